@@ -59,6 +59,27 @@
 #include "ble_srv_common.h"
 
 
+#define APP_BEACON_SCHEDULE_MAX         16      /**< Most slots in one pass through the frames, the sum of their ratios. */
+#define APP_BEACON_UID_NAMESPACE_SIZE   10
+#define APP_BEACON_UID_INSTANCE_SIZE     6
+
+/**@brief Frames the beacon rotates through, each built once into its own PDU. */
+typedef enum
+{
+    APP_BEACON_FRAME_URL,                                       /**< Eddystone-URL. */
+    APP_BEACON_FRAME_UID,                                       /**< Eddystone-UID. */
+    APP_BEACON_FRAME_TLM,                                       /**< Eddystone-TLM, unencrypted. */
+    APP_BEACON_FRAME_RAW,                                       /**< Any advertising data, such as manufacturer specific data. */
+    APP_BEACON_FRAME_COUNT
+} app_beacon_frame_t;
+
+typedef struct
+{
+    uint16_t                battery_mv;                         /**< Battery voltage, 0 if it is not measured. */
+    int16_t                 temperature;                        /**< In degrees Celsius, 8.8 fixed point, 0x8000 if it is not measured. */
+    uint32_t                uptime;                             /**< Time since power on, in units of 0.1 s. */
+} app_beacon_tlm_t;
+
 typedef struct
 {
     uint32_t                adv_interval;
@@ -66,8 +87,18 @@ typedef struct
     uint16_t                data_size;
     ble_gap_addr_t          beacon_addr;                        /** ble address to be used by the beacon*/
     ble_srv_error_handler_t error_handler;                      /**< Function to be called in case of an error. */
+    uint32_t                timer_prescaler;                    /**< Prescaler app_timer was initialized with, retries are delayed with it. */
 } ble_beacon_init_t;
 
+typedef struct
+{
+    uint32_t                granted;                            /**< Timeslots granted. */
+    uint32_t                blocked;                            /**< Timeslot requests blocked by other radio activity. */
+    uint32_t                canceled;                           /**< Granted timeslots canceled before they started. */
+    uint32_t                slot_length;                        /**< Length requested for the next timeslot, in us. */
+    uint32_t                last_slot_used;                     /**< Time the last timeslot took, in us. */
+} app_beacon_stats_t;
+
 
 /**@brief Function for handling system events.
  *
@@ -83,6 +114,61 @@ void app_beacon_on_sys_evt(uint32_t event);
  */
 void app_beacon_init(ble_beacon_init_t * p_init);
 
+/**@brief Function for changing the URL of the URL frame.
+ *
+ * @details The advertising packet is rebuilt here, not in the radio slots. The new data is sent
+ *          from the next slot of the frame on. The same goes for the other frames below.
+ *
+ * @param[in]   p_data     New data, copied.
+ * @param[in]   data_size  Size of the data, at most 18 bytes.
+ *
+ * @retval NRF_SUCCESS               If the data was updated.
+ * @retval NRF_ERROR_INVALID_LENGTH  If the data does not fit in the advertising packet.
+ * @retval NRF_ERROR_BUSY            If the previous update is still being sent, try again later.
+ */
+uint32_t app_beacon_data_update(uint8_t const * p_data, uint16_t data_size);
+
+/**@brief Function for setting the UID frame.
+ *
+ * @param[in]   p_namespace  @ref APP_BEACON_UID_NAMESPACE_SIZE bytes, copied.
+ * @param[in]   p_instance   @ref APP_BEACON_UID_INSTANCE_SIZE bytes, copied.
+ */
+uint32_t app_beacon_uid_set(uint8_t const * p_namespace, uint8_t const * p_instance);
+
+/**@brief Function for updating the TLM frame. The advertising count is filled in here.
+ *
+ * @details The frame is only as fresh as the last update, call it every few seconds.
+ */
+uint32_t app_beacon_tlm_update(app_beacon_tlm_t const * p_tlm);
+
+/**@brief Function for setting the raw frame.
+ *
+ * @details Everything after the flags is given as ready advertising data structures.
+ *
+ * @param[in]   p_ad       Advertising data structures, copied.
+ * @param[in]   ad_size    Size of the data, at most 28 bytes.
+ */
+uint32_t app_beacon_adv_data_update(uint8_t const * p_ad, uint16_t ad_size);
+
+/**@brief Function for setting how often a frame is sent.
+ *
+ * @details The frames are interleaved into a schedule of as many slots as the ratios add up to,
+ *          a frame with ratio 3 next to one with ratio 1 goes out in 3 of every 4 slots. Ratio 0
+ *          stops sending the frame. Only the URL frame is sent after @ref app_beacon_init.
+ *
+ * @retval NRF_SUCCESS              If the schedule was changed.
+ * @retval NRF_ERROR_INVALID_STATE  If the frame has no data yet.
+ * @retval NRF_ERROR_INVALID_PARAM  If no frame would be left, or the ratios add up to more than
+ *                                  @ref APP_BEACON_SCHEDULE_MAX.
+ */
+uint32_t app_beacon_frame_ratio_set(app_beacon_frame_t frame, uint8_t ratio);
+
+/**@brief Function for changing the advertising interval, in milliseconds. */
+void app_beacon_interval_set(uint32_t adv_interval);
+
+/**@brief Function for reading the timeslot counters. */
+void app_beacon_stats_get(app_beacon_stats_t * p_stats);
+
 /**@brief Function for starting the advertisement.
  *
  */
@@ -42,9 +42,11 @@
 #include "nrf_soc.h"
 #include "app_error.h"
 #include "app_util.h"
+#include "app_timer.h"
 #define  NRF_LOG_MODULE_NAME "adv_beacon_..."
 #include "nrf_log.h"
 #include "macros_common.h"
+#include "trace.h"
 
 #define ADV_PACK_LENGTH_IDX     1
 #define ADV_DATA_LENGTH_IDX    16
@@ -57,7 +59,44 @@
 #define FREQ_ADV_CHANNEL_37     2
 #define FREQ_ADV_CHANNEL_38    26
 #define FREQ_ADV_CHANNEL_39    80
-#define BEACON_SLOT_LENGTH   5500
+#define ADV_PDU_SIZE           40       /**< Header, S1 byte, address and 31 bytes of advertising data. */
+#define ADV_PDU_AD_OFFSET      12       /**< Where the advertising data after the flags starts in the PDU. */
+#define ADV_PDU_FRAME_OFFSET   21       /**< Where the Eddystone frame after the frame type starts in the PDU. */
+#define ADV_PDU_DATA_OFFSET    22       /**< Where the URL starts in the PDU. */
+#define ADV_PDU_MAX_AD_SIZE    (ADV_PDU_SIZE - ADV_PDU_AD_OFFSET)
+#define ADV_PDU_MAX_DATA_SIZE  (ADV_PDU_SIZE - ADV_PDU_DATA_OFFSET)
+
+#define EDDYSTONE_UID          0x00
+#define EDDYSTONE_URL          0x10
+#define EDDYSTONE_TLM          0x20
+#define EDDYSTONE_TX_POWER     0xEE     /**< Calibrated power at 0 m, in dBm. */
+#define EDDYSTONE_UID_SIZE     19       /**< Tx power, namespace, instance, two reserved bytes. */
+#define EDDYSTONE_TLM_SIZE     13       /**< Version, battery, temperature, advertising count, uptime. */
+
+// Three packets of 47 bytes on air (376 us each) with TX ramp-up (140 us) and 400 us between the
+// channels is about 2.4 ms, the rest is margin for the start of the slot. The length requested is
+// adapted to what the slots really take, within these limits.
+#define BEACON_SLOT_LENGTH      3000
+#define BEACON_SLOT_LENGTH_MIN  2000
+#define BEACON_SLOT_MARGIN       250    /**< Added to the longest slot seen. */
+#define BEACON_SLOT_WINDOW        16    /**< Slots over which the longest one is taken. */
+
+#define BEACON_BACKOFF_MAX_EXP     5    /**< Retries wait at most 2^5 advertising intervals. */
+
+typedef struct
+{
+    uint8_t                 pdu[2][ADV_PDU_SIZE];               /** Built once per payload, a new payload goes into the buffer not being sent. */
+    uint8_t * volatile      p_pdu;                              /** PDU sent for this frame, NULL until it has data. */
+    uint8_t                 ratio;                              /** Slots out of every pass through the schedule. */
+} beacon_frame_t;
+
+// The frames interleaved, one entry per slot. The slots only step through it, all PDUs in it are
+// built already.
+typedef struct
+{
+    uint8_t                 length;
+    uint8_t                 frames[APP_BEACON_SCHEDULE_MAX];
+} beacon_schedule_t;
 
 static struct
 {
@@ -65,13 +104,27 @@ static struct
     bool                    keep_running;                       /** */
     bool                    is_running;                         /** is the 'beacon' running*/
     uint32_t                slot_length;                        /** */
+    uint32_t                slot_used;                          /** Time the current slot has taken so far, in us. */
+    uint32_t                slot_used_max;                      /** Longest slot in the current window. */
+    uint8_t                 slot_window_count;                  /** Slots in the current window. */
+    bool                    slot_granted;                       /** A slot has been granted in this session, normal requests can be made. */
+    uint8_t                 block_count;                        /** Requests blocked or canceled in a row. */
+    bool                    retry_pending;                      /** The retry timer makes the next request, the session is left alone until it does. */
+    uint32_t                timer_prescaler;                    /** Prescaler app_timer was initialized with. */
+    uint32_t                distance;                           /** From the start of the last granted slot to the next request, in us. */
+    app_beacon_stats_t      stats;
     nrf_radio_request_t     timeslot_request;                   /** */
     ble_gap_addr_t          beacon_addr;                        /** ble address to be used by the beacon. */
     ble_srv_error_handler_t error_handler;                      /** Function to be called in case of an error. */
-    uint8_t               * p_data;
-    uint16_t                data_size;
+    beacon_frame_t          frames[APP_BEACON_FRAME_COUNT];
+    beacon_schedule_t       schedules[2];                       /** A new schedule goes into the one not in use. */
+    beacon_schedule_t * volatile p_schedule;                    /** Schedule the slots go through. */
+    uint8_t                 schedule_idx;                       /** Next entry of the schedule, only used in the slots. */
+    uint8_t * volatile      p_slot_pdu;                         /** PDU the current slot is sending, NULL between slots. */
 } m_beacon;
 
+APP_TIMER_DEF(m_retry_timer_id);
+
 enum mode_t
 {
   ADV_INIT,                                                 /** Initialisation. */
@@ -87,7 +140,7 @@ nrf_radio_request_t * m_configure_next_event(void)
     m_beacon.timeslot_request.request_type              = NRF_RADIO_REQ_TYPE_NORMAL;
     m_beacon.timeslot_request.params.normal.hfclk       = NRF_RADIO_HFCLK_CFG_XTAL_GUARANTEED;
     m_beacon.timeslot_request.params.normal.priority    = NRF_RADIO_PRIORITY_HIGH;
-    m_beacon.timeslot_request.params.normal.distance_us = m_beacon.adv_interval * 1000;
+    m_beacon.timeslot_request.params.normal.distance_us = m_beacon.distance;
     m_beacon.timeslot_request.params.normal.length_us   = m_beacon.slot_length;
     return &m_beacon.timeslot_request;
 }
@@ -104,17 +157,46 @@ uint32_t m_request_earliest(enum NRF_RADIO_PRIORITY priority)
 }
 
 
-static uint8_t * m_get_adv_packet(void)
+// Called at the end of every slot with the time it took.
+static void m_slot_length_update(uint32_t slot_used)
+{
+    m_beacon.stats.last_slot_used = slot_used;
+    m_beacon.slot_used_max = MAX(m_beacon.slot_used_max, slot_used);
+
+    // Grow right away if a slot came close to the end, shrink only after a whole window.
+    if (slot_used + BEACON_SLOT_MARGIN / 2 > m_beacon.slot_length)
+    {
+        m_beacon.slot_length = MIN(slot_used + BEACON_SLOT_MARGIN, BEACON_SLOT_LENGTH);
+    }
+    else if (++m_beacon.slot_window_count >= BEACON_SLOT_WINDOW)
+    {
+        m_beacon.slot_length = MAX(MIN(m_beacon.slot_used_max + BEACON_SLOT_MARGIN, BEACON_SLOT_LENGTH),
+                                   BEACON_SLOT_LENGTH_MIN);
+        m_beacon.slot_used_max     = 0;
+        m_beacon.slot_window_count = 0;
+    }
+    m_beacon.stats.slot_length = m_beacon.slot_length;
+}
+
+
+// Time the radio has been running in this slot, TIMER0 counts from the start of the slot until it is
+// cleared for the next channel.
+static void m_slot_time_add(void)
+{
+    NRF_TIMER0->TASKS_CAPTURE[1] = 1;
+    m_beacon.slot_used += NRF_TIMER0->CC[1];
+}
+
+
+// Header, address and flags, returns where the rest of the advertising data goes.
+static uint8_t m_build_adv_header(uint8_t * adv_pdu)
 {
-    static uint8_t adv_pdu[40];
-    uint8_t packet_len_start_idx, service_data_len_idx;
     uint8_t offset    = 0;
 
     // Constructing header
     adv_pdu[offset]    = BLE_GAP_ADV_TYPE_ADV_SCAN_IND;    // Advertisement type ADV_NONCONN_IND.
     adv_pdu[offset++] |= 1 << 6;                           // TxAdd 1 (random address).
     adv_pdu[offset++]  = 0;                                // Packet length field (will be filled later).
-    packet_len_start_idx = offset;
     adv_pdu[offset++]  = 0x00;                             // Extra byte used to map into the radio register.
 
     // Constructing base advertising packet.
@@ -126,6 +208,16 @@ static uint8_t * m_get_adv_packet(void)
     adv_pdu[offset++] =  BLE_GAP_AD_TYPE_FLAGS;
     adv_pdu[offset++] =  BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
 
+    return offset;
+}
+
+
+// Eddystone service data of the given frame type, the frame itself follows the type.
+static void m_build_eddystone_packet(uint8_t * adv_pdu, uint8_t frame_type, uint8_t const * p_data, uint16_t data_size)
+{
+    uint8_t service_data_len_idx;
+    uint8_t offset = m_build_adv_header(adv_pdu);
+
     // Adding eddystone url UUID.
     adv_pdu[offset++] = 0x03;
     adv_pdu[offset++] = BLE_GAP_AD_TYPE_16BIT_SERVICE_UUID_COMPLETE;
@@ -138,18 +230,26 @@ static uint8_t * m_get_adv_packet(void)
     adv_pdu[offset++] = BLE_GAP_AD_TYPE_SERVICE_DATA;
     adv_pdu[offset++] = 0xAA;
     adv_pdu[offset++] = 0xFE;
-    adv_pdu[offset++] = 0x10;
-    adv_pdu[offset++] = 0xEE;
+    adv_pdu[offset++] = frame_type;
 
-    // Adding URL.
-    memcpy(&adv_pdu[offset], m_beacon.p_data, m_beacon.data_size);
-    offset += m_beacon.data_size;
+    // Adding the frame.
+    memcpy(&adv_pdu[offset], p_data, data_size);
+    offset += data_size;
 
     // Filling in length fields.
-    adv_pdu[ADV_PACK_LENGTH_IDX]         = offset - packet_len_start_idx;
+    adv_pdu[ADV_PACK_LENGTH_IDX]         = offset - (ADV_PACK_LENGTH_IDX + 1);
     adv_pdu[ADV_DATA_LENGTH_IDX]         = offset - service_data_len_idx;
+}
+
+
+static void m_build_raw_adv_packet(uint8_t * adv_pdu, uint8_t const * p_ad, uint16_t ad_size)
+{
+    uint8_t offset = m_build_adv_header(adv_pdu);
 
-    return &adv_pdu[0];
+    memcpy(&adv_pdu[offset], p_ad, ad_size);
+    offset += ad_size;
+
+    adv_pdu[ADV_PACK_LENGTH_IDX]         = offset - (ADV_PACK_LENGTH_IDX + 1);
 }
 
 
@@ -173,10 +273,10 @@ static void m_set_adv_ch(uint32_t channel)
 }
 
 
-static void m_configure_radio()
+// The SoftDevice uses the radio between the slots, so it has to be set up again in each one. All
+// values are constants, the PDU is already built.
+static void m_configure_radio(uint8_t * p_adv_pdu)
 {
-    uint8_t * p_adv_pdu = m_get_adv_packet();
-
     NRF_RADIO->POWER        = 1;
     NRF_RADIO->PCNF0        =   (((1UL) << RADIO_PCNF0_S0LEN_Pos                               ) & RADIO_PCNF0_S0LEN_Msk)
                               | (((2UL) << RADIO_PCNF0_S1LEN_Pos                               ) & RADIO_PCNF0_S1LEN_Msk)
@@ -205,13 +305,28 @@ static void m_configure_radio()
 
 void m_handle_start(void)
 {
+    m_beacon.stats.granted++;
+    m_beacon.slot_granted = true;
+    m_beacon.block_count  = 0;
+    m_beacon.distance     = m_beacon.adv_interval * 1000;
+    m_beacon.slot_used    = 0;
+
     // Configure TX_EN on TIMER EVENT_0.
     NRF_PPI->CH[8].TEP    = (uint32_t)(&NRF_RADIO->TASKS_TXEN);
     NRF_PPI->CH[8].EEP    = (uint32_t)(&NRF_TIMER0->EVENTS_COMPARE[0]);
     NRF_PPI->CHENSET      = (1 << 8);
 
+    // Next frame of the schedule, it may have been swapped for a shorter one.
+    beacon_schedule_t * p_schedule = m_beacon.p_schedule;
+    if (m_beacon.schedule_idx >= p_schedule->length)
+    {
+        m_beacon.schedule_idx = 0;
+    }
+    TRACE(TRACE_EVT_TIMESLOT_START, p_schedule->frames[m_beacon.schedule_idx]);
+    m_beacon.p_slot_pdu = m_beacon.frames[p_schedule->frames[m_beacon.schedule_idx++]].p_pdu;
+
     // Configure and initiate radio.
-    m_configure_radio();
+    m_configure_radio(m_beacon.p_slot_pdu);
     NRF_RADIO->TASKS_DISABLE = 1;
 }
 
@@ -226,11 +341,13 @@ void m_handle_radio_disabled(enum mode_t mode)
             break;
         case ADV_RX_CH38:
             m_set_adv_ch(ADV_CHANNEL_38);
+            m_slot_time_add();
             NRF_TIMER0->TASKS_CLEAR = 1;
             NRF_TIMER0->CC[0]       = 400;
             break;
         case ADV_RX_CH39:
             m_set_adv_ch(ADV_CHANNEL_39);
+            m_slot_time_add();
             NRF_TIMER0->TASKS_CLEAR = 1;
             NRF_TIMER0->CC[0]       = 400;
             break;
@@ -267,6 +384,10 @@ static nrf_radio_signal_callback_return_param_t * m_timeslot_callback(uint8_t si
         if (mode == ADV_DONE)
         {
             NRF_PPI->CHENCLR = (1 << 8);
+            m_beacon.p_slot_pdu = NULL;
+            m_slot_time_add();
+            m_slot_length_update(m_beacon.slot_used);
+            TRACE(TRACE_EVT_TIMESLOT_END, m_beacon.slot_used);
             if (m_beacon.keep_running)
             {
                 signal_callback_return_param.params.request.p_next = m_configure_next_event();
@@ -293,33 +414,136 @@ static nrf_radio_signal_callback_return_param_t * m_timeslot_callback(uint8_t si
 }
 
 
-void app_beacon_on_sys_evt(uint32_t event)
+// Exponential backoff with jitter: after the n-th blocked or canceled request in a row wait another
+// 2^(n-1) to 2^n advertising intervals, so a busy connection is not hit by a retry every interval.
+static uint32_t m_request_retry(void)
+{
+    uint32_t backoff;
+    uint32_t jitter = 0;
+
+    m_beacon.block_count = MIN(m_beacon.block_count + 1, BEACON_BACKOFF_MAX_EXP);
+    backoff = m_beacon.adv_interval * 1000 << (m_beacon.block_count - 1);
+
+    if (sd_rand_application_vector_get((uint8_t *)&jitter, sizeof(jitter)) != NRF_SUCCESS)
+    {
+        jitter = 0;
+    }
+    backoff += jitter % backoff;
+
+    if (m_beacon.slot_granted)
+    {
+        m_beacon.distance += backoff;
+        if (m_beacon.distance <= NRF_RADIO_DISTANCE_MAX_US)
+        {
+            return sd_radio_request(m_configure_next_event());
+        }
+        // Too long since the last slot to time from it, start over.
+        m_beacon.slot_granted = false;
+    }
+
+    // Normal requests are timed from the last granted slot and there is none to time from, an
+    // earliest request goes out once the backoff is over.
+    uint32_t err_code = app_timer_start(m_retry_timer_id, APP_TIMER_TICKS(backoff / 1000, m_beacon.timer_prescaler), NULL);
+    m_beacon.retry_pending = (err_code == NRF_SUCCESS);
+    return err_code;
+}
+
+
+static void m_retry_timer_handler(void * p_context)
 {
     uint32_t err_code;
 
-    NRF_LOG_INFO("app_beacon_on_sys_evt: %d\r\n", event);
+    m_beacon.retry_pending = false;
+    if (m_beacon.keep_running)
+    {
+        err_code = m_request_earliest(NRF_RADIO_PRIORITY_NORMAL);
+    }
+    else
+    {
+        // Stopped during the backoff, the session has nothing left to wait for.
+        err_code = sd_radio_session_close();
+    }
+    if ((err_code != NRF_SUCCESS) && (m_beacon.error_handler != NULL))
+    {
+        m_beacon.error_handler(err_code);
+    }
+}
+
+
+static void m_session_open(void)
+{
+    m_beacon.is_running   = true;
+    m_beacon.slot_granted = false;
+    m_beacon.block_count  = 0;
+    m_beacon.retry_pending = false;
+
+    uint32_t err_code = sd_radio_session_open(m_timeslot_callback);
+    if ((err_code != NRF_SUCCESS) && (m_beacon.error_handler != NULL))
+    {
+        m_beacon.error_handler(err_code);
+    }
+
+    err_code = m_request_earliest(NRF_RADIO_PRIORITY_NORMAL);
+    if ((err_code != NRF_SUCCESS) && (m_beacon.error_handler != NULL))
+    {
+        m_beacon.error_handler(err_code);
+    }
+}
+
+
+void app_beacon_on_sys_evt(uint32_t event)
+{
+    uint32_t err_code;
 
     switch (event)
     {
         case NRF_EVT_RADIO_SESSION_IDLE:
-            if (m_beacon.is_running)
+            TRACE(TRACE_EVT_SYS, event);
+            if (m_beacon.retry_pending)
+            {
+                // Idle during the backoff, the retry timer requests or closes.
+                break;
+            }
+            if (m_beacon.keep_running)
+            {
+                // Started again before the last slot of the stop was over.
+                m_beacon.slot_granted = false;
+                err_code = m_request_earliest(NRF_RADIO_PRIORITY_NORMAL);
+            }
+            else
             {
-                m_beacon.is_running = false;
                 err_code = sd_radio_session_close();
-                if ((err_code != NRF_SUCCESS) && (m_beacon.error_handler != NULL))
-                {
-                    m_beacon.error_handler(err_code);
-                }
+            }
+            if ((err_code != NRF_SUCCESS) && (m_beacon.error_handler != NULL))
+            {
+                m_beacon.error_handler(err_code);
             }
             break;
         case NRF_EVT_RADIO_SESSION_CLOSED:
+            TRACE(TRACE_EVT_SYS, event);
+            m_beacon.is_running = false;
+            if (m_beacon.keep_running)
+            {
+                // Started again while the session was closing.
+                m_session_open();
+            }
             break;
         case NRF_EVT_RADIO_BLOCKED:
         case NRF_EVT_RADIO_CANCELED: // Fall through.
+            if (event == NRF_EVT_RADIO_BLOCKED)
+            {
+                m_beacon.stats.blocked++;
+                TRACE(TRACE_EVT_TIMESLOT_BLOCKED, m_beacon.stats.blocked);
+            }
+            else
+            {
+                m_beacon.stats.canceled++;
+                TRACE(TRACE_EVT_TIMESLOT_CANCELED, m_beacon.stats.canceled);
+            }
+
             if (m_beacon.keep_running)
             {
-                // A proper solution should try again in <block_count> * m_beacon.adv_interval
-                err_code = m_request_earliest(NRF_RADIO_PRIORITY_HIGH);
+                err_code = m_request_retry();
                 if ((err_code != NRF_SUCCESS) && (m_beacon.error_handler != NULL))
                 {
                     m_beacon.error_handler(err_code);
@@ -332,39 +556,216 @@ void app_beacon_on_sys_evt(uint32_t event)
 }
 
 
+// Interleave the frames by their ratios (smooth weighted round robin), so a frame sent more often
+// is spread over the pass instead of going out in a burst.
+static void m_schedule_build(beacon_schedule_t * p_schedule)
+{
+    int16_t credit[APP_BEACON_FRAME_COUNT] = {0};
+    uint8_t total = 0;
+
+    for (uint8_t f = 0; f < APP_BEACON_FRAME_COUNT; f++)
+    {
+        total += m_beacon.frames[f].ratio;
+    }
+
+    for (p_schedule->length = 0; p_schedule->length < total; p_schedule->length++)
+    {
+        uint8_t best = 0;
+
+        for (uint8_t f = 0; f < APP_BEACON_FRAME_COUNT; f++)
+        {
+            credit[f] += m_beacon.frames[f].ratio;
+            if (credit[f] > credit[best])
+            {
+                best = f;
+            }
+        }
+        credit[best] -= total;
+        p_schedule->frames[p_schedule->length] = best;
+    }
+}
+
+
 void app_beacon_init(ble_beacon_init_t * p_init)
 {
     NRF_LOG_INFO("app_beacon_init:\r\n");
     m_beacon.adv_interval  = p_init->adv_interval;
     m_beacon.slot_length   = BEACON_SLOT_LENGTH;
+    m_beacon.distance      = m_beacon.adv_interval * 1000;
+    memset(&m_beacon.stats, 0, sizeof(m_beacon.stats));
+    m_beacon.stats.slot_length = BEACON_SLOT_LENGTH;
     m_beacon.beacon_addr   = p_init->beacon_addr;
     m_beacon.error_handler = p_init->error_handler;
-    m_beacon.data_size     = p_init->data_size;
-    m_beacon.p_data        = p_init->p_data;
+    m_beacon.p_slot_pdu    = NULL;
+    m_beacon.timer_prescaler = p_init->timer_prescaler;
+    m_beacon.retry_pending = false;
+
+    uint32_t err_code = app_timer_create(&m_retry_timer_id, APP_TIMER_MODE_SINGLE_SHOT, m_retry_timer_handler);
+    APP_ERROR_CHECK(err_code);
+
+    // Only the URL frame until others are set.
+    memset(m_beacon.frames, 0, sizeof(m_beacon.frames));
+    UNUSED_RETURN_VALUE(app_beacon_data_update(p_init->p_data, MIN(p_init->data_size, ADV_PDU_MAX_DATA_SIZE)));
+    m_beacon.frames[APP_BEACON_FRAME_URL].ratio = 1;
+
+    m_schedule_build(&m_beacon.schedules[0]);
+    m_beacon.p_schedule    = &m_beacon.schedules[0];
+    m_beacon.schedule_idx  = 0;
+}
+
+
+// PDU buffer an update of the frame can be built in, NULL if both are still in use.
+static uint8_t * m_free_pdu_get(app_beacon_frame_t frame)
+{
+    beacon_frame_t * p_frame = &m_beacon.frames[frame];
+    uint8_t        * p_free  = (p_frame->p_pdu == p_frame->pdu[0]) ? p_frame->pdu[1] : p_frame->pdu[0];
+
+    // The other one may still be sent from before the last update.
+    return (p_free == m_beacon.p_slot_pdu) ? NULL : p_free;
+}
+
+
+// Eddystone frame of the given type, the frame data starts with the tx power.
+static uint32_t m_eddystone_update(app_beacon_frame_t frame, uint8_t frame_type, uint8_t const * p_data, uint16_t data_size)
+{
+    uint8_t * p_free = m_free_pdu_get(frame);
+
+    if (p_free == NULL)
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+    m_build_eddystone_packet(p_free, frame_type, p_data, data_size);
+    m_beacon.frames[frame].p_pdu = p_free;
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_beacon_data_update(uint8_t const * p_data, uint16_t data_size)
+{
+    uint8_t frame[ADV_PDU_SIZE - ADV_PDU_FRAME_OFFSET];
+
+    if (data_size > ADV_PDU_MAX_DATA_SIZE)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    frame[0] = EDDYSTONE_TX_POWER;
+    memcpy(&frame[1], p_data, data_size);
+
+    return m_eddystone_update(APP_BEACON_FRAME_URL, EDDYSTONE_URL, frame, data_size + 1);
+}
+
+
+uint32_t app_beacon_uid_set(uint8_t const * p_namespace, uint8_t const * p_instance)
+{
+    uint8_t frame[EDDYSTONE_UID_SIZE];
+
+    frame[0] = EDDYSTONE_TX_POWER;
+    memcpy(&frame[1], p_namespace, APP_BEACON_UID_NAMESPACE_SIZE);
+    memcpy(&frame[1 + APP_BEACON_UID_NAMESPACE_SIZE], p_instance, APP_BEACON_UID_INSTANCE_SIZE);
+    frame[EDDYSTONE_UID_SIZE - 2] = 0;
+    frame[EDDYSTONE_UID_SIZE - 1] = 0;
+
+    return m_eddystone_update(APP_BEACON_FRAME_UID, EDDYSTONE_UID, frame, EDDYSTONE_UID_SIZE);
+}
+
+
+uint32_t app_beacon_tlm_update(app_beacon_tlm_t const * p_tlm)
+{
+    uint8_t frame[EDDYSTONE_TLM_SIZE];
+    uint8_t offset = 0;
+
+    // Unencrypted TLM, all values big endian.
+    frame[offset++] = 0x00;
+    offset += uint16_big_encode(p_tlm->battery_mv, &frame[offset]);
+    offset += uint16_big_encode((uint16_t)p_tlm->temperature, &frame[offset]);
+    offset += uint32_big_encode(m_beacon.stats.granted, &frame[offset]);
+    offset += uint32_big_encode(p_tlm->uptime, &frame[offset]);
+
+    return m_eddystone_update(APP_BEACON_FRAME_TLM, EDDYSTONE_TLM, frame, offset);
+}
+
+
+uint32_t app_beacon_adv_data_update(uint8_t const * p_ad, uint16_t ad_size)
+{
+    uint8_t * p_free = m_free_pdu_get(APP_BEACON_FRAME_RAW);
+
+    if (ad_size > ADV_PDU_MAX_AD_SIZE)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+    if (p_free == NULL)
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+    m_build_raw_adv_packet(p_free, p_ad, ad_size);
+    m_beacon.frames[APP_BEACON_FRAME_RAW].p_pdu = p_free;
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_beacon_frame_ratio_set(app_beacon_frame_t frame, uint8_t ratio)
+{
+    beacon_schedule_t * p_free;
+    uint8_t             old_ratio;
+    uint16_t            total = 0;
+
+    if (frame >= APP_BEACON_FRAME_COUNT)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (ratio != 0 && m_beacon.frames[frame].p_pdu == NULL)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    old_ratio = m_beacon.frames[frame].ratio;
+    m_beacon.frames[frame].ratio = ratio;
+    for (uint8_t f = 0; f < APP_BEACON_FRAME_COUNT; f++)
+    {
+        total += m_beacon.frames[f].ratio;
+    }
+    if (total == 0 || total > APP_BEACON_SCHEDULE_MAX)
+    {
+        m_beacon.frames[frame].ratio = old_ratio;
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    // The slots only read the schedule when they start, and they preempt this, so the one not in
+    // use can be rebuilt and swapped in.
+    p_free = (m_beacon.p_schedule == &m_beacon.schedules[0]) ? &m_beacon.schedules[1] : &m_beacon.schedules[0];
+    m_schedule_build(p_free);
+    m_beacon.p_schedule = p_free;
+
+    return NRF_SUCCESS;
+}
+
+
+void app_beacon_interval_set(uint32_t adv_interval)
+{
+    // Used from the next granted slot on.
+    m_beacon.adv_interval = adv_interval;
 }
 
 
 void app_beacon_start(void)
 {
-    if (m_beacon.is_running || m_beacon.keep_running)
+    if (m_beacon.keep_running)
     {
         return;
     }
 
     NRF_LOG_INFO("app_beacon_start:\r\n");
     m_beacon.keep_running = true;
-    m_beacon.is_running   = true;
-
-    uint32_t err_code = sd_radio_session_open(m_timeslot_callback);
-    if ((err_code != NRF_SUCCESS) && (m_beacon.error_handler != NULL))
-    {
-        m_beacon.error_handler(err_code);
-    }
 
-    err_code = m_request_earliest(NRF_RADIO_PRIORITY_NORMAL);
-    if ((err_code != NRF_SUCCESS) && (m_beacon.error_handler != NULL))
+    // A session still winding down from a stop picks the beacon up again once it is idle or closed.
+    if (!m_beacon.is_running)
     {
-        m_beacon.error_handler(err_code);
+        m_session_open();
     }
 }
 
@@ -374,3 +775,11 @@ void app_beacon_stop(void)
     NRF_LOG_INFO("app_beacon_stop:\r\n");
     m_beacon.keep_running = false;
 }
+
+
+void app_beacon_stats_get(app_beacon_stats_t * p_stats)
+{
+    // The timeslot callback runs above any critical region, the counters are only consistent
+    // one by one.
+    *p_stats = m_beacon.stats;
+}
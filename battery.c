@@ -0,0 +1,214 @@
+
+#include "nrf.h"
+#include "nrf_drv_saadc.h"
+#include "app_timer.h"
+#include "app_error.h"
+#include "app_util_platform.h"
+#include "sdk_common.h"
+#include "battery.h"
+
+#define INPUT_RANGE_MV          3600        //0.6 V reference with a gain of 1/6
+#define RESOLUTION_BITS         12
+#define CALIBRATION_INTERVAL    60          //conversions between two offset calibrations
+#define SMOOTHING_SHIFT         2           //each reading moves the smoothed value by a quarter
+#define PLAUSIBLE_MIN_MV        2500        //below the cut off of any LiPo protection, the input is open or the divider wrong
+
+//resting voltage of a LiPo cell against its charge, rising, between the points it is interpolated
+static const struct
+{
+    uint16_t voltage_mv;
+    uint8_t  level;
+} m_discharge_curve[] =
+{
+    {3300,   0},
+    {3500,   5},
+    {3600,  10},
+    {3700,  25},
+    {3750,  40},
+    {3800,  55},
+    {3850,  65},
+    {3900,  75},
+    {4000,  85},
+    {4100,  95},
+    {4200, 100},
+};
+
+#define CURVE_POINTS            (sizeof(m_discharge_curve) / sizeof(m_discharge_curve[0]))
+
+APP_TIMER_DEF(m_battery_timer_id);
+
+static battery_config_t  m_config;
+static nrf_saadc_value_t m_sample;
+static uint8_t           m_conversions;     //since the last calibration
+static bool              m_valid;           //m_voltage_mv holds a reading
+static volatile uint16_t m_voltage_mv;
+static volatile uint8_t  m_level;
+
+
+static uint8_t level_get(uint16_t voltage_mv)
+{
+    uint8_t i;
+
+    if(voltage_mv <= m_discharge_curve[0].voltage_mv)
+    {
+        return 0;
+    }
+    if(voltage_mv >= m_discharge_curve[CURVE_POINTS - 1].voltage_mv)
+    {
+        return 100;
+    }
+    for(i = 1; voltage_mv > m_discharge_curve[i].voltage_mv; i++)
+    {
+    }
+
+    return m_discharge_curve[i - 1].level +
+           (voltage_mv - m_discharge_curve[i - 1].voltage_mv) * (m_discharge_curve[i].level - m_discharge_curve[i - 1].level) /
+           (m_discharge_curve[i].voltage_mv - m_discharge_curve[i - 1].voltage_mv);
+}
+
+
+static void conversion_start(void)
+{
+    uint32_t err_code;
+
+    err_code = nrf_drv_saadc_buffer_convert(&m_sample, 1);
+    APP_ERROR_CHECK(err_code);
+    err_code = nrf_drv_saadc_sample();
+    APP_ERROR_CHECK(err_code);
+}
+
+
+static void conversion_done(nrf_saadc_value_t sample)
+{
+    uint32_t voltage_mv;
+
+    //slightly below zero with the offset of a grounded input
+    sample     = MAX(sample, 0);
+    voltage_mv = (uint32_t)sample * INPUT_RANGE_MV * m_config.divider_num / (m_config.divider_den << RESOLUTION_BITS);
+    if(voltage_mv < PLAUSIBLE_MIN_MV)
+    {
+        //not a cell, neither averaged in nor handed on
+        return;
+    }
+
+    if(!m_valid)
+    {
+        m_voltage_mv = voltage_mv;
+        m_valid      = true;
+    }
+    else
+    {
+        m_voltage_mv += ((int32_t)voltage_mv - m_voltage_mv) >> SMOOTHING_SHIFT;
+    }
+    m_level = level_get(m_voltage_mv);
+
+    if(m_config.handler != NULL)
+    {
+        m_config.handler(m_voltage_mv, m_level);
+    }
+}
+
+
+static void saadc_evt_handler(nrf_drv_saadc_evt_t const * p_event)
+{
+    switch(p_event->type)
+    {
+        case NRF_DRV_SAADC_EVT_CALIBRATEDONE:
+            conversion_start();
+            break;
+
+        case NRF_DRV_SAADC_EVT_DONE:
+            //the SAADC keeps drawing current while it is enabled, it is off until the next conversion
+            nrf_drv_saadc_uninit();
+            NRF_SAADC->INTENCLR = (SAADC_INTENCLR_END_Clear << SAADC_INTENCLR_END_Pos);
+            NVIC_ClearPendingIRQ(SAADC_IRQn);
+
+            conversion_done(p_event->data.done.p_buffer[0]);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+static void battery_timer_handler(void * p_context)
+{
+    uint32_t err_code;
+
+    nrf_drv_saadc_config_t const saadc_config =
+    {
+        .resolution         = NRF_SAADC_RESOLUTION_12BIT,
+        .oversample         = NRF_SAADC_OVERSAMPLE_8X,
+        .interrupt_priority = APP_IRQ_PRIORITY_LOW,
+        .low_power_mode     = true
+    };
+
+    //the divider is high impedance, the longest acquisition time charges the sampling capacitor from it
+    nrf_saadc_channel_config_t channel_config = NRF_DRV_SAADC_DEFAULT_CHANNEL_CONFIG_SE(m_config.ain);
+    channel_config.acq_time = NRF_SAADC_ACQTIME_40US;
+    channel_config.burst    = NRF_SAADC_BURST_ENABLED;
+
+    err_code = nrf_drv_saadc_init(&saadc_config, saadc_evt_handler);
+    if(err_code == NRF_ERROR_INVALID_STATE)
+    {
+        //the last conversion did not finish yet, this one is skipped
+        return;
+    }
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_drv_saadc_channel_init(0, &channel_config);
+    APP_ERROR_CHECK(err_code);
+
+    if(m_conversions++ == 0)
+    {
+        //the offset drifts with the temperature, the conversion follows the calibration
+        err_code = nrf_drv_saadc_calibrate_offset();
+        APP_ERROR_CHECK(err_code);
+        return;
+    }
+    if(m_conversions == CALIBRATION_INTERVAL)
+    {
+        m_conversions = 0;
+    }
+    conversion_start();
+}
+
+
+uint32_t battery_init(battery_config_t const * p_config)
+{
+    uint32_t err_code;
+
+    VERIFY_PARAM_NOT_NULL(p_config);
+    if(p_config->divider_den == 0 || p_config->divider_num == 0)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    m_config      = *p_config;
+    m_conversions = 0;
+    m_valid       = false;
+    m_voltage_mv  = 0;
+    m_level       = 0;
+
+    err_code = app_timer_create(&m_battery_timer_id, APP_TIMER_MODE_REPEATED, battery_timer_handler);
+    VERIFY_SUCCESS(err_code);
+    err_code = app_timer_start(m_battery_timer_id, m_config.interval, NULL);
+    VERIFY_SUCCESS(err_code);
+
+    battery_timer_handler(NULL);
+
+    return NRF_SUCCESS;
+}
+
+
+uint16_t battery_voltage_get(void)
+{
+    return m_voltage_mv;
+}
+
+
+uint8_t battery_level_get(void)
+{
+    return m_level;
+}
@@ -0,0 +1,36 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nrf_saadc.h"
+
+/* Battery voltage through the SAADC. A timer starts one conversion a while, 8 samples in a
+ * burst averaged by the SAADC itself and written by EasyDMA, so the CPU only wakes up for the
+ * result. The SAADC is only enabled for the conversion. The readings are smoothed and turned
+ * into a state of charge along the discharge curve of a LiPo cell. Readings no cell can give, as
+ * from an open input, are dropped.
+ */
+
+//called from the SAADC interrupt after every conversion with a plausible reading
+typedef void (*battery_handler_t)(uint16_t voltage_mv, uint8_t level);
+
+typedef struct
+{
+    nrf_saadc_input_t ain;                  //SAADC input of the divider
+    uint16_t          divider_num;          //battery voltage = input voltage * num / den
+    uint16_t          divider_den;
+    uint32_t          interval;             //app_timer ticks between two conversions
+    battery_handler_t handler;              //may be NULL
+} battery_config_t;
+
+//the first conversion is started right away
+uint32_t battery_init(battery_config_t const * p_config);
+
+//last smoothed reading, 0 before the first plausible conversion
+uint16_t battery_voltage_get(void);
+
+//state of charge in %, 0 to 100
+uint8_t battery_level_get(void);
+
+#endif  //BATTERY_H
@@ -5,6 +5,10 @@
 
 #define BLE_UUID_GL_SERVICE 0x0001
 #define BLE_UUID_GL_COLOR_CHARACTERISTIC 0x0002                      /**< The UUID of the TX Characteristic. */
+#define BLE_UUID_GL_ANIMATION_CHARACTERISTIC 0x0003                  /**< The UUID of the animation characteristic. */
+#define BLE_UUID_GL_STREAM_CHARACTERISTIC 0x0004                     /**< The UUID of the stream characteristic. */
+#define BLE_UUID_GL_CMD_CHARACTERISTIC 0x0005                        /**< The UUID of the command characteristic. */
+#define BLE_UUID_GL_TRACE_CHARACTERISTIC 0x0006                      /**< The UUID of the trace characteristic. */
 
 #define GLASS_LIGHT_BASE_UUID                  {{0x35, 0xe4, 0x5a, 0xb1, 0xcd, 0x29, 0x0e, 0x9f, 0x4d, 0x4b, 0xa6, 0x4c, 0x00, 0x00, 0xd4, 0x28}} /**< Used vendor specific UUID. */
 
@@ -16,6 +20,8 @@
 static void on_connect(ble_nus_t * p_nus, ble_evt_t * p_ble_evt)
 {
     p_nus->conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    p_nus->stream_seq_valid = false;
+    p_nus->max_data_len = BLE_NUS_MAX_DATA_LEN;
 }
 
 
@@ -28,6 +34,164 @@ static void on_disconnect(ble_nus_t * p_nus, ble_evt_t * p_ble_evt)
 {
     UNUSED_PARAMETER(p_ble_evt);
     p_nus->conn_handle = BLE_CONN_HANDLE_INVALID;
+    p_nus->is_notification_enabled = false;
+    p_nus->is_trace_notification_enabled = false;
+}
+
+
+/**@brief Function for handling a packet written to the stream characteristic.
+ *
+ * @param[in] p_nus     Nordic UART Service structure.
+ * @param[in] p_data    Packet.
+ * @param[in] length    Length of the packet.
+ */
+static void on_stream_write(ble_nus_t * p_nus, uint8_t const * p_data, uint16_t length)
+{
+    ble_gl_stream_evt_t evt;
+
+    if(length < BLE_GL_STREAM_HEADER_SIZE || (length - BLE_GL_STREAM_HEADER_SIZE) % sizeof(nrf_drv_WS2812_pixel_t) != 0)
+    {
+        return;
+    }
+
+    evt.seq          = p_data[0];
+    evt.show         = (p_data[1] & BLE_GL_STREAM_SHOW) != 0;
+    evt.first_pixel  = uint16_decode(&p_data[2]);
+    evt.nr_of_pixels = (length - BLE_GL_STREAM_HEADER_SIZE) / sizeof(nrf_drv_WS2812_pixel_t);
+    evt.p_pixels     = (nrf_drv_WS2812_pixel_t const *)&p_data[BLE_GL_STREAM_HEADER_SIZE];
+    evt.lost         = p_nus->stream_seq_valid ? (uint8_t)(evt.seq - p_nus->stream_seq) : 0;
+
+    p_nus->stream_seq       = evt.seq + 1;
+    p_nus->stream_seq_valid = true;
+
+    p_nus->stream_handler(p_nus, &evt);
+}
+
+
+/**@brief Function for decoding the payload of one command.
+ *
+ * @retval true   If the payload fits the opcode, or the opcode is unknown and skipped.
+ */
+static bool cmd_decode(ble_gl_cmd_evt_t * p_evt, uint8_t const * p_payload, uint8_t length)
+{
+    switch (p_evt->opcode)
+    {
+        case BLE_GL_CMD_SET_ALL:
+            if (length != sizeof(nrf_drv_WS2812_pixel_t))
+            {
+                return false;
+            }
+            p_evt->params.set_all.p_color = (nrf_drv_WS2812_pixel_t const *)p_payload;
+            return true;
+
+        case BLE_GL_CMD_SET_RANGE:
+            if (length != 4 + sizeof(nrf_drv_WS2812_pixel_t))
+            {
+                return false;
+            }
+            p_evt->params.set_range.first_pixel  = uint16_decode(&p_payload[0]);
+            p_evt->params.set_range.nr_of_pixels = uint16_decode(&p_payload[2]);
+            p_evt->params.set_range.p_color      = (nrf_drv_WS2812_pixel_t const *)&p_payload[4];
+            return true;
+
+        case BLE_GL_CMD_SET_PIXELS:
+            if (length % BLE_GL_CMD_PIXEL_SIZE != 0)
+            {
+                return false;
+            }
+            p_evt->params.set_pixels.nr_of_pixels = length / BLE_GL_CMD_PIXEL_SIZE;
+            p_evt->params.set_pixels.p_data       = p_payload;
+            return true;
+
+        case BLE_GL_CMD_ANIMATION:
+            p_evt->params.animation.p_data = p_payload;
+            p_evt->params.animation.length = length;
+            return length != 0;
+
+        case BLE_GL_CMD_BRIGHTNESS:
+            if (length != 1)
+            {
+                return false;
+            }
+            p_evt->params.brightness = p_payload[0];
+            return true;
+
+        case BLE_GL_CMD_QUERY_STATE:
+            return length == 0;
+
+        case BLE_GL_CMD_PRESET_SAVE:
+            if (length < 1 || length > 1 + BLE_GL_CMD_PRESET_NAME_LEN)
+            {
+                return false;
+            }
+            p_evt->params.preset_save.slot        = p_payload[0];
+            p_evt->params.preset_save.p_name      = &p_payload[1];
+            p_evt->params.preset_save.name_length = length - 1;
+            return true;
+
+        case BLE_GL_CMD_PRESET_LOAD:
+            if (length != 1)
+            {
+                return false;
+            }
+            p_evt->params.preset_load = p_payload[0];
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+
+/**@brief Function for handling a packet written to the command characteristic.
+ *
+ * @details The commands are handed out one by one as they are found, straight from the packet.
+ *
+ * @param[in] p_nus     Nordic UART Service structure.
+ * @param[in] p_data    Packet.
+ * @param[in] length    Length of the packet.
+ */
+static void on_cmd_write(ble_nus_t * p_nus, uint8_t const * p_data, uint16_t length)
+{
+    ble_gl_cmd_evt_t evt;
+    uint16_t         offset = 0;
+
+    while (offset + BLE_GL_CMD_HEADER_SIZE <= length)
+    {
+        uint8_t         payload_length = p_data[offset + 1];
+        uint8_t const * p_payload      = &p_data[offset + BLE_GL_CMD_HEADER_SIZE];
+
+        if (offset + BLE_GL_CMD_HEADER_SIZE + payload_length > length)
+        {
+            return;
+        }
+
+        evt.opcode = (ble_gl_cmd_opcode_t)p_data[offset];
+        offset    += BLE_GL_CMD_HEADER_SIZE + payload_length;
+
+        if (!cmd_decode(&evt, p_payload, payload_length))
+        {
+            return;
+        }
+
+        switch (evt.opcode)
+        {
+            case BLE_GL_CMD_SET_ALL:
+            case BLE_GL_CMD_SET_RANGE:
+            case BLE_GL_CMD_SET_PIXELS:
+            case BLE_GL_CMD_ANIMATION:
+            case BLE_GL_CMD_BRIGHTNESS:
+            case BLE_GL_CMD_QUERY_STATE:
+            case BLE_GL_CMD_PRESET_SAVE:
+            case BLE_GL_CMD_PRESET_LOAD:
+                p_nus->cmd_handler(p_nus, &evt);
+                break;
+
+            default:
+                // Left for a later version of the protocol.
+                break;
+        }
+    }
 }
 
 
@@ -50,13 +214,52 @@ static void on_write(ble_nus_t * p_nus, ble_evt_t * p_ble_evt)
             p_nus->data_handler(p_nus, (nrf_drv_WS2812_pixel_t *)p_evt_write->data);
         }
     }
+    else if (
+             (p_evt_write->handle == p_nus->animation_handles.value_handle)
+             &&
+             (p_nus->animation_handler != NULL)
+            )
+    {
+        p_nus->animation_handler(p_nus, p_evt_write->data, p_evt_write->len);
+    }
+    else if (
+             (p_evt_write->handle == p_nus->stream_handles.value_handle)
+             &&
+             (p_nus->stream_handler != NULL)
+            )
+    {
+        on_stream_write(p_nus, p_evt_write->data, p_evt_write->len);
+    }
+    else if (
+             (p_evt_write->handle == p_nus->cmd_handles.value_handle)
+             &&
+             (p_nus->cmd_handler != NULL)
+            )
+    {
+        on_cmd_write(p_nus, p_evt_write->data, p_evt_write->len);
+    }
+    else if (
+             (p_evt_write->handle == p_nus->cmd_handles.cccd_handle)
+             &&
+             (p_evt_write->len == 2)
+            )
+    {
+        p_nus->is_notification_enabled = ble_srv_is_notification_enabled(p_evt_write->data);
+    }
+    else if (
+             (p_evt_write->handle == p_nus->trace_handles.cccd_handle)
+             &&
+             (p_evt_write->len == 2)
+            )
+    {
+        p_nus->is_trace_notification_enabled = ble_srv_is_notification_enabled(p_evt_write->data);
+    }
     else
     {
         // Do Nothing. This event is not relevant for this service.
     }
 }
 
-//TODO: change this to also be readable at first connection
 uint32_t control_point_color_add(ble_nus_t * p_nus, const ble_nus_init_t * p_nus_init)
 {
 	ble_gatts_char_md_t char_md;
@@ -90,10 +293,10 @@ uint32_t control_point_color_add(ble_nus_t * p_nus, const ble_nus_init_t * p_nus
 
     attr_char_value.p_uuid       = &ble_uuid;
     attr_char_value.p_attr_md    = &attr_md;
-    attr_char_value.init_len     = sizeof(uint8_t);
+    attr_char_value.init_len     = sizeof(nrf_drv_WS2812_pixel_t);
     attr_char_value.init_offs    = 0;
     attr_char_value.max_len      = sizeof(nrf_drv_WS2812_pixel_t);
-    attr_char_value.p_value      = NULL;
+    attr_char_value.p_value      = (uint8_t *)p_nus_init->p_initial_color;
 
     return sd_ble_gatts_characteristic_add(p_nus->service_handle,
                                            &char_md,
@@ -101,6 +304,205 @@ uint32_t control_point_color_add(ble_nus_t * p_nus, const ble_nus_init_t * p_nus
                                            &p_nus->color_handles);
 }
 
+/**@brief Function for adding the animation characteristic, written to start an animation.
+ */
+static uint32_t animation_char_add(ble_nus_t * p_nus, const ble_nus_init_t * p_nus_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&char_md, 0, sizeof(char_md));
+
+    char_md.char_props.write  = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = NULL;
+    char_md.p_sccd_md         = NULL;
+
+    ble_uuid.type = p_nus->uuid_type;
+    ble_uuid.uuid = BLE_UUID_GL_ANIMATION_CHARACTERISTIC;
+
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 1;
+
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = sizeof(uint8_t);
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LIGHT_ANIMATION_MAX_ENCODED_SIZE;
+    attr_char_value.p_value      = NULL;
+
+    return sd_ble_gatts_characteristic_add(p_nus->service_handle,
+                                           &char_md,
+                                           &attr_char_value,
+                                           &p_nus->animation_handles);
+}
+
+/**@brief Function for adding the stream characteristic. It is written without response so the
+ *        peer can send several packets per connection event.
+ */
+static uint32_t stream_char_add(ble_nus_t * p_nus, const ble_nus_init_t * p_nus_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&char_md, 0, sizeof(char_md));
+
+    char_md.char_props.write_wo_resp = 1;
+    char_md.p_char_user_desc         = NULL;
+    char_md.p_char_pf                = NULL;
+    char_md.p_user_desc_md           = NULL;
+    char_md.p_cccd_md                = NULL;
+    char_md.p_sccd_md                = NULL;
+
+    ble_uuid.type = p_nus->uuid_type;
+    ble_uuid.uuid = BLE_UUID_GL_STREAM_CHARACTERISTIC;
+
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 1;
+
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = sizeof(uint8_t);
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = BLE_GL_STREAM_MAX_LEN;
+    attr_char_value.p_value      = NULL;
+
+    return sd_ble_gatts_characteristic_add(p_nus->service_handle,
+                                           &char_md,
+                                           &attr_char_value,
+                                           &p_nus->stream_handles);
+}
+
+/**@brief Function for adding the command characteristic. It is written with or without response,
+ *        answers to queries are notified.
+ */
+static uint32_t cmd_char_add(ble_nus_t * p_nus, const ble_nus_init_t * p_nus_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_md_t cccd_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&cccd_md, 0, sizeof(cccd_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+    cccd_md.vloc = BLE_GATTS_VLOC_STACK;
+
+    memset(&char_md, 0, sizeof(char_md));
+
+    char_md.char_props.write         = 1;
+    char_md.char_props.write_wo_resp = 1;
+    char_md.char_props.notify        = 1;
+    char_md.p_char_user_desc         = NULL;
+    char_md.p_char_pf                = NULL;
+    char_md.p_user_desc_md           = NULL;
+    char_md.p_cccd_md                = &cccd_md;
+    char_md.p_sccd_md                = NULL;
+
+    ble_uuid.type = p_nus->uuid_type;
+    ble_uuid.uuid = BLE_UUID_GL_CMD_CHARACTERISTIC;
+
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 1;
+
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = sizeof(uint8_t);
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = BLE_GL_CMD_MAX_LEN;
+    attr_char_value.p_value      = NULL;
+
+    return sd_ble_gatts_characteristic_add(p_nus->service_handle,
+                                           &char_md,
+                                           &attr_char_value,
+                                           &p_nus->cmd_handles);
+}
+
+/**@brief Function for adding the trace characteristic. It only notifies, records of @ref trace.h
+ *        laid out as they are in RAM.
+ */
+static uint32_t trace_char_add(ble_nus_t * p_nus, const ble_nus_init_t * p_nus_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_md_t cccd_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&cccd_md, 0, sizeof(cccd_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+    cccd_md.vloc = BLE_GATTS_VLOC_STACK;
+
+    memset(&char_md, 0, sizeof(char_md));
+
+    char_md.char_props.notify        = 1;
+    char_md.p_char_user_desc         = NULL;
+    char_md.p_char_pf                = NULL;
+    char_md.p_user_desc_md           = NULL;
+    char_md.p_cccd_md                = &cccd_md;
+    char_md.p_sccd_md                = NULL;
+
+    ble_uuid.type = p_nus->uuid_type;
+    ble_uuid.uuid = BLE_UUID_GL_TRACE_CHARACTERISTIC;
+
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 1;
+
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = 0;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = BLE_GL_STREAM_MAX_LEN;
+    attr_char_value.p_value      = NULL;
+
+    return sd_ble_gatts_characteristic_add(p_nus->service_handle,
+                                           &char_md,
+                                           &attr_char_value,
+                                           &p_nus->trace_handles);
+}
+
 void ble_nus_on_ble_evt(ble_nus_t * p_nus, ble_evt_t * p_ble_evt)
 {
     if ((p_nus == NULL) || (p_ble_evt == NULL))
@@ -122,6 +524,19 @@ void ble_nus_on_ble_evt(ble_nus_t * p_nus, ble_evt_t * p_ble_evt)
             on_write(p_nus, p_ble_evt);
             break;
 
+#if (NRF_SD_BLE_API_VERSION == 3)
+        // The application replies with BLE_GL_MAX_MTU_SIZE and asks for it, the smaller one counts.
+        case BLE_GATTS_EVT_EXCHANGE_MTU_REQUEST:
+            p_nus->max_data_len = MIN(p_ble_evt->evt.gatts_evt.params.exchange_mtu_request.client_rx_mtu,
+                                      BLE_GL_MAX_MTU_SIZE) - 3;
+            break;
+
+        case BLE_GATTC_EVT_EXCHANGE_MTU_RSP:
+            p_nus->max_data_len = MIN(p_ble_evt->evt.gattc_evt.params.exchange_mtu_rsp.server_rx_mtu,
+                                      BLE_GL_MAX_MTU_SIZE) - 3;
+            break;
+#endif
+
         default:
             // No implementation needed.
             break;
@@ -141,7 +556,13 @@ uint32_t ble_nus_init(ble_nus_t * p_nus, const ble_nus_init_t * p_nus_init)
     // Initialize the service structure.
     p_nus->conn_handle             = BLE_CONN_HANDLE_INVALID;
     p_nus->data_handler            = p_nus_init->data_handler;
+    p_nus->animation_handler       = p_nus_init->animation_handler;
+    p_nus->stream_handler          = p_nus_init->stream_handler;
+    p_nus->cmd_handler             = p_nus_init->cmd_handler;
+    p_nus->stream_seq_valid        = false;
     p_nus->is_notification_enabled = false;
+    p_nus->is_trace_notification_enabled = false;
+    p_nus->max_data_len            = BLE_NUS_MAX_DATA_LEN;
 
     /**@snippet [Adding proprietary Service to S110 SoftDevice] */
     // Add a custom base UUID.
@@ -161,5 +582,72 @@ uint32_t ble_nus_init(ble_nus_t * p_nus, const ble_nus_init_t * p_nus_init)
 	err_code = control_point_color_add(p_nus, p_nus_init);
 	VERIFY_SUCCESS(err_code);
 
+    err_code = animation_char_add(p_nus, p_nus_init);
+    VERIFY_SUCCESS(err_code);
+
+    err_code = stream_char_add(p_nus, p_nus_init);
+    VERIFY_SUCCESS(err_code);
+
+    err_code = cmd_char_add(p_nus, p_nus_init);
+    VERIFY_SUCCESS(err_code);
+
+    err_code = trace_char_add(p_nus, p_nus_init);
+    VERIFY_SUCCESS(err_code);
+
     return NRF_SUCCESS;
 }
+
+
+void ble_gl_cmd_pixel_get(ble_gl_cmd_evt_t const * p_evt, uint16_t index, ble_gl_cmd_pixel_t * p_pixel)
+{
+    uint8_t const * p_data = &p_evt->params.set_pixels.p_data[index * BLE_GL_CMD_PIXEL_SIZE];
+
+    p_pixel->pixel       = uint16_decode(&p_data[0]);
+    p_pixel->color.red   = p_data[2];
+    p_pixel->color.green = p_data[3];
+    p_pixel->color.blue  = p_data[4];
+}
+
+
+uint32_t ble_gl_cmd_reply_send(ble_nus_t * p_nus, uint8_t const * p_data, uint16_t length)
+{
+    ble_gatts_hvx_params_t hvx_params;
+
+    VERIFY_PARAM_NOT_NULL(p_nus);
+
+    if ((p_nus->conn_handle == BLE_CONN_HANDLE_INVALID) || (!p_nus->is_notification_enabled))
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    memset(&hvx_params, 0, sizeof(hvx_params));
+
+    hvx_params.handle = p_nus->cmd_handles.value_handle;
+    hvx_params.p_data = (uint8_t *)p_data;
+    hvx_params.p_len  = &length;
+    hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
+
+    return sd_ble_gatts_hvx(p_nus->conn_handle, &hvx_params);
+}
+
+
+uint32_t ble_gl_trace_send(ble_nus_t * p_nus, uint8_t const * p_data, uint16_t length)
+{
+    ble_gatts_hvx_params_t hvx_params;
+
+    VERIFY_PARAM_NOT_NULL(p_nus);
+
+    if ((p_nus->conn_handle == BLE_CONN_HANDLE_INVALID) || (!p_nus->is_trace_notification_enabled))
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    memset(&hvx_params, 0, sizeof(hvx_params));
+
+    hvx_params.handle = p_nus->trace_handles.value_handle;
+    hvx_params.p_data = (uint8_t *)p_data;
+    hvx_params.p_len  = &length;
+    hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
+
+    return sd_ble_gatts_hvx(p_nus->conn_handle, &hvx_params);
+}
@@ -8,6 +8,7 @@
 #include <stdbool.h>
 
 #include "nrf_drv_WS2812.h"
+#include "light_animation.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -15,6 +16,8 @@ extern "C" {
 
 #define BLE_UUID_NUS_SERVICE 0x0001                      /**< The UUID of the Nordic UART Service. */
 #define BLE_NUS_MAX_DATA_LEN (GATT_MTU_SIZE_DEFAULT - 3) /**< Maximum length of data (in bytes) that can be transmitted to the peer by the Nordic UART service module. */
+#define BLE_GL_MAX_MTU_SIZE  247                         /**< Largest ATT MTU the service is made for, one packet per LL PDU with data length extension. */
+#define BLE_GL_STREAM_MAX_LEN (BLE_GL_MAX_MTU_SIZE - 3)  /**< Largest stream packet, it is only reached with the larger MTU negotiated. */
 
 /* Forward declaration of the ble_nus_t type. */
 typedef struct ble_nus_s ble_nus_t;
@@ -22,6 +25,103 @@ typedef struct ble_nus_s ble_nus_t;
 /**@brief Nordic UART Service event handler type. */
 typedef void (*ble_gl_data_handler_t) (ble_nus_t * p_nus, nrf_drv_WS2812_pixel_t *p_color);
 
+/**@brief Handler for writes to the animation characteristic, see @ref light_animation_decode for the format. */
+typedef void (*ble_gl_animation_handler_t) (ble_nus_t * p_nus, uint8_t const * p_data, uint16_t length);
+
+#define BLE_GL_STREAM_HEADER_SIZE   4       /**< Sequence number, control byte and first pixel in front of the pixels of a stream packet. */
+#define BLE_GL_STREAM_SHOW          0x80    /**< Control byte flag, the packet ends a frame. The other bits are reserved and sent as 0. */
+
+/**@brief A packet written to the stream characteristic.
+ *
+ * @details Stream packets are written without response and laid out as a sequence number, a control
+ *          byte, the first pixel as 16 bits little endian and 3 bytes per pixel. A frame can be split
+ *          over several packets, only the one with @ref BLE_GL_STREAM_SHOW set is shown.
+ */
+typedef struct
+{
+    uint8_t                        seq;            /**< Sequence number of the packet. */
+    uint8_t                        lost;           /**< Packets missing since the previous one, judged by the sequence numbers. */
+    bool                           show;           /**< The packet ends a frame. */
+    uint16_t                       first_pixel;    /**< Pixel the first color is for. */
+    uint8_t                        nr_of_pixels;
+    nrf_drv_WS2812_pixel_t const * p_pixels;
+} ble_gl_stream_evt_t;
+
+/**@brief Handler for packets written to the stream characteristic. */
+typedef void (*ble_gl_stream_handler_t) (ble_nus_t * p_nus, ble_gl_stream_evt_t const * p_evt);
+
+#define BLE_GL_CMD_HEADER_SIZE      2       /**< Opcode and payload length in front of every command. */
+#define BLE_GL_CMD_MAX_LEN          BLE_GL_STREAM_MAX_LEN /**< Largest command packet, several commands fit in one. */
+#define BLE_GL_CMD_PRESET_NAME_LEN  12      /**< Longest preset name, it is not zero terminated when it fills it. */
+
+/**@brief Opcodes of the command characteristic. */
+typedef enum
+{
+    BLE_GL_CMD_SET_ALL       = 0x01,    /**< red, green, blue: all pixels. */
+    BLE_GL_CMD_SET_RANGE     = 0x02,    /**< first pixel (16 bits), number of pixels (16 bits), red, green, blue. */
+    BLE_GL_CMD_SET_PIXELS    = 0x03,    /**< pixel (16 bits), red, green, blue for every pixel set. */
+    BLE_GL_CMD_ANIMATION     = 0x04,    /**< As written to the animation characteristic. */
+    BLE_GL_CMD_BRIGHTNESS    = 0x05,    /**< brightness, 255 is full. */
+    BLE_GL_CMD_QUERY_STATE   = 0x06,    /**< No payload, the state is notified on the command characteristic. */
+    BLE_GL_CMD_PRESET_SAVE   = 0x07,    /**< slot, name: store what is on the LEDs. */
+    BLE_GL_CMD_PRESET_LOAD   = 0x08,    /**< slot: put a stored preset on the LEDs. */
+} ble_gl_cmd_opcode_t;
+
+#define BLE_GL_CMD_PIXEL_SIZE       5       /**< Bytes per pixel of @ref BLE_GL_CMD_SET_PIXELS. */
+
+/**@brief One pixel of @ref BLE_GL_CMD_SET_PIXELS, see @ref ble_gl_cmd_pixel_get. */
+typedef struct
+{
+    uint16_t               pixel;
+    nrf_drv_WS2812_pixel_t color;
+} ble_gl_cmd_pixel_t;
+
+/**@brief A command written to the command characteristic.
+ *
+ * @details A packet holds one or more commands, each an opcode, a payload length and the payload.
+ *          The pointers point into the written packet, they are only valid in the handler. Unknown
+ *          opcodes are skipped, a malformed command ends the packet. Pixel numbers and counts are
+ *          16 bits little endian.
+ */
+typedef struct
+{
+    ble_gl_cmd_opcode_t opcode;
+    union
+    {
+        struct
+        {
+            nrf_drv_WS2812_pixel_t const * p_color;
+        } set_all;
+        struct
+        {
+            uint16_t                       first_pixel;
+            uint16_t                       nr_of_pixels;
+            nrf_drv_WS2812_pixel_t const * p_color;
+        } set_range;
+        struct
+        {
+            uint16_t                       nr_of_pixels;
+            uint8_t const *                p_data;              /**< Packed pixels, read them with @ref ble_gl_cmd_pixel_get. */
+        } set_pixels;
+        struct
+        {
+            uint8_t const *                p_data;
+            uint16_t                       length;
+        } animation;
+        uint8_t                            brightness;
+        struct
+        {
+            uint8_t                        slot;
+            uint8_t const *                p_name;
+            uint8_t                        name_length;
+        } preset_save;
+        uint8_t                            preset_load;         /**< Slot. */
+    } params;
+} ble_gl_cmd_evt_t;
+
+/**@brief Handler for every command written to the command characteristic. */
+typedef void (*ble_gl_cmd_handler_t) (ble_nus_t * p_nus, ble_gl_cmd_evt_t const * p_evt);
+
 /**@brief Nordic UART Service initialization structure.
  *
  * @details This structure contains the initialization information for the service. The application
@@ -30,7 +130,11 @@ typedef void (*ble_gl_data_handler_t) (ble_nus_t * p_nus, nrf_drv_WS2812_pixel_t
  */
 typedef struct
 {
-    ble_gl_data_handler_t data_handler; /**< Event handler to be called for handling received data. */
+    ble_gl_data_handler_t      data_handler;      /**< Event handler to be called for handling received data. */
+    ble_gl_animation_handler_t animation_handler; /**< Event handler to be called for a written animation. */
+    ble_gl_stream_handler_t    stream_handler;    /**< Event handler to be called for every stream packet. */
+    ble_gl_cmd_handler_t       cmd_handler;       /**< Event handler to be called for every command. */
+    nrf_drv_WS2812_pixel_t const * p_initial_color; /**< Value of the color characteristic until it is written, NULL for off. */
 } ble_nus_init_t;
 
 /**@brief Nordic UART Service structure.
@@ -42,9 +146,20 @@ struct ble_nus_s
     uint8_t                  uuid_type;               /**< UUID type for Nordic UART Service Base UUID. */
     uint16_t                 service_handle;          /**< Handle of Nordic UART Service (as provided by the SoftDevice). */
     ble_gatts_char_handles_t color_handles;              /**< Handles related to the RX characteristic (as provided by the SoftDevice). */
+    ble_gatts_char_handles_t animation_handles;          /**< Handles related to the animation characteristic (as provided by the SoftDevice). */
+    ble_gatts_char_handles_t stream_handles;             /**< Handles related to the stream characteristic (as provided by the SoftDevice). */
+    ble_gatts_char_handles_t cmd_handles;                /**< Handles related to the command characteristic (as provided by the SoftDevice). */
+    ble_gatts_char_handles_t trace_handles;              /**< Handles related to the trace characteristic (as provided by the SoftDevice). */
     uint16_t                 conn_handle;             /**< Handle of the current connection (as provided by the SoftDevice). BLE_CONN_HANDLE_INVALID if not in a connection. */
     bool                     is_notification_enabled; /**< Variable to indicate if the peer has enabled notification of the RX characteristic.*/
+    bool                     is_trace_notification_enabled; /**< The peer has enabled notification of the trace characteristic. */
+    uint16_t                 max_data_len;            /**< Longest notification on this connection, ATT MTU - 3. */
     ble_gl_data_handler_t    data_handler;            /**< Event handler to be called for handling received data. */
+    ble_gl_animation_handler_t animation_handler;     /**< Event handler to be called for a written animation. */
+    ble_gl_stream_handler_t  stream_handler;          /**< Event handler to be called for every stream packet. */
+    ble_gl_cmd_handler_t     cmd_handler;             /**< Event handler to be called for every command. */
+    uint8_t                  stream_seq;              /**< Sequence number expected for the next stream packet. */
+    bool                     stream_seq_valid;        /**< A stream packet has been received on this connection. */
 };
 
 /**@brief Function for initializing the Nordic UART Service.
@@ -86,6 +201,36 @@ uint32_t ble_nus_string_send(ble_nus_t * p_nus, uint8_t * p_string, uint16_t len
 
 uint32_t ble_nus_string_set(ble_nus_t * p_nus, uint8_t * p_string, uint16_t length);
 
+/**@brief Function for answering a command, as a notification of the command characteristic.
+ *
+ * @param[in] p_nus       Pointer to the Nordic UART Service structure.
+ * @param[in] p_data      Answer, laid out like a command.
+ * @param[in] length      Length of the answer.
+ *
+ * @retval NRF_SUCCESS              If the answer was queued.
+ * @retval NRF_ERROR_INVALID_STATE  If not connected or the peer did not enable notifications.
+ */
+uint32_t ble_gl_cmd_reply_send(ble_nus_t * p_nus, uint8_t const * p_data, uint16_t length);
+
+/**@brief Function for reading one pixel of a @ref BLE_GL_CMD_SET_PIXELS command.
+ *
+ * @param[in]  p_evt      Command.
+ * @param[in]  index      Pixel of the command, below its nr_of_pixels.
+ * @param[out] p_pixel    Pixel number and color.
+ */
+void ble_gl_cmd_pixel_get(ble_gl_cmd_evt_t const * p_evt, uint16_t index, ble_gl_cmd_pixel_t * p_pixel);
+
+/**@brief Function for sending trace records, as a notification of the trace characteristic.
+ *
+ * @param[in] p_nus       Pointer to the Nordic UART Service structure.
+ * @param[in] p_data      Whole records, at most max_data_len bytes.
+ * @param[in] length      Length of the records.
+ *
+ * @retval NRF_SUCCESS              If the records were queued.
+ * @retval NRF_ERROR_INVALID_STATE  If not connected or the peer did not enable notifications.
+ */
+uint32_t ble_gl_trace_send(ble_nus_t * p_nus, uint8_t const * p_data, uint16_t length);
+
 #ifdef __cplusplus
 }
 #endif
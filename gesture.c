@@ -0,0 +1,314 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdk_common.h"
+#include "gesture.h"
+
+//thresholds on the movement, in % of 1 g
+#define PEAK_PCT                60          //a knock or a swing of a shake
+#define MOVE_PCT                20          //picked up or carried
+#define STILL_PCT               5           //standing on the table, above the sensor noise
+
+//angles in degrees
+#define TILT_STEP               5
+#define POUR_ANGLE              60
+#define POUR_HYSTERESIS         15
+#define UPRIGHT_ANGLE           20
+
+//times in ms
+#define GRAVITY_TIME_CONSTANT   250         //slower movements count as tilting
+#define TAP_MAX_LENGTH          40          //a knock is over quickly
+#define TAP_QUIET               250         //and not followed by more
+#define SHAKE_WINDOW            1000
+#define SHAKE_PEAKS             4
+#define POUR_TIME               500
+#define STILL_TIME              500
+
+static gesture_handler_t m_handler;
+
+//all converted to counts and samples
+static struct
+{
+    int32_t  peak;
+    int32_t  move;
+    int32_t  still;
+    uint8_t  gravity_shift;
+    uint16_t tap_max_length;
+    uint16_t tap_quiet;
+    uint16_t shake_window;
+    uint16_t pour_time;
+    uint16_t still_time;
+} m_limits;
+
+static bool     m_started;
+static int32_t  m_gravity[3];               //low pass of the samples, scaled by 2^gravity_shift
+static uint32_t m_sample_nr;
+
+static uint8_t  m_tilt;
+static uint8_t  m_tilt_reported;
+
+static bool     m_peak;                     //movement above the peak threshold
+static uint32_t m_peak_start;
+static uint32_t m_peak_end;
+static uint32_t m_window_start;
+static uint8_t  m_window_peaks;
+static uint32_t m_shake_holdoff_end;
+static bool     m_tap_pending;
+static uint32_t m_tap_end;
+
+static bool     m_pouring;
+static uint16_t m_pour_count;
+
+static bool     m_moved;
+static uint16_t m_still_count;
+
+
+static uint16_t ms_to_samples(uint16_t sample_rate_hz, uint32_t ms)
+{
+    return MAX((uint32_t)sample_rate_hz * ms / 1000, 1);
+}
+
+
+// Length of a 3D vector within about 10% (largest part plus 3/8 of the other two).
+static int32_t magnitude3(int32_t x, int32_t y, int32_t z)
+{
+    int32_t a = abs(x);
+    int32_t b = abs(y);
+    int32_t c = abs(z);
+    int32_t max = MAX(a, MAX(b, c));
+
+    return max + 3 * (a + b + c - max) / 8;
+}
+
+
+// Length of a 2D vector within about 7%.
+static int32_t magnitude2(int32_t x, int32_t y)
+{
+    int32_t a = abs(x);
+    int32_t b = abs(y);
+
+    return MAX(a, b) + 3 * MIN(a, b) / 8;
+}
+
+
+// atan(num / den) in degrees for 0 <= num <= den, from atan(r) ~ 45 r + 15.6 r (1 - r) degrees,
+// better than half a degree.
+static int32_t atan_octant(int32_t num, int32_t den)
+{
+    int32_t r = (int32_t)(((int64_t)num << 10) / den);
+    int32_t deg_q10 = 45 * r + (((r * (1024 - r)) >> 10) * 1001) / 64;
+
+    return (deg_q10 + 512) >> 10;
+}
+
+
+// Angle between the glass axis and up, 0 to 180 degrees.
+static uint8_t tilt_angle(int32_t horizontal, int32_t vertical)
+{
+    int32_t up = abs(vertical);
+    int32_t angle;
+
+    if (horizontal == 0 && up == 0)
+    {
+        return 0;
+    }
+
+    angle = (horizontal <= up) ? atan_octant(horizontal, up) : 90 - atan_octant(up, horizontal);
+
+    return (uint8_t)((vertical >= 0) ? angle : 180 - angle);
+}
+
+
+static void evt_send(gesture_evt_type_t type)
+{
+    gesture_evt_t evt;
+
+    evt.type = type;
+    evt.tilt = m_tilt;
+    if (m_handler != NULL)
+    {
+        m_handler(&evt);
+    }
+}
+
+
+// Knocks and shakes, from the peaks of the movement.
+static void peaks_update(int32_t movement)
+{
+    if (!m_peak && movement > m_limits.peak)
+    {
+        m_peak = true;
+        m_peak_start = m_sample_nr;
+
+        // a second peak soon after makes it something else than a knock
+        m_tap_pending = false;
+
+        if (m_sample_nr - m_window_start > m_limits.shake_window)
+        {
+            m_window_start = m_sample_nr;
+            m_window_peaks = 0;
+        }
+        if (++m_window_peaks >= SHAKE_PEAKS && (int32_t)(m_sample_nr - m_shake_holdoff_end) >= 0)
+        {
+            evt_send(GESTURE_EVT_SHAKE);
+            m_shake_holdoff_end = m_sample_nr + m_limits.shake_window;
+        }
+    }
+    else if (m_peak && movement < m_limits.peak * 3 / 4)
+    {
+        m_peak = false;
+        if (m_sample_nr - m_peak_start <= m_limits.tap_max_length &&
+            (m_window_peaks == 1 || m_peak_start - m_peak_end >= m_limits.tap_quiet))
+        {
+            m_tap_pending = true;
+            m_tap_end = m_sample_nr;
+        }
+        m_peak_end = m_sample_nr;
+    }
+
+    if (m_tap_pending && m_sample_nr - m_tap_end >= m_limits.tap_quiet)
+    {
+        m_tap_pending = false;
+        evt_send(GESTURE_EVT_TAP);
+    }
+}
+
+
+static void tilt_update(void)
+{
+    if (abs(m_tilt - m_tilt_reported) >= TILT_STEP)
+    {
+        m_tilt_reported = m_tilt;
+        evt_send(GESTURE_EVT_TILT);
+    }
+
+    if (!m_pouring)
+    {
+        m_pour_count = (m_tilt >= POUR_ANGLE) ? m_pour_count + 1 : 0;
+        if (m_pour_count >= m_limits.pour_time)
+        {
+            m_pouring = true;
+            evt_send(GESTURE_EVT_POUR_START);
+        }
+    }
+    else if (m_tilt < POUR_ANGLE - POUR_HYSTERESIS)
+    {
+        m_pouring = false;
+        m_pour_count = 0;
+        evt_send(GESTURE_EVT_POUR_END);
+    }
+}
+
+
+static void still_update(int32_t movement)
+{
+    if (!m_moved && (movement > m_limits.move || m_tilt > UPRIGHT_ANGLE))
+    {
+        m_moved = true;
+        evt_send(GESTURE_EVT_MOVE);
+    }
+
+    m_still_count = (movement < m_limits.still && m_tilt <= UPRIGHT_ANGLE) ? m_still_count + 1 : 0;
+    if (m_moved && m_still_count >= m_limits.still_time)
+    {
+        m_moved = false;
+        evt_send(GESTURE_EVT_SET_DOWN);
+    }
+}
+
+
+static void sample_process(lis3dh_sample_t const * p_sample)
+{
+    int32_t const sample[3] = {p_sample->x, p_sample->y, p_sample->z};
+    int32_t gravity[3];
+    int32_t movement;
+
+    if (!m_started)
+    {
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            m_gravity[i] = sample[i] << m_limits.gravity_shift;
+        }
+        m_started = true;
+    }
+
+    // gravity += (sample - gravity) / 2^shift, kept scaled up so nothing is lost to rounding
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        m_gravity[i] += sample[i] - (m_gravity[i] >> m_limits.gravity_shift);
+        gravity[i]    = m_gravity[i] >> m_limits.gravity_shift;
+    }
+
+    movement = magnitude3(sample[0] - gravity[0], sample[1] - gravity[1], sample[2] - gravity[2]);
+    m_tilt   = tilt_angle(magnitude2(gravity[0], gravity[1]), gravity[2]);
+
+    peaks_update(movement);
+    tilt_update();
+    still_update(movement);
+
+    m_sample_nr++;
+}
+
+
+uint32_t gesture_init(gesture_init_t const * p_init)
+{
+    uint16_t gravity_samples;
+
+    VERIFY_PARAM_NOT_NULL(p_init);
+    if (p_init->sample_rate_hz == 0 || p_init->counts_per_g == 0)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    m_handler = p_init->handler;
+
+    m_limits.peak  = (int32_t)p_init->counts_per_g * PEAK_PCT / 100;
+    m_limits.move  = (int32_t)p_init->counts_per_g * MOVE_PCT / 100;
+    m_limits.still = (int32_t)p_init->counts_per_g * STILL_PCT / 100;
+
+    // the low pass shifts instead of dividing, take the power of 2 closest below the time constant
+    gravity_samples = ms_to_samples(p_init->sample_rate_hz, GRAVITY_TIME_CONSTANT);
+    for (m_limits.gravity_shift = 1; (2u << m_limits.gravity_shift) <= gravity_samples; m_limits.gravity_shift++)
+    {
+    }
+
+    m_limits.tap_max_length = ms_to_samples(p_init->sample_rate_hz, TAP_MAX_LENGTH);
+    m_limits.tap_quiet      = ms_to_samples(p_init->sample_rate_hz, TAP_QUIET);
+    m_limits.shake_window   = ms_to_samples(p_init->sample_rate_hz, SHAKE_WINDOW);
+    m_limits.pour_time      = ms_to_samples(p_init->sample_rate_hz, POUR_TIME);
+    m_limits.still_time     = ms_to_samples(p_init->sample_rate_hz, STILL_TIME);
+
+    m_started          = false;
+    m_sample_nr        = 0;
+    m_tilt             = 0;
+    m_tilt_reported    = 0;
+    m_peak             = false;
+    m_peak_start       = 0;
+    m_peak_end         = 0;
+    m_window_start     = 0;
+    m_window_peaks     = 0;
+    m_shake_holdoff_end = 0;
+    m_tap_pending      = false;
+    m_pouring          = false;
+    m_pour_count       = 0;
+    m_moved            = false;
+    m_still_count      = 0;
+
+    return NRF_SUCCESS;
+}
+
+
+void gesture_process(lis3dh_sample_t const * p_samples, uint16_t nr_of_samples)
+{
+    for (uint16_t i = 0; i < nr_of_samples; i++)
+    {
+        sample_process(&p_samples[i]);
+    }
+}
+
+
+uint8_t gesture_tilt_get(void)
+{
+    return m_tilt;
+}
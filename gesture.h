@@ -0,0 +1,51 @@
+#ifndef GESTURE_H__
+#define GESTURE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lis3dh.h"
+
+/* Gestures from the accelerometer stream, so the glass can react to being handled without a
+ * round trip over BLE. Gravity is split from movement with a first order low pass per axis, all
+ * in integer math: no float and no square root per sample, magnitudes and angles are
+ * approximated.
+ *
+ * The glass is taken to stand on the z axis of the accelerometer.
+ */
+
+typedef enum
+{
+    GESTURE_EVT_TILT,           /**< The tilt changed by a few degrees. */
+    GESTURE_EVT_TAP,            /**< A single short knock, like clinking glasses. */
+    GESTURE_EVT_SHAKE,          /**< Several strong movements in a short time. */
+    GESTURE_EVT_POUR_START,     /**< Held tilted past the pour angle. */
+    GESTURE_EVT_POUR_END,       /**< Back up after pouring. */
+    GESTURE_EVT_MOVE,           /**< Picked up or moved after standing still. */
+    GESTURE_EVT_SET_DOWN,       /**< Upright and still after being moved. */
+} gesture_evt_type_t;
+
+typedef struct
+{
+    gesture_evt_type_t type;
+    uint8_t            tilt;    /**< Angle from upright, in degrees. */
+} gesture_evt_t;
+
+typedef void (*gesture_handler_t)(gesture_evt_t const * p_evt);
+
+typedef struct
+{
+    uint16_t          sample_rate_hz;
+    uint16_t          counts_per_g;     /**< Sample value of 1 g, 8192 at +-4 g. */
+    gesture_handler_t handler;
+} gesture_init_t;
+
+uint32_t gesture_init(gesture_init_t const * p_init);
+
+/**@brief Run samples through the filters, the handler is called for every gesture found. */
+void gesture_process(lis3dh_sample_t const * p_samples, uint16_t nr_of_samples);
+
+/**@brief Current angle from upright, in degrees. */
+uint8_t gesture_tilt_get(void);
+
+#endif //GESTURE_H__
@@ -0,0 +1,75 @@
+/* Host run of the render path benchmark in perf_bench.c.
+ *
+ * Sets up a strip of the given length and light_animation for it, the way main.c does on the
+ * target, and prints the cycles the synthetic workload takes. make perf runs it for strips from
+ * 6 to 1024 pixels. The pwm stub never finishes a frame, so every frame after the first is encoded
+ * into the back buffer and left pending, as on the target while the previous one is clocked out.
+ * With STREAMING=1 the encoding moves into the pwm interrupt, encode then only counts show().
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "nrf_drv_WS2812.h"
+#include "light_animation.h"
+#include "perf_bench.h"
+#include "app_error.h"
+
+#define MAX_PIXELS              1024
+#define ITERATIONS              2000
+
+NRF_DRV_WS2812_DEF(m_strip, 0, MAX_PIXELS);
+
+//the frame is left for the benchmark to show
+static void show_handler(void)
+{
+}
+
+static void report_handler(char const * p_name, uint16_t nr_of_pixels, perf_bench_stat_t const * p_stat)
+{
+    printf("%-8s %5u pixels: min %8u  avg %8u  max %8u cycles, %6.1f per pixel\n",
+           p_name, nr_of_pixels, (unsigned)p_stat->min, (unsigned)(p_stat->sum / p_stat->count),
+           (unsigned)p_stat->max, (double)p_stat->min / nr_of_pixels);
+}
+
+int main(int argc, char * argv[])
+{
+    uint32_t nr_of_pixels = (argc > 1) ? strtoul(argv[1], NULL, 0) : 6;
+
+    if(nr_of_pixels == 0 || nr_of_pixels > MAX_PIXELS)
+    {
+        printf("usage: %s [pixels, 1-%u]\n", argv[0], MAX_PIXELS);
+        return 1;
+    }
+
+    nrf_drv_WS2812_config_t const config =
+    {
+        .pin          = 0,
+        .nr_of_pixels = nr_of_pixels,
+        .handler      = NULL
+    };
+    APP_ERROR_CHECK(nrf_drv_WS2812_init(&m_strip, &config));
+
+    light_animation_init_t const animation_init =
+    {
+        .p_strip          = &m_strip,
+        .nr_of_pixels     = nr_of_pixels,
+        .tick_interval_ms = 4000 / 256,
+        .timer_prescaler  = 0,
+        .show_handler     = show_handler
+    };
+    APP_ERROR_CHECK(light_animation_init(&animation_init));
+
+    perf_bench_init_t const bench_init =
+    {
+        .p_strip        = &m_strip,
+        .nr_of_pixels   = nr_of_pixels,
+        .iterations     = ITERATIONS,
+        .report_handler = report_handler
+    };
+    perf_bench_init(&bench_init);
+    perf_bench_run();
+
+    return 0;
+}
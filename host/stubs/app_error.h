@@ -0,0 +1,25 @@
+#ifndef APP_ERROR_H
+#define APP_ERROR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define NRF_SUCCESS             0
+#define NRF_ERROR_INVALID_STATE 8
+#define NRF_ERROR_INVALID_PARAM 7
+#define NRF_ERROR_BUSY          17
+
+#define APP_ERROR_CHECK(err_code)                                                   \
+    do                                                                              \
+    {                                                                               \
+        uint32_t local_err_code = (err_code);                                       \
+        if (local_err_code != NRF_SUCCESS)                                          \
+        {                                                                           \
+            fprintf(stderr, "%s:%d: error %u\n", __FILE__, __LINE__,                \
+                    (unsigned)local_err_code);                                      \
+            exit(1);                                                                \
+        }                                                                           \
+    } while (0)
+
+#endif  //APP_ERROR_H
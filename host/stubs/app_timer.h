@@ -0,0 +1,60 @@
+#ifndef APP_TIMER_H__
+#define APP_TIMER_H__
+
+//host build stand-in for the SDK 12 app_timer, timers are created and started but never expire
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "app_error.h"
+
+typedef void (*app_timer_timeout_handler_t)(void * p_context);
+
+typedef struct
+{
+    app_timer_timeout_handler_t handler;
+    bool                        running;
+} app_timer_t;
+
+typedef app_timer_t * app_timer_id_t;
+
+typedef enum
+{
+    APP_TIMER_MODE_SINGLE_SHOT,
+    APP_TIMER_MODE_REPEATED
+} app_timer_mode_t;
+
+#define APP_TIMER_CLOCK_FREQ            32768
+
+#define APP_TIMER_DEF(timer_id)                                  \
+    static app_timer_t timer_id##_data;                          \
+    static const app_timer_id_t timer_id = &timer_id##_data
+
+#define APP_TIMER_TICKS(MS, PRESCALER)  \
+    ((uint32_t)(((uint64_t)(MS) * APP_TIMER_CLOCK_FREQ) / (((PRESCALER) + 1) * 1000)))
+
+static inline uint32_t app_timer_create(app_timer_id_t const * p_timer_id,
+                                        app_timer_mode_t mode,
+                                        app_timer_timeout_handler_t timeout_handler)
+{
+    (void)mode;
+    (*p_timer_id)->handler = timeout_handler;
+    (*p_timer_id)->running = false;
+    return NRF_SUCCESS;
+}
+
+static inline uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void * p_context)
+{
+    (void)timeout_ticks;
+    (void)p_context;
+    timer_id->running = true;
+    return NRF_SUCCESS;
+}
+
+static inline uint32_t app_timer_stop(app_timer_id_t timer_id)
+{
+    timer_id->running = false;
+    return NRF_SUCCESS;
+}
+
+#endif  //APP_TIMER_H__
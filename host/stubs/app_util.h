@@ -0,0 +1,13 @@
+#ifndef APP_UTIL_H
+#define APP_UTIL_H
+
+#include <stdint.h>
+
+#define STATIC_ASSERT(EXPR) _Static_assert((EXPR), #EXPR)
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define CEIL_DIV(A, B) (((A) + (B) - 1) / (B))
+
+#endif  //APP_UTIL_H
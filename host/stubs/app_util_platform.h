@@ -0,0 +1,12 @@
+#ifndef APP_UTIL_PLATFORM_H
+#define APP_UTIL_PLATFORM_H
+
+#include "app_error.h"
+
+#define APP_IRQ_PRIORITY_HIGH   2
+#define APP_IRQ_PRIORITY_LOW    6
+
+#define CRITICAL_REGION_ENTER()
+#define CRITICAL_REGION_EXIT()
+
+#endif  //APP_UTIL_PLATFORM_H
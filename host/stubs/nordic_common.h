@@ -0,0 +1,9 @@
+#ifndef NORDIC_COMMON_H__
+#define NORDIC_COMMON_H__
+
+#define CONCAT_2(p1, p2)        CONCAT_2_(p1, p2)
+#define CONCAT_2_(p1, p2)       p1##p2
+
+#define UNUSED_PARAMETER(X)     (void)(X)
+
+#endif  //NORDIC_COMMON_H__
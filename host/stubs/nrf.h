@@ -0,0 +1,31 @@
+#ifndef NRF_H
+#define NRF_H
+
+//host build stand-in for the device header
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef __INLINE
+#define __INLINE inline
+#endif
+
+#ifndef __CLZ
+#define __CLZ(value) ((uint8_t)__builtin_clz(value))
+#endif
+
+#ifndef __RBIT
+static inline uint32_t __RBIT(uint32_t value)
+{
+    uint32_t result = 0;
+
+    for (int i = 0; i < 32; i++)
+    {
+        result = (result << 1) | ((value >> i) & 1);
+    }
+    return result;
+}
+#endif
+
+#endif  //NRF_H
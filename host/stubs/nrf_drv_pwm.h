@@ -0,0 +1,100 @@
+#ifndef NRF_DRV_PWM_H__
+#define NRF_DRV_PWM_H__
+
+//host build stand-in for the SDK 12 PWM driver, playback is run on demand by nrf_drv_pwm_stub_play()
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NRF_DRV_PWM_PIN_NOT_USED    0xFF
+
+typedef uint16_t nrf_pwm_values_common_t;
+
+typedef union
+{
+    nrf_pwm_values_common_t const * p_common;
+    void const                    * p_raw;
+} nrf_pwm_values_t;
+
+typedef struct
+{
+    nrf_pwm_values_t values;
+    uint16_t         length;
+    uint32_t         repeats;
+    uint32_t         end_delay;
+} nrf_pwm_sequence_t;
+
+#define NRF_PWM_VALUES_LENGTH(array)    (sizeof(array) / sizeof(array[0]))
+
+typedef enum { NRF_PWM_CLK_16MHz = 0 } nrf_pwm_clk_t;
+typedef enum { NRF_PWM_MODE_UP = 0 } nrf_pwm_mode_t;
+typedef enum { NRF_PWM_LOAD_COMMON = 0 } nrf_pwm_dec_load_t;
+typedef enum { NRF_PWM_STEP_AUTO = 0 } nrf_pwm_dec_step_t;
+
+typedef struct
+{
+    uint8_t  drv_inst_idx;
+} nrf_drv_pwm_t;
+
+#define NRF_DRV_PWM_INSTANCE(id)    { .drv_inst_idx = (id) }
+
+typedef struct
+{
+    uint8_t            output_pins[4];
+    uint8_t            irq_priority;
+    nrf_pwm_clk_t      base_clock;
+    nrf_pwm_mode_t     count_mode;
+    uint16_t           top_value;
+    nrf_pwm_dec_load_t load_mode;
+    nrf_pwm_dec_step_t step_mode;
+} nrf_drv_pwm_config_t;
+
+typedef enum
+{
+    NRF_DRV_PWM_EVT_FINISHED,
+    NRF_DRV_PWM_EVT_END_SEQ0,
+    NRF_DRV_PWM_EVT_END_SEQ1,
+    NRF_DRV_PWM_EVT_STOPPED,
+} nrf_drv_pwm_evt_type_t;
+
+#define NRF_DRV_PWM_FLAG_STOP               0x01
+#define NRF_DRV_PWM_FLAG_LOOP               0x02
+#define NRF_DRV_PWM_FLAG_SIGNAL_END_SEQ0    0x04
+#define NRF_DRV_PWM_FLAG_SIGNAL_END_SEQ1    0x08
+#define NRF_DRV_PWM_FLAG_NO_EVT_FINISHED    0x10
+
+typedef void (* nrf_drv_pwm_handler_t)(nrf_drv_pwm_evt_type_t event_type);
+
+uint32_t nrf_drv_pwm_init(nrf_drv_pwm_t const * const p_instance,
+                          nrf_drv_pwm_config_t const * p_config,
+                          nrf_drv_pwm_handler_t handler);
+
+void nrf_drv_pwm_simple_playback(nrf_drv_pwm_t const * const p_instance,
+                                 nrf_pwm_sequence_t const * p_sequence,
+                                 uint16_t playback_count,
+                                 uint32_t flags);
+
+void nrf_drv_pwm_complex_playback(nrf_drv_pwm_t const * const p_instance,
+                                  nrf_pwm_sequence_t const * p_sequence_0,
+                                  nrf_pwm_sequence_t const * p_sequence_1,
+                                  uint16_t playback_count,
+                                  uint32_t flags);
+
+bool nrf_drv_pwm_is_stopped(nrf_drv_pwm_t const * const p_instance);
+
+/**@brief Host only: clock out the current playback, capturing the values and raising the
+ *        events the real driver would, ending with STOPPED.
+ */
+void nrf_drv_pwm_stub_play(uint8_t instance_idx);
+
+/**@brief Host only: values clocked out by the last nrf_drv_pwm_stub_play(), one per pwm period.
+ *
+ * @details Repeated values and the end delay of a sequence are in it as often as they are clocked
+ *          out, the end delay as the last value of the sequence.
+ */
+nrf_pwm_values_common_t const * nrf_drv_pwm_stub_capture(uint8_t instance_idx, uint32_t * p_length);
+
+/**@brief Host only: counter top of the pwm period, in 16 MHz ticks. */
+uint16_t nrf_drv_pwm_stub_top_value(uint8_t instance_idx);
+
+#endif  //NRF_DRV_PWM_H__
@@ -0,0 +1,141 @@
+
+#include <stddef.h>
+#include "nrf_drv_pwm.h"
+#include "app_error.h"
+
+#define PWM_INSTANCE_COUNT  4
+#define CAPTURE_LENGTH      (64 * 1024)
+
+static struct
+{
+    nrf_drv_pwm_handler_t      handler;
+    uint16_t                   top_value;
+    nrf_pwm_sequence_t const * p_seq[2];
+    uint16_t                   loops;
+    uint32_t                   flags;
+    bool                       playing;
+    nrf_pwm_values_common_t    capture[CAPTURE_LENGTH];
+    uint32_t                   capture_length;
+} m_cb[PWM_INSTANCE_COUNT];
+
+uint32_t nrf_drv_pwm_init(nrf_drv_pwm_t const * const p_instance,
+                          nrf_drv_pwm_config_t const * p_config,
+                          nrf_drv_pwm_handler_t handler)
+{
+    m_cb[p_instance->drv_inst_idx].handler        = handler;
+    m_cb[p_instance->drv_inst_idx].top_value      = p_config->top_value;
+    m_cb[p_instance->drv_inst_idx].playing        = false;
+    m_cb[p_instance->drv_inst_idx].capture_length = 0;
+    return NRF_SUCCESS;
+}
+
+void nrf_drv_pwm_simple_playback(nrf_drv_pwm_t const * const p_instance,
+                                 nrf_pwm_sequence_t const * p_sequence,
+                                 uint16_t playback_count,
+                                 uint32_t flags)
+{
+    //only single playbacks are used, modelled as one loop of a lone sequence
+    (void)playback_count;
+    m_cb[p_instance->drv_inst_idx].p_seq[0] = p_sequence;
+    m_cb[p_instance->drv_inst_idx].p_seq[1] = NULL;
+    m_cb[p_instance->drv_inst_idx].loops    = 1;
+    m_cb[p_instance->drv_inst_idx].flags    = flags;
+    m_cb[p_instance->drv_inst_idx].playing  = true;
+}
+
+void nrf_drv_pwm_complex_playback(nrf_drv_pwm_t const * const p_instance,
+                                  nrf_pwm_sequence_t const * p_sequence_0,
+                                  nrf_pwm_sequence_t const * p_sequence_1,
+                                  uint16_t playback_count,
+                                  uint32_t flags)
+{
+    m_cb[p_instance->drv_inst_idx].p_seq[0] = p_sequence_0;
+    m_cb[p_instance->drv_inst_idx].p_seq[1] = p_sequence_1;
+    m_cb[p_instance->drv_inst_idx].loops    = playback_count;
+    m_cb[p_instance->drv_inst_idx].flags    = flags;
+    m_cb[p_instance->drv_inst_idx].playing  = true;
+}
+
+bool nrf_drv_pwm_is_stopped(nrf_drv_pwm_t const * const p_instance)
+{
+    return !m_cb[p_instance->drv_inst_idx].playing;
+}
+
+static void capture_value(uint8_t instance_idx, nrf_pwm_values_common_t value)
+{
+    if (m_cb[instance_idx].capture_length < CAPTURE_LENGTH)
+    {
+        m_cb[instance_idx].capture[m_cb[instance_idx].capture_length++] = value;
+    }
+}
+
+static void capture_sequence(uint8_t instance_idx, nrf_pwm_sequence_t const * p_seq)
+{
+    for (uint32_t i = 0; i < p_seq->length; i++)
+    {
+        for (uint32_t r = 0; r <= p_seq->repeats; r++)
+        {
+            capture_value(instance_idx, p_seq->values.p_common[i]);
+        }
+    }
+
+    //the pwm keeps running with the last value until the end delay is over
+    for (uint32_t d = 0; d < p_seq->end_delay && p_seq->length != 0; d++)
+    {
+        capture_value(instance_idx, p_seq->values.p_common[p_seq->length - 1]);
+    }
+}
+
+static void signal(uint8_t instance_idx, nrf_drv_pwm_evt_type_t event_type)
+{
+    if (m_cb[instance_idx].handler != NULL)
+    {
+        m_cb[instance_idx].handler(event_type);
+    }
+}
+
+void nrf_drv_pwm_stub_play(uint8_t instance_idx)
+{
+    if (!m_cb[instance_idx].playing)
+    {
+        return;
+    }
+
+    m_cb[instance_idx].capture_length = 0;
+
+    for (uint32_t loop = 0; loop < m_cb[instance_idx].loops; loop++)
+    {
+        capture_sequence(instance_idx, m_cb[instance_idx].p_seq[0]);
+        if (m_cb[instance_idx].flags & NRF_DRV_PWM_FLAG_SIGNAL_END_SEQ0)
+        {
+            signal(instance_idx, NRF_DRV_PWM_EVT_END_SEQ0);
+        }
+
+        if (m_cb[instance_idx].p_seq[1] != NULL)
+        {
+            capture_sequence(instance_idx, m_cb[instance_idx].p_seq[1]);
+            if (m_cb[instance_idx].flags & NRF_DRV_PWM_FLAG_SIGNAL_END_SEQ1)
+            {
+                signal(instance_idx, NRF_DRV_PWM_EVT_END_SEQ1);
+            }
+        }
+    }
+
+    m_cb[instance_idx].playing = false;
+    signal(instance_idx, NRF_DRV_PWM_EVT_FINISHED);
+    if (m_cb[instance_idx].flags & NRF_DRV_PWM_FLAG_STOP)
+    {
+        signal(instance_idx, NRF_DRV_PWM_EVT_STOPPED);
+    }
+}
+
+nrf_pwm_values_common_t const * nrf_drv_pwm_stub_capture(uint8_t instance_idx, uint32_t * p_length)
+{
+    *p_length = m_cb[instance_idx].capture_length;
+    return m_cb[instance_idx].capture;
+}
+
+uint16_t nrf_drv_pwm_stub_top_value(uint8_t instance_idx)
+{
+    return m_cb[instance_idx].top_value;
+}
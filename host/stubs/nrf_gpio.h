@@ -0,0 +1,10 @@
+#ifndef NRF_GPIO_H
+#define NRF_GPIO_H
+
+#include <stdint.h>
+
+static inline void nrf_gpio_cfg_output(uint32_t pin_number) { (void)pin_number; }
+static inline void nrf_gpio_pin_clear(uint32_t pin_number)  { (void)pin_number; }
+static inline void nrf_gpio_pin_set(uint32_t pin_number)    { (void)pin_number; }
+
+#endif  //NRF_GPIO_H
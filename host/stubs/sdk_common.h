@@ -0,0 +1,42 @@
+#ifndef SDK_COMMON_H__
+#define SDK_COMMON_H__
+
+//host build stand-in for the SDK 12 common header, only what the repo's modules use
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_util.h"
+#include "app_error.h"
+
+#define NRF_ERROR_INVALID_LENGTH    9
+#define NRF_ERROR_NULL              14
+
+#define VERIFY_SUCCESS(err_code)                \
+    do                                          \
+    {                                           \
+        if ((err_code) != NRF_SUCCESS)          \
+        {                                       \
+            return (err_code);                  \
+        }                                       \
+    } while (0)
+
+#define VERIFY_PARAM_NOT_NULL(p_param)          \
+    do                                          \
+    {                                           \
+        if ((p_param) == NULL)                  \
+        {                                       \
+            return NRF_ERROR_NULL;              \
+        }                                       \
+    } while (0)
+
+#define UNUSED_RETURN_VALUE(X)  (void)(X)
+
+static inline uint16_t uint16_decode(uint8_t const * p_encoded_data)
+{
+    return (uint16_t)p_encoded_data[0] | ((uint16_t)p_encoded_data[1] << 8);
+}
+
+#endif  //SDK_COMMON_H__
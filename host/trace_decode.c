@@ -0,0 +1,137 @@
+/* Decoder for the trace records of trace.h.
+ *
+ * Reads the records as they come out of the trace RTT channel or the trace characteristic, for
+ * example saved with JLinkRTTLogger -RTTChannel 1, and prints them as a timeline: time since the
+ * first record, time since the one before, the event and its argument. The 24 bit RTC timestamps
+ * wrap every 512 s, gaps longer than that cannot be told apart from shorter ones.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//only the record format is needed here, not the recording
+#define TRACE_ENABLED           0
+#include "trace.h"
+
+#define TICK_HZ                 32768       //RTC1 with APP_TIMER_PRESCALER 0
+#define TIME_BITS               24
+
+static char const * const m_names[] =
+{
+    [TRACE_EVT_LOST]              = "lost",
+    [TRACE_EVT_BLE_WRITE]         = "ble_write",
+    [TRACE_EVT_FRAME_ENCODED]     = "frame_encoded",
+    [TRACE_EVT_PWM_START]         = "pwm_start",
+    [TRACE_EVT_PWM_END]           = "pwm_end",
+    [TRACE_EVT_TIMESLOT_START]    = "timeslot_start",
+    [TRACE_EVT_TIMESLOT_END]      = "timeslot_end",
+    [TRACE_EVT_TIMESLOT_BLOCKED]  = "timeslot_blocked",
+    [TRACE_EVT_TIMESLOT_CANCELED] = "timeslot_canceled",
+    [TRACE_EVT_ACC_FIFO]          = "acc_fifo",
+    [TRACE_EVT_SYS]               = "sys_evt",
+};
+
+_Static_assert(sizeof(m_names) / sizeof(m_names[0]) == TRACE_NR_OF_EVTS, "every event needs a name");
+
+static uint32_t word_decode(uint8_t const * p_data)
+{
+    return p_data[0] | (p_data[1] << 8) | (p_data[2] << 16) | ((uint32_t)p_data[3] << 24);
+}
+
+static void arg_print(uint8_t event, uint32_t arg)
+{
+    switch(event)
+    {
+        case TRACE_EVT_LOST:
+            printf("%u records", (unsigned)arg);
+            break;
+
+        case TRACE_EVT_BLE_WRITE:
+            printf("handle 0x%04x, %u bytes", (unsigned)(arg & 0xFFFF), (unsigned)(arg >> 16));
+            break;
+
+        case TRACE_EVT_FRAME_ENCODED:
+            if(arg)
+            {
+                printf("waits for the running frame");
+            }
+            break;
+
+        case TRACE_EVT_PWM_START:
+        case TRACE_EVT_PWM_END:
+            break;
+
+        case TRACE_EVT_TIMESLOT_END:
+            printf("%u us", (unsigned)arg);
+            break;
+
+        case TRACE_EVT_ACC_FIFO:
+            printf("%u samples", (unsigned)arg);
+            break;
+
+        case TRACE_EVT_SYS:
+            printf("event %u", (unsigned)arg);
+            break;
+
+        default:
+            printf("%u", (unsigned)arg);
+            break;
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    FILE *   p_file = stdin;
+    uint8_t  data[sizeof(trace_record_t)];
+    uint32_t last_time = 0;
+    uint64_t first = 0;
+    uint64_t previous = 0;
+    uint64_t now = 0;
+    uint32_t nr_of_records = 0;
+
+    if(argc > 1 && (p_file = fopen(argv[1], "rb")) == NULL)
+    {
+        printf("usage: %s [file of trace records, else stdin]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%12s %10s  %-18s %s\n", "time ms", "delta ms", "event", "arg");
+
+    while(fread(data, sizeof(data), 1, p_file) == 1)
+    {
+        uint32_t word  = word_decode(&data[0]);
+        uint32_t arg   = word_decode(&data[4]);
+        uint8_t  event = word & 0xFF;
+        uint32_t time  = word >> 8;
+
+        //unwrap the timestamp
+        now += (time - last_time) & ((1UL << TIME_BITS) - 1);
+        last_time = time;
+        if(nr_of_records++ == 0)
+        {
+            first    = now;
+            previous = now;
+        }
+
+        printf("%12.3f %10.3f  ", (now - first) * 1000.0 / TICK_HZ, (now - previous) * 1000.0 / TICK_HZ);
+        if(event < TRACE_NR_OF_EVTS)
+        {
+            printf("%-18s ", m_names[event]);
+            arg_print(event, arg);
+        }
+        else
+        {
+            printf("%-18s 0x%08x", "unknown", (unsigned)arg);
+        }
+        printf("\n");
+        previous = now;
+    }
+
+    if(p_file != stdin)
+    {
+        fclose(p_file);
+    }
+    return 0;
+}
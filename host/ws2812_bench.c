@@ -0,0 +1,500 @@
+/* Host benchmark for the WS2812 pwm encoder.
+ *
+ * Times the nibble lookup table encoder in nrf_drv_WS2812_show() against the
+ * original bit-by-bit loop and checks that both produce the same pwm values, with
+ * gamma, brightness and white balance applied to the reference colors. Also
+ * times show() with a single changed pixel and with nothing changed. With dithering
+ * it checks that the frames average to the 16 bit colors instead. Without it, it also
+ * checks that a white strip over the current limit is dimmed down to it and back.
+ * In both modes it checks the current estimate against the pixels after setting
+ * them in random order.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "nrf_drv_WS2812.h"
+#include "nrf_drv_pwm.h"
+#include "app_error.h"
+
+#define ITERATIONS              20000
+#define MAX_PIXELS              1024
+
+//values of the original bit loop encoder
+#define REF_RESET_ZEROS         45
+#define REF_ONE_HIGH_TICKS      13
+#define REF_ZERO_HIGH_TICKS     5
+
+//correction applied while checking the output
+#define TEST_BRIGHTNESS         200
+#define TEST_WHITE_RED          255
+#define TEST_WHITE_GREEN        224
+#define TEST_WHITE_BLUE         176
+
+NRF_DRV_WS2812_DEF(m_strip, 0, MAX_PIXELS);
+
+static uint32_t                m_nr_of_pixels;
+#if !NRF_DRV_WS2812_DITHER
+static nrf_drv_WS2812_pixel_t  m_ref_pixels[MAX_PIXELS];
+static nrf_pwm_values_common_t m_ref_seq_values[MAX_PIXELS * 24 + REF_RESET_ZEROS + 1];
+#endif
+
+static uint64_t cycles_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+#if !NRF_DRV_WS2812_DITHER
+
+//the encoder nrf_drv_WS2812_show() used before the lookup table
+static void ref_show(void)
+{
+    //the original used an uint8_t pixel index, widened here so strips above 255 pixels terminate
+    for(uint32_t i = 0; i < m_nr_of_pixels ; i++)
+    {
+        for(uint8_t j = 0; j < 8; j++)
+        {
+            if( (m_ref_pixels[i].green << j) & 0x80)
+            {
+                m_ref_seq_values[REF_RESET_ZEROS + i*24 + j] = REF_ONE_HIGH_TICKS | 0x8000;
+            }
+            else
+            {
+                m_ref_seq_values[REF_RESET_ZEROS + i*24 + j] = REF_ZERO_HIGH_TICKS | 0x8000;
+            }
+        }
+        for(uint8_t j = 0; j < 8; j++)
+        {
+            if( (m_ref_pixels[i].red << j) & 0x80)
+            {
+                m_ref_seq_values[REF_RESET_ZEROS + i*24 + j + 8] = REF_ONE_HIGH_TICKS | 0x8000;
+            }
+            else
+            {
+                m_ref_seq_values[REF_RESET_ZEROS + i*24 + j + 8] = REF_ZERO_HIGH_TICKS | 0x8000;
+            }
+        }
+        for(uint8_t j = 0; j < 8; j++)
+        {
+            if( (m_ref_pixels[i].blue << j) & 0x80)
+            {
+                m_ref_seq_values[REF_RESET_ZEROS + i*24 + j + 16] = REF_ONE_HIGH_TICKS | 0x8000;
+            }
+            else
+            {
+                m_ref_seq_values[REF_RESET_ZEROS + i*24 + j + 16] = REF_ZERO_HIGH_TICKS | 0x8000;
+            }
+        }
+    }
+}
+
+#endif
+
+//linear light of an 8 bit color, computed without the driver's gamma table
+static uint32_t ref_linear(uint8_t value)
+{
+#if NRF_DRV_WS2812_GAMMA
+    return (uint32_t)(65535.0 * pow(value / 255.0, 2.2) + 0.5);
+#else
+    return value * 257;
+#endif
+}
+
+//set pixels in random order, many of them back to off, and compare the current estimate with one
+//computed from the colors the pixels were left at
+static int check_current_estimate(void)
+{
+    static uint8_t colors[MAX_PIXELS][3];
+    uint8_t const white[3] = {TEST_WHITE_RED, TEST_WHITE_GREEN, TEST_WHITE_BLUE};
+    uint32_t seed = 7;
+    
+    for(uint32_t i = 0; i < m_nr_of_pixels; i++)
+    {
+        nrf_drv_WS2812_set_pixel_rgb(&m_strip, i, 0, 0, 0);
+    }
+    memset(colors, 0, sizeof(colors));
+    
+    for(uint32_t round = 0; round < 8; round++)
+    {
+        uint64_t load = 0;
+        uint32_t current_ua;
+        
+        for(uint32_t n = 0; n < m_nr_of_pixels * 4; n++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            uint32_t i = (seed >> 8) % m_nr_of_pixels;
+            
+            //the last round turns everything off again
+            if(round == 7 || (seed >> 30) == 0)
+            {
+                memset(colors[i], 0, 3);
+            }
+            else
+            {
+                seed = seed * 1664525u + 1013904223u;
+                colors[i][0] = seed >> 24;
+                colors[i][1] = seed >> 16;
+                colors[i][2] = seed >> 8;
+            }
+            nrf_drv_WS2812_set_pixel_rgb(&m_strip, i, colors[i][0], colors[i][1], colors[i][2]);
+        }
+        nrf_drv_WS2812_show(&m_strip);
+        nrf_drv_pwm_stub_play(0);
+        
+        //linear light times brightness and white balance, 65535 * 255 for a color at full on
+        for(uint32_t i = 0; i < m_nr_of_pixels; i++)
+        {
+            for(uint32_t c = 0; c < 3; c++)
+            {
+                load += (uint64_t)ref_linear(colors[i][c]) * ((TEST_BRIGHTNESS * white[c] + 127) / 255);
+            }
+        }
+        current_ua = m_nr_of_pixels * NRF_DRV_WS2812_PIXEL_IDLE_UA +
+                     load * NRF_DRV_WS2812_CHANNEL_UA / (65535ULL * 255);
+        if(nrf_drv_WS2812_get_current(&m_strip) != (current_ua + 999) / 1000)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#if NRF_DRV_WS2812_DITHER
+
+static double m_ref_levels[MAX_PIXELS][3];      //expected average output in GRB order
+
+//output level a 16 bit color should average to over a dithering cycle
+static double ref_level(uint16_t value, uint8_t white)
+{
+    uint32_t scale = (TEST_BRIGHTNESS * white + 127) / 255;
+#if NRF_DRV_WS2812_GAMMA
+    double linear = 65535.0 * pow(value / 65535.0, 2.2);
+#else
+    double linear = value;
+#endif
+    
+    return linear * scale / 65536.0;
+}
+
+static void fill_pixels(uint32_t seed)
+{
+    for(uint32_t i = 0; i < m_nr_of_pixels; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        uint16_t red   = seed >> 16;
+        seed = seed * 1664525u + 1013904223u;
+        uint16_t green = seed >> 16;
+        seed = seed * 1664525u + 1013904223u;
+        uint16_t blue  = seed >> 20;        //keep some colors in the dark end
+        
+        nrf_drv_WS2812_set_pixel16(&m_strip, i, red, green, blue);
+        m_ref_levels[i][0] = ref_level(green, TEST_WHITE_GREEN);
+        m_ref_levels[i][1] = ref_level(red,   TEST_WHITE_RED);
+        m_ref_levels[i][2] = ref_level(blue,  TEST_WHITE_BLUE);
+    }
+}
+
+//average the colors clocked out over one dithering cycle and compare them with the 16 bit colors
+static int check_dither(void)
+{
+    static uint32_t sums[MAX_PIXELS][3];
+    uint32_t const  frames = 1 << NRF_DRV_WS2812_DITHER_BITS;
+    
+    memset(sums, 0, sizeof(sums));
+    
+    //the frame sent before show() may still be playing
+    nrf_drv_pwm_stub_play(0);
+    nrf_drv_pwm_stub_play(0);
+    
+    for(uint32_t f = 0; f < frames; f++)
+    {
+        uint32_t length;
+        nrf_pwm_values_common_t const * p_values = nrf_drv_pwm_stub_capture(0, &length);
+        uint32_t reset_zeros = 0;
+        
+        while(reset_zeros < length && p_values[reset_zeros] == 0x8000)
+        {
+            reset_zeros++;
+        }
+        if(length < reset_zeros + m_nr_of_pixels * 24)
+        {
+            return -1;
+        }
+        
+        for(uint32_t i = 0; i < m_nr_of_pixels * 24; i++)
+        {
+            uint32_t bit = ((p_values[reset_zeros + i] & 0x7FFF) == REF_ONE_HIGH_TICKS);
+            
+            sums[i / 24][(i / 8) % 3] += bit << (7 - (i % 8));
+        }
+        nrf_drv_pwm_stub_play(0);
+    }
+    
+    for(uint32_t i = 0; i < m_nr_of_pixels; i++)
+    {
+        for(uint32_t c = 0; c < 3; c++)
+        {
+            //the fraction below the dithered bits is rounded off
+            if(fabs((double)sums[i][c] / frames - m_ref_levels[i][c]) > 0.5 / frames + 0.02)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+#else
+
+//what the driver should send for a color value, computed without its tables
+static uint8_t ref_correct(uint8_t value, uint8_t white)
+{
+    uint32_t scale = (TEST_BRIGHTNESS * white + 127) / 255;
+    
+    return (ref_linear(value) * scale + 0x8000) >> 16;
+}
+
+static void fill_pixels(uint32_t seed)
+{
+    for(uint32_t i = 0; i < m_nr_of_pixels; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        nrf_drv_WS2812_pixel_t color = {.red = seed >> 24, .green = seed >> 16, .blue = seed >> 8};
+        
+        nrf_drv_WS2812_set_pixel(&m_strip, i, &color);
+        m_ref_pixels[i].red   = ref_correct(color.red,   TEST_WHITE_RED);
+        m_ref_pixels[i].green = ref_correct(color.green, TEST_WHITE_GREEN);
+        m_ref_pixels[i].blue  = ref_correct(color.blue,  TEST_WHITE_BLUE);
+    }
+}
+
+//compare the 24 values per pixel with what was clocked out, skipping the reset low periods in front
+static int check_output(void)
+{
+    uint32_t length;
+    nrf_pwm_values_common_t const * p_values = nrf_drv_pwm_stub_capture(0, &length);
+    uint32_t reset_zeros = 0;
+    
+    while(reset_zeros < length && p_values[reset_zeros] == 0x8000)
+    {
+        reset_zeros++;
+    }
+    
+    if(reset_zeros < REF_RESET_ZEROS || length < reset_zeros + m_nr_of_pixels * 24 + 1 ||
+       memcmp(&p_values[reset_zeros],
+              &m_ref_seq_values[REF_RESET_ZEROS],
+              m_nr_of_pixels * 24 * sizeof(nrf_pwm_values_common_t)) != 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+//current the clocked out colors draw, by the same model as the driver's estimate
+static uint32_t output_current_ua(void)
+{
+    uint32_t length;
+    nrf_pwm_values_common_t const * p_values = nrf_drv_pwm_stub_capture(0, &length);
+    uint32_t reset_zeros = 0;
+    uint32_t sum = 0;
+    
+    while(reset_zeros < length && p_values[reset_zeros] == 0x8000)
+    {
+        reset_zeros++;
+    }
+    for(uint32_t i = 0; i < m_nr_of_pixels * 24 && reset_zeros + i < length; i++)
+    {
+        if((p_values[reset_zeros + i] & 0x7FFF) == REF_ONE_HIGH_TICKS)
+        {
+            sum += 1 << (7 - (i % 8));
+        }
+    }
+    return m_nr_of_pixels * NRF_DRV_WS2812_PIXEL_IDLE_UA + (uint64_t)sum * NRF_DRV_WS2812_CHANNEL_UA / 255;
+}
+
+//a white strip over the limit is dimmed evenly to it, without the limit it is sent as it was
+static int check_current_limit(void)
+{
+    uint32_t full_ma;
+    uint32_t limit_ma;
+    uint32_t output_ua;
+    
+    for(uint32_t i = 0; i < m_nr_of_pixels; i++)
+    {
+        nrf_drv_WS2812_set_pixel_rgb(&m_strip, i, 255, 255, 255);
+    }
+    nrf_drv_WS2812_show(&m_strip);
+    nrf_drv_pwm_stub_play(0);
+    full_ma = nrf_drv_WS2812_get_current(&m_strip);
+    if(abs((int32_t)output_current_ua() - (int32_t)full_ma * 1000) > (int32_t)m_nr_of_pixels * 1000)
+    {
+        return -1;
+    }
+    
+    limit_ma = full_ma / 2;
+    nrf_drv_WS2812_set_current_limit(&m_strip, limit_ma);
+    nrf_drv_WS2812_show(&m_strip);
+    nrf_drv_pwm_stub_play(0);
+    output_ua = output_current_ua();
+    //one output step per color of rounding in the correction tables
+    if(nrf_drv_WS2812_get_current(&m_strip) > limit_ma ||
+       output_ua > limit_ma * 1000 + m_nr_of_pixels * 3 * NRF_DRV_WS2812_CHANNEL_UA / 255 ||
+       output_ua < limit_ma * 900)
+    {
+        return -1;
+    }
+    
+    nrf_drv_WS2812_set_current_limit(&m_strip, 0);
+    fill_pixels(1);
+    ref_show();
+    nrf_drv_WS2812_show(&m_strip);
+    nrf_drv_pwm_stub_play(0);
+    return check_output();
+}
+
+#endif
+
+
+int main(int argc, char * argv[])
+{
+    uint64_t start;
+#if !NRF_DRV_WS2812_DITHER
+    uint64_t ref_cycles;
+#endif
+    uint64_t lut_cycles;
+    uint64_t one_cycles;
+    uint64_t same_cycles;
+    
+    m_nr_of_pixels = (argc > 1) ? strtoul(argv[1], NULL, 0) : 6;
+    if(m_nr_of_pixels == 0 || m_nr_of_pixels > MAX_PIXELS)
+    {
+        printf("usage: %s [pixels, 1-%u]\n", argv[0], MAX_PIXELS);
+        return 1;
+    }
+    
+    nrf_drv_WS2812_config_t const config =
+    {
+        .pin          = 0,
+        .nr_of_pixels = m_nr_of_pixels,
+        .handler      = NULL
+    };
+    APP_ERROR_CHECK(nrf_drv_WS2812_init(&m_strip, &config));
+    nrf_drv_pwm_stub_play(0);
+    nrf_drv_WS2812_set_brightness(&m_strip, TEST_BRIGHTNESS);
+    nrf_drv_WS2812_set_white_balance(&m_strip, TEST_WHITE_RED, TEST_WHITE_GREEN, TEST_WHITE_BLUE);
+    
+    if(check_current_estimate() != 0)
+    {
+        printf("FAIL: current estimate differs from the pixels\n");
+        return 1;
+    }
+    
+    for(uint32_t seed = 1; seed < 100; seed++)
+    {
+        fill_pixels(seed);
+#if NRF_DRV_WS2812_DITHER
+        nrf_drv_WS2812_show(&m_strip);
+        if(check_dither() != 0)
+        {
+            printf("FAIL: dithered output does not average to the 16 bit colors (seed %u)\n", (unsigned)seed);
+            return 1;
+        }
+    }
+#else
+        ref_show();
+        nrf_drv_WS2812_show(&m_strip);
+        nrf_drv_pwm_stub_play(0);
+        if(check_output() != 0)
+        {
+            printf("FAIL: encoder output differs from the reference (seed %u)\n", (unsigned)seed);
+            return 1;
+        }
+    }
+    
+    if(check_current_limit() != 0)
+    {
+        printf("FAIL: frame over the current limit was not dimmed to it\n");
+        return 1;
+    }
+    
+    //show() without changes must not send anything
+    nrf_drv_WS2812_show(&m_strip);
+    if(nrf_drv_WS2812_is_busy(&m_strip))
+    {
+        printf("FAIL: unchanged frame was sent again\n");
+        return 1;
+    }
+    
+    start = cycles_now();
+    for(uint32_t i = 0; i < ITERATIONS; i++)
+    {
+        for(uint32_t j = 0; j < m_nr_of_pixels; j++)
+        {
+            m_ref_pixels[j].red = (uint8_t)(i + j);
+        }
+        ref_show();
+    }
+    ref_cycles = cycles_now() - start;
+#endif
+    
+    //every pixel changes, so every pixel is encoded again
+    start = cycles_now();
+    for(uint32_t i = 0; i < ITERATIONS; i++)
+    {
+        for(uint32_t j = 0; j < m_nr_of_pixels; j++)
+        {
+            nrf_drv_WS2812_set_pixel_rgb(&m_strip, j, (uint8_t)(i + j), 0, 0);
+        }
+        nrf_drv_WS2812_show(&m_strip);
+#if NRF_DRV_WS2812_STREAMING
+        //encoding happens while the frame is clocked out, so this also counts the stub playback
+        nrf_drv_pwm_stub_play(0);
+#endif
+    }
+    lut_cycles = cycles_now() - start;
+    
+    //one pixel changes per frame
+    start = cycles_now();
+    for(uint32_t i = 0; i < ITERATIONS; i++)
+    {
+        nrf_drv_WS2812_set_pixel_rgb(&m_strip, i % m_nr_of_pixels, 0, (uint8_t)(i + 1), 0);
+        nrf_drv_WS2812_show(&m_strip);
+#if NRF_DRV_WS2812_STREAMING
+        nrf_drv_pwm_stub_play(0);
+#endif
+    }
+    one_cycles = cycles_now() - start;
+    
+    //the same color is written again, show() has nothing to do
+    start = cycles_now();
+    for(uint32_t i = 0; i < ITERATIONS; i++)
+    {
+        nrf_drv_WS2812_set_pixel_rgb(&m_strip, 0, 0, 1, 0);
+        nrf_drv_WS2812_show(&m_strip);
+    }
+    same_cycles = cycles_now() - start;
+    
+    printf("pixels: %u\n", (unsigned)m_nr_of_pixels);
+#if !NRF_DRV_WS2812_DITHER
+    printf("bit loop encoder:  %8.1f cycles/pixel\n", (double)ref_cycles / ITERATIONS / m_nr_of_pixels);
+#endif
+    printf("lookup encoder:    %8.1f cycles/pixel\n", (double)lut_cycles / ITERATIONS / m_nr_of_pixels);
+    printf("one pixel changed: %8.1f cycles/frame\n", (double)one_cycles / ITERATIONS);
+    printf("unchanged frame:   %8.1f cycles/frame\n", (double)same_cycles / ITERATIONS);
+    
+    return 0;
+}
@@ -0,0 +1,320 @@
+/* Host waveform check for the WS2812 pwm encoder.
+ *
+ * Clocks the pwm values nrf_drv_WS2812_show() encoded out of the pwm stub, turns them into the
+ * high and low times on the data pin and decodes those the way the first LED of the strip does:
+ * a reset, then 24 bits per pixel, green red blue, msb first. The times are checked against the
+ * WS2812 tolerances the PERIOD_TICKS and *_HIGH_TICKS comments in the driver are based on, the
+ * decoded bytes against the colors set with the correction applied.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "nrf_drv_WS2812.h"
+#include "nrf_drv_pwm.h"
+#include "app_error.h"
+
+#define MAX_PIXELS              1024
+#define SEEDS                   100
+
+//WS2812 timing, in ns
+#define T0H_NS                  350
+#define T1H_NS                  900
+#define BIT_NS                  1250
+#define TOLERANCE_NS            150
+#define RESET_NS                50000       //low time that latches the bits, and is needed before the first one
+
+#define TICK_NS                 (1000.0 / 16)   //16 MHz pwm clock
+
+//correction applied while checking the output, as in the benchmark
+#define TEST_BRIGHTNESS         200
+#define TEST_WHITE_RED          255
+#define TEST_WHITE_GREEN        224
+#define TEST_WHITE_BLUE         176
+
+NRF_DRV_WS2812_DEF(m_strip, 0, MAX_PIXELS);
+
+static uint32_t m_nr_of_pixels;
+static double   m_expected[MAX_PIXELS][3];      //output level per color in GRB order, in 8 bit steps
+
+//time the pin spends at one level, adjacent pwm periods at the same level are merged
+typedef struct
+{
+    uint8_t  high;
+    uint32_t ticks;
+} segment_t;
+
+static segment_t m_segments[64 * 1024 * 2];
+static uint32_t  m_nr_of_segments;
+static uint8_t   m_decoded[MAX_PIXELS * 3];
+
+//extremes seen over all frames, in ns
+typedef struct
+{
+    double min;
+    double max;
+} range_t;
+
+static range_t m_t0h   = {1e9, 0};
+static range_t m_t1h   = {1e9, 0};
+static range_t m_bit   = {1e9, 0};
+static range_t m_reset = {1e9, 0};
+
+static void range_add(range_t * p_range, double value)
+{
+    p_range->min = fmin(p_range->min, value);
+    p_range->max = fmax(p_range->max, value);
+}
+
+static void segment_add(uint8_t high, uint32_t ticks)
+{
+    if(ticks == 0)
+    {
+        return;
+    }
+    if(m_nr_of_segments != 0 && m_segments[m_nr_of_segments - 1].high == high)
+    {
+        m_segments[m_nr_of_segments - 1].ticks += ticks;
+        return;
+    }
+    m_segments[m_nr_of_segments].high  = high;
+    m_segments[m_nr_of_segments].ticks = ticks;
+    m_nr_of_segments++;
+}
+
+//what a pwm period looks like on the pin in up mode: bit 15 set starts the period high and
+//falls at the compare value, clear starts it low and rises there
+static void waveform_build(nrf_pwm_values_common_t const * p_values, uint32_t length, uint16_t top)
+{
+    m_nr_of_segments = 0;
+    for(uint32_t i = 0; i < length; i++)
+    {
+        uint32_t compare = p_values[i] & 0x7FFF;
+
+        if(compare > top)
+        {
+            compare = top;
+        }
+        if(p_values[i] & 0x8000)
+        {
+            segment_add(1, compare);
+            segment_add(0, top - compare);
+        }
+        else
+        {
+            segment_add(0, compare);
+            segment_add(1, top - compare);
+        }
+    }
+}
+
+static int within(double ns, double nominal)
+{
+    return fabs(ns - nominal) <= TOLERANCE_NS;
+}
+
+//decode the frame like the first LED would, returns the number of bits or -1 on a timing error
+static int waveform_decode(void)
+{
+    uint32_t bits = 0;
+
+    if(m_nr_of_segments < 2 || m_segments[0].high)
+    {
+        printf("FAIL: no reset in front of the frame\n");
+        return -1;
+    }
+    range_add(&m_reset, m_segments[0].ticks * TICK_NS);
+    if(m_segments[0].ticks * TICK_NS < RESET_NS)
+    {
+        printf("FAIL: reset of %.0f ns, needs %u ns\n", m_segments[0].ticks * TICK_NS, RESET_NS);
+        return -1;
+    }
+
+    for(uint32_t s = 1; s < m_nr_of_segments; s += 2)
+    {
+        double high = m_segments[s].ticks * TICK_NS;
+        double low  = (s + 1 < m_nr_of_segments) ? m_segments[s + 1].ticks * TICK_NS : 0;
+        uint8_t bit;
+
+        if(within(high, T0H_NS))
+        {
+            bit = 0;
+            range_add(&m_t0h, high);
+        }
+        else if(within(high, T1H_NS))
+        {
+            bit = 1;
+            range_add(&m_t1h, high);
+        }
+        else
+        {
+            printf("FAIL: bit %u high for %.1f ns, neither T0H nor T1H\n", (unsigned)bits, high);
+            return -1;
+        }
+
+        if(bits / 8 < sizeof(m_decoded))
+        {
+            m_decoded[bits / 8] = (m_decoded[bits / 8] << 1) | bit;
+        }
+        bits++;
+
+        if(low >= RESET_NS)
+        {
+            //latched, anything after it is the next frame
+            break;
+        }
+        if(s + 2 >= m_nr_of_segments)
+        {
+            //the pin has to end low, for at least the rest of the bit period
+            if(s + 1 >= m_nr_of_segments || high + low < BIT_NS - TOLERANCE_NS)
+            {
+                printf("FAIL: frame does not end low\n");
+                return -1;
+            }
+            break;
+        }
+
+        range_add(&m_bit, high + low);
+        if(!within(high + low, BIT_NS))
+        {
+            printf("FAIL: bit %u takes %.1f ns\n", (unsigned)bits - 1, high + low);
+            return -1;
+        }
+    }
+
+    return bits;
+}
+
+//output level a color should have, computed without the driver's tables
+static double ref_level(uint16_t value, uint8_t white)
+{
+    uint32_t scale = (TEST_BRIGHTNESS * white + 127) / 255;
+#if NRF_DRV_WS2812_GAMMA
+    double linear = 65535.0 * pow(value / 65535.0, 2.2);
+#else
+    double linear = value;
+#endif
+
+    return linear * scale / 65536.0;
+}
+
+static void fill_pixels(uint32_t seed)
+{
+    for(uint32_t i = 0; i < m_nr_of_pixels; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+#if NRF_DRV_WS2812_DITHER
+        uint16_t red   = seed >> 16;
+        seed = seed * 1664525u + 1013904223u;
+        uint16_t green = seed >> 16;
+        seed = seed * 1664525u + 1013904223u;
+        uint16_t blue  = seed >> 20;
+
+        nrf_drv_WS2812_set_pixel16(&m_strip, i, red, green, blue);
+#else
+        nrf_drv_WS2812_pixel_t color = {.red = seed >> 24, .green = seed >> 16, .blue = seed >> 8};
+        uint16_t red   = color.red * 257;
+        uint16_t green = color.green * 257;
+        uint16_t blue  = color.blue * 257;
+
+        nrf_drv_WS2812_set_pixel(&m_strip, i, &color);
+#endif
+        m_expected[i][0] = ref_level(green, TEST_WHITE_GREEN);
+        m_expected[i][1] = ref_level(red,   TEST_WHITE_RED);
+        m_expected[i][2] = ref_level(blue,  TEST_WHITE_BLUE);
+    }
+}
+
+//the driver rounds to the nearest step, dithering picks one of the two steps around the level
+static int check_bytes(void)
+{
+#if NRF_DRV_WS2812_DITHER
+    double const allowed = 1.0 + 0.02;
+#else
+    double const allowed = 0.5 + 0.02;
+#endif
+
+    for(uint32_t i = 0; i < m_nr_of_pixels * 3; i++)
+    {
+        if(fabs(m_decoded[i] - m_expected[i / 3][i % 3]) > allowed)
+        {
+            printf("FAIL: pixel %u color %u decoded as %u, expected %.2f\n",
+                   (unsigned)(i / 3), (unsigned)(i % 3), m_decoded[i], m_expected[i / 3][i % 3]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char * argv[])
+{
+    uint32_t length;
+    nrf_pwm_values_common_t const * p_values;
+
+    m_nr_of_pixels = (argc > 1) ? strtoul(argv[1], NULL, 0) : 6;
+    if(m_nr_of_pixels == 0 || m_nr_of_pixels > MAX_PIXELS)
+    {
+        printf("usage: %s [pixels, 1-%u]\n", argv[0], MAX_PIXELS);
+        return 1;
+    }
+
+    nrf_drv_WS2812_config_t const config =
+    {
+        .pin          = 0,
+        .nr_of_pixels = m_nr_of_pixels,
+        .handler      = NULL
+    };
+    APP_ERROR_CHECK(nrf_drv_WS2812_init(&m_strip, &config));
+    nrf_drv_pwm_stub_play(0);
+    nrf_drv_WS2812_set_brightness(&m_strip, TEST_BRIGHTNESS);
+    nrf_drv_WS2812_set_white_balance(&m_strip, TEST_WHITE_RED, TEST_WHITE_GREEN, TEST_WHITE_BLUE);
+
+    for(uint32_t seed = 1; seed < SEEDS; seed++)
+    {
+        int bits;
+
+        fill_pixels(seed);
+        nrf_drv_WS2812_show(&m_strip);
+#if NRF_DRV_WS2812_DITHER
+        //the frame sent before show() may still be playing
+        nrf_drv_pwm_stub_play(0);
+#endif
+        nrf_drv_pwm_stub_play(0);
+
+        p_values = nrf_drv_pwm_stub_capture(0, &length);
+        waveform_build(p_values, length, nrf_drv_pwm_stub_top_value(0));
+
+        bits = waveform_decode();
+        if(bits < 0)
+        {
+            printf("FAIL: timing (seed %u)\n", (unsigned)seed);
+            return 1;
+        }
+        if((uint32_t)bits != m_nr_of_pixels * 24)
+        {
+            printf("FAIL: %d bits in the frame, expected %u (seed %u)\n", bits, (unsigned)m_nr_of_pixels * 24, (unsigned)seed);
+            return 1;
+        }
+        if(check_bytes() != 0)
+        {
+            printf("FAIL: decoded colors (seed %u)\n", (unsigned)seed);
+            return 1;
+        }
+    }
+
+    printf("pixels: %u\n", (unsigned)m_nr_of_pixels);
+    printf("reset:      %8.1f ns      (min %u)\n", m_reset.min, RESET_NS);
+    printf("T0H:        %8.1f ns      (%u +-%u)\n", m_t0h.min, T0H_NS, TOLERANCE_NS);
+    printf("T1H:        %8.1f ns      (%u +-%u)\n", m_t1h.min, T1H_NS, TOLERANCE_NS);
+    printf("bit:        %8.1f ns      (%u +-%u)\n", m_bit.min, BIT_NS, TOLERANCE_NS);
+    if(m_t0h.min != m_t0h.max || m_t1h.min != m_t1h.max || m_bit.min != m_bit.max)
+    {
+        printf("FAIL: times vary between bits\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,398 @@
+
+#include <string.h>
+
+#include "sdk_common.h"
+#include "app_timer.h"
+#include "light_animation.h"
+
+#define HUE_SECTOR              10923       //one sixth of the color wheel, hues are 16 bit
+#define DURATION_MASK           0x3FFF      //of the encoded keyframe word, the interpolation is above it
+
+typedef struct
+{
+    uint16_t hue;
+    uint16_t saturation;
+    uint16_t value;
+} hsv_t;
+
+APP_TIMER_DEF(m_fade_timer_id);
+
+static nrf_drv_WS2812_t *       mp_strip;
+static uint16_t                 m_nr_of_pixels;
+static light_animation_show_handler_t m_show_handler;
+static uint16_t                 m_tick_interval_ms;
+static uint32_t                 m_tick_interval;    //in app_timer ticks
+
+static light_animation_t        m_animation;
+static nrf_drv_WS2812_pixel16_t m_start_color;      //what the first keyframe fades from on the first pass
+static uint32_t                 m_period_ms;        //one pass through all keyframes
+static uint32_t                 m_lag_ms;           //how far the last pixel lags behind the first
+static uint32_t                 m_time_ms;          //of the first pixel, since the start
+static bool                     m_running;
+
+
+//smoothstep, 3t^2 - 2t^3, t in 1/65536
+static uint32_t ease(uint32_t t)
+{
+    uint32_t t2 = (t * t) >> 16;
+
+    return (t2 * ((3UL << 16) - 2 * t)) >> 16;
+}
+
+
+static uint16_t lerp(uint16_t from, uint16_t to, uint32_t t)
+{
+    return from + (int32_t)(((int64_t)((int32_t)to - from) * t) >> 16);
+}
+
+
+static void rgb_to_hsv(nrf_drv_WS2812_pixel16_t const * p_rgb, hsv_t * p_hsv)
+{
+    int32_t max = MAX(p_rgb->red, MAX(p_rgb->green, p_rgb->blue));
+    int32_t min = MIN(p_rgb->red, MIN(p_rgb->green, p_rgb->blue));
+    int32_t delta = max - min;
+
+    p_hsv->value = max;
+    if(delta == 0)
+    {
+        p_hsv->hue = 0;
+        p_hsv->saturation = 0;
+        return;
+    }
+
+    p_hsv->saturation = ((uint32_t)delta * 0xFFFF) / max;
+
+    //negative hues wrap around through the cast
+    if(max == p_rgb->red)
+    {
+        p_hsv->hue = (uint16_t)(((int32_t)p_rgb->green - p_rgb->blue) * HUE_SECTOR / delta);
+    }
+    else if(max == p_rgb->green)
+    {
+        p_hsv->hue = (uint16_t)(2 * HUE_SECTOR + ((int32_t)p_rgb->blue - p_rgb->red) * HUE_SECTOR / delta);
+    }
+    else
+    {
+        p_hsv->hue = (uint16_t)(4 * HUE_SECTOR + ((int32_t)p_rgb->red - p_rgb->green) * HUE_SECTOR / delta);
+    }
+}
+
+
+static void hsv_to_rgb(hsv_t const * p_hsv, nrf_drv_WS2812_pixel16_t * p_rgb)
+{
+    uint32_t h6 = (uint32_t)p_hsv->hue * 6;
+    uint32_t f = h6 & 0xFFFF;                   //position within the sector
+    uint32_t s = p_hsv->saturation;
+    uint32_t v = p_hsv->value;
+    uint16_t p = (v * (0x10000 - s)) >> 16;
+    uint16_t q = (v * (0x10000 - ((s * f) >> 16))) >> 16;
+    uint16_t t = (v * (0x10000 - ((s * (0x10000 - f)) >> 16))) >> 16;
+
+    switch(h6 >> 16)
+    {
+        case 0:  p_rgb->red = v; p_rgb->green = t; p_rgb->blue = p; break;
+        case 1:  p_rgb->red = q; p_rgb->green = v; p_rgb->blue = p; break;
+        case 2:  p_rgb->red = p; p_rgb->green = v; p_rgb->blue = t; break;
+        case 3:  p_rgb->red = p; p_rgb->green = q; p_rgb->blue = v; break;
+        case 4:  p_rgb->red = t; p_rgb->green = p; p_rgb->blue = v; break;
+        default: p_rgb->red = v; p_rgb->green = p; p_rgb->blue = q; break;
+    }
+}
+
+
+static void color16(nrf_drv_WS2812_pixel_t const * p_color, nrf_drv_WS2812_pixel16_t * p_color16)
+{
+    p_color16->red = p_color->red * 257;
+    p_color16->green = p_color->green * 257;
+    p_color16->blue = p_color->blue * 257;
+}
+
+
+//t is the position between the two colors in 1/65536
+static void interpolate(nrf_drv_WS2812_pixel16_t const * p_from,
+                        nrf_drv_WS2812_pixel16_t const * p_to,
+                        uint8_t interpolation, uint32_t t,
+                        nrf_drv_WS2812_pixel16_t * p_color)
+{
+    hsv_t from, to, hsv;
+
+    switch(interpolation)
+    {
+        case LIGHT_ANIMATION_STEP:
+            *p_color = *p_from;
+            return;
+
+        case LIGHT_ANIMATION_HUE:
+            rgb_to_hsv(p_from, &from);
+            rgb_to_hsv(p_to, &to);
+
+            //grey has no hue of its own and black no saturation either, take them from the other end
+            if(from.value == 0)
+            {
+                from.saturation = to.saturation;
+            }
+            if(to.value == 0)
+            {
+                to.saturation = from.saturation;
+            }
+            if(from.saturation == 0)
+            {
+                from.hue = to.hue;
+            }
+            if(to.saturation == 0)
+            {
+                to.hue = from.hue;
+            }
+
+            hsv.hue = from.hue + (((int32_t)(int16_t)(to.hue - from.hue) * (int32_t)t) >> 16);
+            hsv.saturation = lerp(from.saturation, to.saturation, t);
+            hsv.value = lerp(from.value, to.value, t);
+            hsv_to_rgb(&hsv, p_color);
+            return;
+
+        case LIGHT_ANIMATION_EASE:
+            t = ease(t);
+            break;
+
+        default:
+            break;
+    }
+
+    p_color->red = lerp(p_from->red, p_to->red, t);
+    p_color->green = lerp(p_from->green, p_to->green, t);
+    p_color->blue = lerp(p_from->blue, p_to->blue, t);
+}
+
+
+//color at time_ms into the animation, negative times have not started yet
+static void color_at(int32_t time_ms, nrf_drv_WS2812_pixel16_t * p_color)
+{
+    light_animation_keyframe_t const * p_last = &m_animation.keyframes[m_animation.nr_of_keyframes - 1];
+    nrf_drv_WS2812_pixel16_t from, to;
+    uint32_t pass, position;
+    uint8_t k;
+
+    if(time_ms < 0)
+    {
+        *p_color = m_start_color;
+        return;
+    }
+
+    pass = (uint32_t)time_ms / m_period_ms;
+    if(m_animation.repeat != LIGHT_ANIMATION_REPEAT_FOREVER && pass > m_animation.repeat)
+    {
+        color16(&p_last->color, p_color);
+        return;
+    }
+
+    //keyframes with zero duration are passed over
+    position = (uint32_t)time_ms % m_period_ms;
+    for(k = 0; position >= m_animation.keyframes[k].duration_ms; k++)
+    {
+        position -= m_animation.keyframes[k].duration_ms;
+    }
+
+    if(k > 0)
+    {
+        color16(&m_animation.keyframes[k - 1].color, &from);
+    }
+    else if(pass > 0)
+    {
+        color16(&p_last->color, &from);
+    }
+    else
+    {
+        from = m_start_color;
+    }
+    color16(&m_animation.keyframes[k].color, &to);
+
+    interpolate(&from, &to, m_animation.keyframes[k].interpolation,
+                (uint32_t)(((uint64_t)position << 16) / m_animation.keyframes[k].duration_ms), p_color);
+}
+
+
+static void render(void)
+{
+    nrf_drv_WS2812_pixel16_t color;
+
+    for(uint16_t i = 0; i < m_nr_of_pixels; i++)
+    {
+        color_at((int32_t)m_time_ms - i * m_animation.pixel_delay_ms, &color);
+        nrf_drv_WS2812_set_pixel16(mp_strip, i, color.red, color.green, color.blue);
+    }
+
+    if(m_show_handler != NULL)
+    {
+        m_show_handler();
+    }
+    else
+    {
+        nrf_drv_WS2812_show(mp_strip);
+    }
+}
+
+
+static void fade_timer_handler(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    if(!m_running)
+    {
+        return;
+    }
+
+    m_time_ms += m_tick_interval_ms;
+
+    if(m_animation.repeat == LIGHT_ANIMATION_REPEAT_FOREVER)
+    {
+        //keep the time bounded once every pixel is past its first pass
+        if(m_time_ms >= 2 * m_period_ms + m_lag_ms)
+        {
+            m_time_ms -= m_period_ms;
+        }
+    }
+    else if(m_time_ms >= (m_animation.repeat + 1) * m_period_ms + m_lag_ms)
+    {
+        //the last pixel is done too, leave everything on the last keyframe
+        light_animation_stop();
+    }
+
+    render();
+}
+
+
+uint32_t light_animation_init(light_animation_init_t const * p_init)
+{
+    VERIFY_PARAM_NOT_NULL(p_init);
+    VERIFY_PARAM_NOT_NULL(p_init->p_strip);
+
+    mp_strip = p_init->p_strip;
+    m_nr_of_pixels = p_init->nr_of_pixels;
+    m_show_handler = p_init->show_handler;
+    m_tick_interval_ms = MAX(p_init->tick_interval_ms, 1);
+    m_tick_interval = APP_TIMER_TICKS(m_tick_interval_ms, p_init->timer_prescaler);
+    m_running = false;
+
+    //the timer only runs while an animation does
+    return app_timer_create(&m_fade_timer_id, APP_TIMER_MODE_REPEATED, fade_timer_handler);
+}
+
+
+uint32_t light_animation_start(light_animation_t const * p_animation)
+{
+    uint32_t err_code;
+    uint32_t period_ms = 0;
+
+    VERIFY_PARAM_NOT_NULL(p_animation);
+    if(p_animation->nr_of_keyframes == 0 || p_animation->nr_of_keyframes > LIGHT_ANIMATION_MAX_KEYFRAMES)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    for(uint8_t k = 0; k < p_animation->nr_of_keyframes; k++)
+    {
+        period_ms += p_animation->keyframes[k].duration_ms;
+    }
+
+    light_animation_stop();
+
+    m_animation = *p_animation;
+    nrf_drv_WS2812_get_pixel16(mp_strip, 0, &m_start_color);
+
+    if(period_ms == 0)
+    {
+        //nothing to animate, render one frame past the end to go straight to the last color
+        m_animation.repeat = 0;
+        m_animation.pixel_delay_ms = 0;
+        m_period_ms = 1;
+        m_lag_ms = 0;
+        m_time_ms = 1;
+        render();
+        return NRF_SUCCESS;
+    }
+
+    m_period_ms = period_ms;
+    m_lag_ms = (uint32_t)m_animation.pixel_delay_ms * (m_nr_of_pixels - 1);
+    m_time_ms = 0;
+    m_running = true;
+
+    err_code = app_timer_start(m_fade_timer_id, m_tick_interval, NULL);
+    VERIFY_SUCCESS(err_code);
+
+    render();
+
+    return NRF_SUCCESS;
+}
+
+
+void light_animation_stop(void)
+{
+    if(m_running)
+    {
+        m_running = false;
+        UNUSED_RETURN_VALUE(app_timer_stop(m_fade_timer_id));
+    }
+}
+
+
+bool light_animation_is_running(void)
+{
+    return m_running;
+}
+
+
+uint32_t light_animation_time_get(void)
+{
+    return m_time_ms;
+}
+
+
+void light_animation_time_set(uint32_t time_ms)
+{
+    if(!m_running)
+    {
+        return;
+    }
+
+    if(m_animation.repeat == LIGHT_ANIMATION_REPEAT_FOREVER && time_ms >= 2 * m_period_ms + m_lag_ms)
+    {
+        //same bound as the tick handler keeps
+        time_ms = m_period_ms + (time_ms - m_period_ms) % m_period_ms;
+    }
+    m_time_ms = time_ms;
+}
+
+
+uint32_t light_animation_decode(light_animation_t * p_animation, uint8_t const * p_data, uint16_t length)
+{
+    uint8_t nr_of_keyframes;
+
+    if(length < LIGHT_ANIMATION_HEADER_SIZE + LIGHT_ANIMATION_KEYFRAME_SIZE ||
+       length > LIGHT_ANIMATION_MAX_ENCODED_SIZE ||
+       (length - LIGHT_ANIMATION_HEADER_SIZE) % LIGHT_ANIMATION_KEYFRAME_SIZE != 0)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    nr_of_keyframes = (length - LIGHT_ANIMATION_HEADER_SIZE) / LIGHT_ANIMATION_KEYFRAME_SIZE;
+
+    memset(p_animation, 0, sizeof(light_animation_t));
+    p_animation->repeat = p_data[0];
+    p_animation->pixel_delay_ms = p_data[1] * LIGHT_ANIMATION_TIME_UNIT_MS;
+    p_animation->nr_of_keyframes = nr_of_keyframes;
+    p_data += LIGHT_ANIMATION_HEADER_SIZE;
+
+    for(uint8_t k = 0; k < nr_of_keyframes; k++)
+    {
+        uint16_t word = uint16_decode(&p_data[3]);
+
+        p_animation->keyframes[k].color.red = p_data[0];
+        p_animation->keyframes[k].color.green = p_data[1];
+        p_animation->keyframes[k].color.blue = p_data[2];
+        p_animation->keyframes[k].duration_ms = (uint32_t)(word & DURATION_MASK) * LIGHT_ANIMATION_TIME_UNIT_MS;
+        p_animation->keyframes[k].interpolation = word >> 14;
+        p_data += LIGHT_ANIMATION_KEYFRAME_SIZE;
+    }
+
+    return NRF_SUCCESS;
+}
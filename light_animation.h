@@ -0,0 +1,99 @@
+#ifndef LIGHT_ANIMATION_H__
+#define LIGHT_ANIMATION_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nrf_drv_WS2812.h"
+
+/* Keyframe animations for a WS2812 strip. Keyframes are interpolated in fixed point into 16 bit
+ * colors from one app_timer tick, so a fade or color cycle started once keeps running without
+ * any further BLE traffic. Set NRF_DRV_WS2812_DITHER in the driver to get the 16 bits onto the
+ * LEDs, otherwise they are cut to 8.
+ */
+
+#define LIGHT_ANIMATION_MAX_KEYFRAMES       8
+#define LIGHT_ANIMATION_REPEAT_FOREVER      0xFF
+
+//encoded animation, as written over BLE
+#define LIGHT_ANIMATION_HEADER_SIZE         2
+#define LIGHT_ANIMATION_KEYFRAME_SIZE       5
+#define LIGHT_ANIMATION_MAX_ENCODED_SIZE    (LIGHT_ANIMATION_HEADER_SIZE + LIGHT_ANIMATION_MAX_KEYFRAMES * LIGHT_ANIMATION_KEYFRAME_SIZE)
+#define LIGHT_ANIMATION_TIME_UNIT_MS        10
+
+typedef enum
+{
+    LIGHT_ANIMATION_LINEAR,     /**< Constant speed from one color to the next. */
+    LIGHT_ANIMATION_EASE,       /**< Starts and ends slowly (smoothstep). */
+    LIGHT_ANIMATION_HUE,        /**< Linear in HSV, the hue going the short way around the color wheel. */
+    LIGHT_ANIMATION_STEP,       /**< Holds the previous color, then jumps. */
+} light_animation_interpolation_t;
+
+typedef struct
+{
+    nrf_drv_WS2812_pixel_t color;
+    uint32_t               duration_ms;      /**< Time to get to this color from the previous keyframe. */
+    uint8_t                interpolation;    /**< @ref light_animation_interpolation_t used on the way to this keyframe. */
+} light_animation_keyframe_t;
+
+/**@brief An animation. The first keyframe starts from the color pixel 0 has when the animation
+ *        is started, and from the last keyframe on every repeat.
+ */
+typedef struct
+{
+    light_animation_keyframe_t keyframes[LIGHT_ANIMATION_MAX_KEYFRAMES];
+    uint8_t                    nr_of_keyframes;
+    uint8_t                    repeat;          /**< Times to play it again after the first time, or @ref LIGHT_ANIMATION_REPEAT_FOREVER. */
+    uint16_t                   pixel_delay_ms;  /**< How far each pixel lags behind the one before it, for chases. */
+} light_animation_t;
+
+/**@brief Called after the pixels of a frame were set, to show them from somewhere else than the
+ *        tick.
+ */
+typedef void (*light_animation_show_handler_t)(void);
+
+typedef struct
+{
+    nrf_drv_WS2812_t *             p_strip;
+    uint16_t                       nr_of_pixels;
+    uint16_t                       tick_interval_ms;      /**< Time between two rendered frames. */
+    uint32_t                       timer_prescaler;       /**< Prescaler app_timer was initialized with. */
+    light_animation_show_handler_t show_handler;          /**< NULL to show every frame right away. */
+} light_animation_init_t;
+
+/**@brief Create the tick timer. app_timer must be initialized first.
+ */
+uint32_t light_animation_init(light_animation_init_t const * p_init);
+
+/**@brief Start an animation, replacing the running one. The animation is copied.
+ *
+ * @retval NRF_SUCCESS              If the animation was started.
+ * @retval NRF_ERROR_INVALID_PARAM  If it has no keyframes or too many.
+ */
+uint32_t light_animation_start(light_animation_t const * p_animation);
+
+/**@brief Stop the running animation, the pixels keep their current colors. */
+void light_animation_stop(void);
+
+bool light_animation_is_running(void);
+
+/**@brief Time into the running animation, in ms. */
+uint32_t light_animation_time_get(void);
+
+/**@brief Jump to a time into the running animation, to keep it in step with another glass. */
+void light_animation_time_set(uint32_t time_ms);
+
+/**@brief Decode an animation written over BLE.
+ *
+ * @details All values are little endian:
+ *          - byte 0:   repeat
+ *          - byte 1:   pixel delay, in units of @ref LIGHT_ANIMATION_TIME_UNIT_MS
+ *          - then per keyframe red, green, blue and a 16 bit word holding the duration in units
+ *            of @ref LIGHT_ANIMATION_TIME_UNIT_MS in bits 0-13 and the interpolation in bits 14-15.
+ *
+ * @retval NRF_SUCCESS                If the animation was decoded.
+ * @retval NRF_ERROR_INVALID_LENGTH   If the length does not fit a whole number of keyframes.
+ */
+uint32_t light_animation_decode(light_animation_t * p_animation, uint8_t const * p_data, uint16_t length);
+
+#endif //LIGHT_ANIMATION_H__
@@ -0,0 +1,153 @@
+
+#include <string.h>
+
+#include "sdk_common.h"
+#include "ble_gap.h"
+#include "advertiser_beacon.h"
+#include "light_sync.h"
+
+#define STATE_MAGIC             0x67        //'g', tells glass states apart from other test company data
+#define STATE_AD_SIZE           14          //length, type, company id, magic, group, color, animation, time
+#define STATE_AD_LENGTH         (STATE_AD_SIZE - 1)
+
+#define SCAN_INTERVAL           MSEC_TO_UNITS(200, UNIT_0_625_MS)
+#define SCAN_WINDOW             MSEC_TO_UNITS(50, UNIT_0_625_MS)        //a quarter of the time, the glasses run on a battery
+
+static uint8_t              m_group;
+static light_sync_handler_t m_handler;
+static bool                 m_following;
+
+
+uint32_t light_sync_init(light_sync_init_t const * p_init)
+{
+    VERIFY_PARAM_NOT_NULL(p_init);
+
+    m_group     = p_init->group;
+    m_handler   = p_init->handler;
+    m_following = false;
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t light_sync_broadcast(light_sync_state_t const * p_state)
+{
+    uint8_t ad[STATE_AD_SIZE];
+    uint8_t offset = 0;
+
+    ad[offset++] = STATE_AD_LENGTH;
+    ad[offset++] = BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA;
+    offset += uint16_encode(LIGHT_SYNC_COMPANY_ID, &ad[offset]);
+    ad[offset++] = STATE_MAGIC;
+    ad[offset++] = m_group;
+    ad[offset++] = p_state->color.red;
+    ad[offset++] = p_state->color.green;
+    ad[offset++] = p_state->color.blue;
+    ad[offset++] = p_state->animation_id;
+    offset += uint32_encode(p_state->time_ms, &ad[offset]);
+
+    return app_beacon_adv_data_update(ad, offset);
+}
+
+
+uint32_t light_sync_follow_start(void)
+{
+    uint32_t              err_code;
+    ble_gap_scan_params_t scan_params;
+
+    if (m_following)
+    {
+        return NRF_SUCCESS;
+    }
+
+    memset(&scan_params, 0, sizeof(scan_params));
+    scan_params.active   = 0;
+    scan_params.interval = SCAN_INTERVAL;
+    scan_params.window   = SCAN_WINDOW;
+    scan_params.timeout  = 0;
+
+    err_code = sd_ble_gap_scan_start(&scan_params);
+    VERIFY_SUCCESS(err_code);
+
+    m_following = true;
+    return NRF_SUCCESS;
+}
+
+
+uint32_t light_sync_follow_stop(void)
+{
+    if (!m_following)
+    {
+        return NRF_SUCCESS;
+    }
+
+    m_following = false;
+    return sd_ble_gap_scan_stop();
+}
+
+
+// Look for a state of our group in the advertising data.
+static bool state_decode(uint8_t const * p_data, uint8_t length, light_sync_state_t * p_state)
+{
+    uint8_t offset = 0;
+
+    while (offset + 1 < length)
+    {
+        uint8_t field_length = p_data[offset];
+        uint8_t const * p_field = &p_data[offset + 1];
+
+        if (field_length == 0 || offset + 1 + field_length > length)
+        {
+            return false;
+        }
+
+        if (field_length == STATE_AD_LENGTH &&
+            p_field[0] == BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA &&
+            uint16_decode(&p_field[1]) == LIGHT_SYNC_COMPANY_ID &&
+            p_field[3] == STATE_MAGIC &&
+            p_field[4] == m_group)
+        {
+            p_state->color.red    = p_field[5];
+            p_state->color.green  = p_field[6];
+            p_state->color.blue   = p_field[7];
+            p_state->animation_id = p_field[8];
+            p_state->time_ms      = uint32_decode(&p_field[9]);
+            return true;
+        }
+
+        offset += field_length + 1;
+    }
+
+    return false;
+}
+
+
+void light_sync_on_ble_evt(ble_evt_t * p_ble_evt)
+{
+    light_sync_state_t state;
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_ADV_REPORT:
+        {
+            ble_gap_evt_adv_report_t const * p_report = &p_ble_evt->evt.gap_evt.params.adv_report;
+
+            if (m_following && m_handler != NULL && state_decode(p_report->data, p_report->dlen, &state))
+            {
+                m_handler(&state);
+            }
+        } break;
+
+        case BLE_GAP_EVT_TIMEOUT:
+            if (p_ble_evt->evt.gap_evt.params.timeout.src == BLE_GAP_TIMEOUT_SRC_SCAN && m_following)
+            {
+                // Should not happen without a scan timeout, keep following anyway.
+                m_following = false;
+                UNUSED_RETURN_VALUE(light_sync_follow_start());
+            }
+            break;
+
+        default:
+            break;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef LIGHT_SYNC_H__
+#define LIGHT_SYNC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ble.h"
+#include "nrf_drv_WS2812.h"
+
+/* Connectionless light sync. The glass the phone is connected to puts its light state into the
+ * payload of the timeslot beacon, the other glasses scan for it and follow, so any number of them
+ * change together without a connection each.
+ */
+
+#define LIGHT_SYNC_COMPANY_ID           0xFFFF      //reserved by the Bluetooth SIG for tests, replace with an assigned one
+#define LIGHT_SYNC_ANIMATION_NONE       0x00        /**< Static color. */
+#define LIGHT_SYNC_ANIMATION_CUSTOM     0xFF        /**< Written over BLE, followers can only mirror its current color. */
+
+typedef struct
+{
+    nrf_drv_WS2812_pixel_t color;           /**< Current color of the first pixel. */
+    uint8_t                animation_id;    /**< Built-in animation running, or one of the values above. */
+    uint32_t               time_ms;         /**< Time into the animation. */
+} light_sync_state_t;
+
+/**@brief Called on a follower for every state heard from a leader of its group. */
+typedef void (*light_sync_handler_t)(light_sync_state_t const * p_state);
+
+typedef struct
+{
+    uint8_t              group;             /**< Only glasses in the same group follow each other. */
+    light_sync_handler_t handler;
+} light_sync_init_t;
+
+uint32_t light_sync_init(light_sync_init_t const * p_init);
+
+/**@brief Put the state into the beacon payload. Call it again whenever the state changes and
+ *        regularly while an animation runs, so the time followers get stays fresh.
+ *
+ * @retval NRF_ERROR_BUSY  If the beacon is still sending the previous state, try again later.
+ */
+uint32_t light_sync_broadcast(light_sync_state_t const * p_state);
+
+/**@brief Start scanning for the state of a leader. */
+uint32_t light_sync_follow_start(void);
+
+/**@brief Stop scanning, for instance when this glass becomes the leader. */
+uint32_t light_sync_follow_stop(void);
+
+/**@brief Handle the advertising reports while following. */
+void light_sync_on_ble_evt(ble_evt_t * p_ble_evt);
+
+#endif //LIGHT_SYNC_H__
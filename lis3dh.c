@@ -1,49 +1,511 @@
 
+#include <string.h>
 
 #include "nrf.h"
 #include "nrf_drv_spi.h"
+#include "nrf_drv_gpiote.h"
+#include "nrf_gpio.h"
 #include "pin_definitions.h"
 #include "app_error.h"
+#include "app_util_platform.h"
+#include "sdk_common.h"
+#include "lis3dh.h"
+
+#define LIS3DH_READ             0x80
+#define LIS3DH_AUTO_INCREMENT   0x40
+#define LIS3DH_ADDR_MASK        0x3F
+
+#define WHO_AM_I                0x0F
+#define WHO_AM_I_VALUE          0x33
+#define CTRL_REG1               0x20
+#define CTRL_REG2               0x21
+#define CTRL_REG3               0x22
+#define CTRL_REG4               0x23
+#define CTRL_REG5               0x24
+#define CTRL_REG6               0x25
+#define REFERENCE               0x26
+#define OUT_X_L                 0x28
+#define FIFO_CTRL_REG           0x2E
+#define FIFO_SRC_REG            0x2F
+#define INT2_CFG                0x34
+#define INT2_THS                0x36
+#define INT2_DURATION           0x37
+#define CLICK_CFG               0x38
+#define CLICK_THS               0x3A
+#define TIME_LIMIT              0x3B
+
+#define CTRL_REG1_LPEN          0x08
+#define CTRL_REG1_XYZ_EN        0x07
+#define CTRL_REG2_HPCLICK       0x04
+#define CTRL_REG2_HP_IA2        0x02
+#define CTRL_REG3_I1_CLICK      0x80
+#define CTRL_REG3_I1_WTM        0x04
+#define CTRL_REG4_BDU           0x80
+#define CTRL_REG4_HR            0x08
+#define CTRL_REG5_FIFO_EN       0x40
+#define CTRL_REG6_I2_IA2        0x20
+#define INT2_CFG_XYZ_HIGH       0x2A
+#define CLICK_CFG_XYZ_SINGLE    0x15
+#define FIFO_CTRL_BYPASS        0x00
+#define FIFO_CTRL_STREAM        0x80
+#define FIFO_SRC_OVRN           0x40
+#define FIFO_SRC_FSS_MASK       0x1F
+
+#define SAMPLE_SIZE             6
+#define CLICK_MAX_LENGTH_MS     40          //a knock, not a push
+
+//threshold registers count in steps of the full scale
+static const uint16_t m_threshold_mg[] = {16, 32, 62, 186};
+static const uint16_t m_odr_hz[] = {0, 1, 10, 25, 50, 100, 200, 400};
 
 static const nrf_drv_spi_t spi = NRF_DRV_SPI_INSTANCE(0);
 static volatile bool spi_xfer_done;
 
-void spi_event_handler(nrf_drv_spi_evt_t const * p_event)
+//what the running transfer is
+static enum
+{
+    XFER_IDLE,
+    XFER_BLOCKING,
+    XFER_FIFO_SRC,
+    XFER_FIFO_DATA,
+    XFER_WRITE,
+} volatile m_xfer;
+
+static enum
+{
+    MODE_OFF,
+    MODE_STREAM,
+    MODE_WAKEUP,
+} volatile m_mode;
+
+static lis3dh_config_t  m_config;
+static volatile bool    m_config_pending;   //a mode change waits for the running transfer
+static volatile bool    m_wakeup_armed;     //the wake-up handler has not been called yet
+
+//tx is the command byte only, rx starts with the byte clocked in while it is sent
+static uint8_t          m_cmd_byte;
+static uint8_t          m_writes[14][2];    //register and value, a read if the register has LIS3DH_READ
+static uint8_t          m_write_idx;
+static uint8_t          m_nr_of_writes;
+static uint8_t          m_rx[1 + LIS3DH_FIFO_SIZE * SAMPLE_SIZE];
+
+//written in the SPI interrupt, read in the application
+static lis3dh_sample_t  m_ring[LIS3DH_RING_SIZE];
+static volatile uint32_t m_ring_head;
+static volatile uint32_t m_ring_tail;
+static volatile uint32_t m_dropped;
+
+STATIC_ASSERT((LIS3DH_RING_SIZE & (LIS3DH_RING_SIZE - 1)) == 0);
+STATIC_ASSERT(sizeof(m_rx) <= 255);     //longest EasyDMA transfer
+
+static void fifo_src_read(void);
+static void config_write(void);
+
+
+static void spi_transfer(uint8_t cmd_byte, uint8_t size)
+{
+    m_cmd_byte = cmd_byte;
+    APP_ERROR_CHECK(nrf_drv_spi_transfer(&spi, &m_cmd_byte, 1, m_rx, size));
+}
+
+
+static void fifo_data_read(uint8_t nr_of_samples)
+{
+    //the address goes back from the last output register to OUT_X_L while the FIFO is on, so one
+    //burst empties it
+    m_xfer = XFER_FIFO_DATA;
+    spi_transfer(OUT_X_L | LIS3DH_READ | LIS3DH_AUTO_INCREMENT, 1 + nr_of_samples * SAMPLE_SIZE);
+}
+
+
+static void fifo_data_store(uint8_t nr_of_samples)
+{
+    uint8_t const * p_data = &m_rx[1];
+    uint16_t stored = 0;
+
+    for(uint8_t i = 0; i < nr_of_samples; i++, p_data += SAMPLE_SIZE)
+    {
+        if(m_ring_head - m_ring_tail >= LIS3DH_RING_SIZE)
+        {
+            m_dropped += nr_of_samples - i;
+            break;
+        }
+
+        lis3dh_sample_t * p_sample = &m_ring[m_ring_head & (LIS3DH_RING_SIZE - 1)];
+        p_sample->x = (int16_t)uint16_decode(&p_data[0]);
+        p_sample->y = (int16_t)uint16_decode(&p_data[2]);
+        p_sample->z = (int16_t)uint16_decode(&p_data[4]);
+        m_ring_head++;
+        stored++;
+    }
+
+    if(stored != 0 && m_config.handler != NULL)
+    {
+        m_config.handler(stored);
+    }
+}
+
+
+static void write_next(void)
+{
+    m_xfer = XFER_WRITE;
+    APP_ERROR_CHECK(nrf_drv_spi_transfer(&spi, m_writes[m_write_idx], 2, m_rx, 2));
+}
+
+
+//the interrupts of a mode are only taken once all its registers are written
+static void config_done(void)
+{
+    if(m_mode == MODE_STREAM)
+    {
+        nrf_drv_gpiote_in_event_enable(ACC_INT1_PIN, true);
+    }
+    else if(m_mode == MODE_WAKEUP)
+    {
+        m_wakeup_armed = true;
+        nrf_drv_gpiote_in_event_enable(ACC_INT1_PIN, true);
+        nrf_drv_gpiote_in_event_enable(ACC_INT2_PIN, true);
+    }
+}
+
+
+//the next transfer once one is done, if there is one
+static void xfer_next(void)
+{
+    if(m_config_pending)
+    {
+        config_write();
+    }
+    else if(m_mode == MODE_STREAM && nrf_gpio_pin_read(ACC_INT1_PIN))
+    {
+        //the FIFO filled up to the watermark again while it was read, the level did not change
+        fifo_src_read();
+    }
+    else
+    {
+        m_xfer = XFER_IDLE;
+    }
+}
+
+
+static void spi_event_handler(nrf_drv_spi_evt_t const * p_event)
+{
+    switch(m_xfer)
+    {
+        case XFER_FIFO_SRC:
+        {
+            uint8_t src = m_rx[1];
+            uint8_t nr_of_samples = (src & FIFO_SRC_OVRN) ? LIS3DH_FIFO_SIZE : (src & FIFO_SRC_FSS_MASK);
+
+            if(nr_of_samples != 0 && !m_config_pending)
+            {
+                fifo_data_read(nr_of_samples);
+            }
+            else
+            {
+                xfer_next();
+            }
+        } break;
+
+        case XFER_FIFO_DATA:
+            fifo_data_store((p_event->data.done.rx_length - 1) / SAMPLE_SIZE);
+            xfer_next();
+            break;
+
+        case XFER_WRITE:
+            //a newer mode replaces the rest of the chain
+            if(m_config_pending)
+            {
+                xfer_next();
+            }
+            else if(++m_write_idx < m_nr_of_writes)
+            {
+                write_next();
+            }
+            else
+            {
+                config_done();
+                xfer_next();
+            }
+            break;
+
+        default:
+            spi_xfer_done = true;
+            m_xfer = XFER_IDLE;
+            break;
+    }
+}
+
+
+static void write_add(uint8_t reg, uint8_t value)
+{
+    m_writes[m_nr_of_writes][0] = reg;
+    m_writes[m_nr_of_writes][1] = value;
+    m_nr_of_writes++;
+}
+
+
+static uint8_t threshold(uint16_t mg)
+{
+    return MIN(mg / m_threshold_mg[m_config.range], 0x7F);
+}
+
+
+//write all registers of the mode, chained in the SPI interrupt
+static void config_write(void)
+{
+    m_config_pending = false;
+    m_write_idx = 0;
+    m_nr_of_writes = 0;
+
+    switch(m_mode)
+    {
+        case MODE_STREAM:
+            write_add(INT2_CFG, 0);
+            write_add(CLICK_CFG, 0);
+            write_add(CTRL_REG2, 0);
+            write_add(CTRL_REG6, 0);
+            write_add(CTRL_REG3, CTRL_REG3_I1_WTM);
+            //block data update so a sample is never half old, half new
+            write_add(CTRL_REG4, CTRL_REG4_BDU | CTRL_REG4_HR | (m_config.range << 4));
+            write_add(CTRL_REG5, CTRL_REG5_FIFO_EN);
+            //bypass mode empties the FIFO, stream mode keeps the newest 32 samples
+            write_add(FIFO_CTRL_REG, FIFO_CTRL_BYPASS);
+            write_add(FIFO_CTRL_REG, FIFO_CTRL_STREAM | m_config.watermark);
+            write_add(CTRL_REG1, (m_config.odr << 4) | CTRL_REG1_XYZ_EN);
+            break;
+
+        case MODE_WAKEUP:
+            //low power mode, no FIFO, movement above the threshold on INT2 and knocks on INT1, both
+            //high pass filtered so gravity does not count
+            write_add(CTRL_REG5, 0);
+            write_add(FIFO_CTRL_REG, FIFO_CTRL_BYPASS);
+            write_add(CTRL_REG4, CTRL_REG4_BDU | (m_config.range << 4));
+            write_add(CTRL_REG2, CTRL_REG2_HPCLICK | CTRL_REG2_HP_IA2);
+            write_add(INT2_THS, threshold(m_config.wakeup_threshold_mg));
+            write_add(INT2_DURATION, 0);
+            write_add(INT2_CFG, INT2_CFG_XYZ_HIGH);
+            write_add(CLICK_THS, threshold(m_config.click_threshold_mg));
+            write_add(TIME_LIMIT, MAX(CLICK_MAX_LENGTH_MS * m_odr_hz[m_config.wakeup_odr] / 1000, 1));
+            write_add(CLICK_CFG, CLICK_CFG_XYZ_SINGLE);
+            write_add(CTRL_REG3, CTRL_REG3_I1_CLICK);
+            write_add(CTRL_REG6, CTRL_REG6_I2_IA2);
+            write_add(CTRL_REG1, (m_config.wakeup_odr << 4) | CTRL_REG1_LPEN | CTRL_REG1_XYZ_EN);
+            //reading it resets the high pass filters to the current acceleration
+            write_add(REFERENCE | LIS3DH_READ, 0);
+            break;
+
+        default:
+            //power down
+            write_add(CTRL_REG1, 0);
+            break;
+    }
+
+    write_next();
+}
+
+
+//any mode may be asked for from any interrupt level, a running transfer is finished first
+static void mode_set(uint8_t mode)
+{
+    nrf_drv_gpiote_in_event_disable(ACC_INT1_PIN);
+    nrf_drv_gpiote_in_event_disable(ACC_INT2_PIN);
+    m_wakeup_armed = false;
+
+    CRITICAL_REGION_ENTER();
+    m_mode = mode;
+    if(m_xfer == XFER_IDLE)
+    {
+        config_write();
+    }
+    else
+    {
+        m_config_pending = true;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+
+static void fifo_src_read(void)
+{
+    m_xfer = XFER_FIFO_SRC;
+    spi_transfer(FIFO_SRC_REG | LIS3DH_READ, 2);
+}
+
+
+static void wakeup_report(lis3dh_wakeup_src_t src)
 {
-    spi_xfer_done = true;
+    //once per arming, the application changes the mode when it is woken up
+    if(m_wakeup_armed)
+    {
+        m_wakeup_armed = false;
+        if(m_config.wakeup_handler != NULL)
+        {
+            m_config.wakeup_handler(src);
+        }
+    }
+}
+
+
+static void int1_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+    if(m_mode == MODE_WAKEUP)
+    {
+        wakeup_report(LIS3DH_WAKEUP_CLICK);
+    }
+    //a burst is already running, it checks the pin again when it is done
+    else if(m_mode == MODE_STREAM && m_xfer == XFER_IDLE)
+    {
+        fifo_src_read();
+    }
+}
+
+
+static void int2_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+    if(m_mode == MODE_WAKEUP)
+    {
+        wakeup_report(LIS3DH_WAKEUP_MOTION);
+    }
 }
 
-void lis3dh_init(void)
+
+uint32_t lis3dh_init(lis3dh_config_t const * p_config)
 {
+    uint32_t err_code;
+    uint8_t who_am_i[2];
+
+    VERIFY_PARAM_NOT_NULL(p_config);
+    if(p_config->watermark == 0 || p_config->watermark >= LIS3DH_FIFO_SIZE ||
+       p_config->wakeup_odr < LIS3DH_ODR_1HZ || p_config->wakeup_odr > LIS3DH_ODR_400HZ)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    m_config = *p_config;
+
     nrf_drv_spi_config_t spi_config = NRF_DRV_SPI_DEFAULT_CONFIG;
     spi_config.ss_pin   = ACC_CS_PIN;
     spi_config.miso_pin = ACC_MISO_PIN;
     spi_config.mosi_pin = ACC_MOSI_PIN;
     spi_config.sck_pin  = ACC_SCK_PIN;
-    APP_ERROR_CHECK(nrf_drv_spi_init(&spi, &spi_config, spi_event_handler));
-    
-    //TODO: initialize int pins
+    spi_config.frequency = NRF_DRV_SPI_FREQ_8M;   //the LIS3DH takes up to 10 MHz, halves the burst time
+    err_code = nrf_drv_spi_init(&spi, &spi_config, spi_event_handler);
+    VERIFY_SUCCESS(err_code);
+
+    lis3dh_read(WHO_AM_I, who_am_i, sizeof(who_am_i));
+    if(who_am_i[1] != WHO_AM_I_VALUE)
+    {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    //INT1 and INT2 are push-pull and active high after reset
+    if(!nrf_drv_gpiote_is_init())
+    {
+        err_code = nrf_drv_gpiote_init();
+        VERIFY_SUCCESS(err_code);
+    }
+
+    nrf_drv_gpiote_in_config_t pin_config = GPIOTE_CONFIG_IN_SENSE_LOTOHI(false);
+    err_code = nrf_drv_gpiote_in_init(ACC_INT1_PIN, &pin_config, int1_handler);
+    VERIFY_SUCCESS(err_code);
+    err_code = nrf_drv_gpiote_in_init(ACC_INT2_PIN, &pin_config, int2_handler);
+    VERIFY_SUCCESS(err_code);
+
+    return NRF_SUCCESS;
 }
 
-void lis3dh_read(uint8_t addr, uint8_t *data, uint8_t size)
+
+uint32_t lis3dh_start(void)
 {
-    static uint8_t cmd_byte;
-    
-    if(size > 2)
+    if(m_mode == MODE_STREAM)
     {
-        //address is only 6 bits long 
-        cmd_byte = (addr & 0x3F) | 0xA0;
+        return NRF_SUCCESS;
     }
-    else
+
+    m_ring_tail = m_ring_head;
+    mode_set(MODE_STREAM);
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t lis3dh_wakeup_start(void)
+{
+    //also when already waiting, to arm it again
+    mode_set(MODE_WAKEUP);
+
+    return NRF_SUCCESS;
+}
+
+
+void lis3dh_stop(void)
+{
+    if(m_mode == MODE_OFF)
     {
-        cmd_byte = (addr & 0x3F) | 0x80;
+        return;
     }
-    
+
+    mode_set(MODE_OFF);
+}
+
+
+uint16_t lis3dh_samples_get(lis3dh_sample_t * p_samples, uint16_t max_samples)
+{
+    uint16_t count = 0;
+
+    while(count < max_samples && m_ring_tail != m_ring_head)
+    {
+        p_samples[count++] = m_ring[m_ring_tail & (LIS3DH_RING_SIZE - 1)];
+        m_ring_tail++;
+    }
+
+    return count;
+}
+
+
+uint32_t lis3dh_dropped_get(void)
+{
+    return m_dropped;
+}
+
+
+static void blocking_transfer(uint8_t const * p_tx, uint8_t tx_size, uint8_t * p_rx, uint8_t rx_size)
+{
+    m_xfer = XFER_BLOCKING;
     spi_xfer_done = false;
-    nrf_drv_spi_transfer(&spi, &cmd_byte, 1, data, size);
-    
+    APP_ERROR_CHECK(nrf_drv_spi_transfer(&spi, p_tx, tx_size, p_rx, rx_size));
+
     while (!spi_xfer_done)
     {
         __WFE();
     }
 }
+
+
+void lis3dh_read(uint8_t addr, uint8_t *data, uint8_t size)
+{
+    static uint8_t cmd_byte;
+
+    if(size > 2)
+    {
+        //address is only 6 bits long, bit 6 asks for auto increment
+        cmd_byte = (addr & LIS3DH_ADDR_MASK) | LIS3DH_READ | LIS3DH_AUTO_INCREMENT;
+    }
+    else
+    {
+        cmd_byte = (addr & LIS3DH_ADDR_MASK) | LIS3DH_READ;
+    }
+
+    blocking_transfer(&cmd_byte, 1, data, size);
+}
+
+
+void lis3dh_write(uint8_t addr, uint8_t value)
+{
+    static uint8_t tx[2];
+
+    tx[0] = addr & LIS3DH_ADDR_MASK;
+    tx[1] = value;
+
+    blocking_transfer(tx, sizeof(tx), NULL, 0);
+}
@@ -1,8 +1,90 @@
-
 #ifndef LIS3DH_H
 #define LIS3DH_H
 
-void lis3dh_init(void);
+#include <stdint.h>
+#include <stdbool.h>
+
+/* LIS3DH accelerometer on SPI. The samples are collected in the accelerometer's FIFO, its
+ * watermark interrupt on INT1 starts a burst read of the whole FIFO into a ring buffer without
+ * the CPU waiting for it, so there is one wakeup per watermark instead of one per sample.
+ *
+ * In wake-up mode the accelerometer runs in low power mode with nothing read out, its own click
+ * detection on INT1 and motion detection on INT2 wake the application up.
+ */
+
+#define LIS3DH_FIFO_SIZE        32
+#define LIS3DH_RING_SIZE        64      //samples, must be a power of 2
+
+//CTRL_REG1 output data rates, in all modes
+typedef enum
+{
+    LIS3DH_ODR_1HZ   = 1,
+    LIS3DH_ODR_10HZ  = 2,
+    LIS3DH_ODR_25HZ  = 3,
+    LIS3DH_ODR_50HZ  = 4,
+    LIS3DH_ODR_100HZ = 5,
+    LIS3DH_ODR_200HZ = 6,
+    LIS3DH_ODR_400HZ = 7,
+} lis3dh_odr_t;
+
+//CTRL_REG4 full scale
+typedef enum
+{
+    LIS3DH_RANGE_2G  = 0,
+    LIS3DH_RANGE_4G  = 1,
+    LIS3DH_RANGE_8G  = 2,
+    LIS3DH_RANGE_16G = 3,
+} lis3dh_range_t;
+
+//left justified, full scale is +-32768
+typedef struct
+{
+    int16_t x;
+    int16_t y;
+    int16_t z;
+} lis3dh_sample_t;
+
+typedef enum
+{
+    LIS3DH_WAKEUP_MOTION,
+    LIS3DH_WAKEUP_CLICK,
+} lis3dh_wakeup_src_t;
+
+//called from the SPI interrupt after new samples went into the ring buffer
+typedef void (*lis3dh_handler_t)(uint16_t nr_of_samples);
+
+//called from the GPIOTE interrupt, once per lis3dh_wakeup_start
+typedef void (*lis3dh_wakeup_handler_t)(lis3dh_wakeup_src_t src);
+
+typedef struct
+{
+    lis3dh_odr_t            odr;
+    lis3dh_range_t          range;
+    uint8_t                 watermark;              //samples in the FIFO before they are read, 1 to 31
+    lis3dh_handler_t        handler;                //may be NULL
+    lis3dh_odr_t            wakeup_odr;             //low power mode, 1 or 10 Hz take less current
+    uint16_t                wakeup_threshold_mg;    //movement that wakes up, without gravity
+    uint16_t                click_threshold_mg;     //knock that wakes up
+    lis3dh_wakeup_handler_t wakeup_handler;         //may be NULL
+} lis3dh_config_t;
+
+uint32_t lis3dh_init(lis3dh_config_t const * p_config);
+
+//blocking register access, only from the main loop and while the FIFO is not running
 void lis3dh_read(uint8_t addr, uint8_t *data, uint8_t size);
+void lis3dh_write(uint8_t addr, uint8_t value);
+
+//start and stop collecting samples, the register writes are done in the SPI interrupt
+uint32_t lis3dh_start(void);
+void lis3dh_stop(void);
+
+//stop collecting samples and wait for movement or a knock instead, lis3dh_start goes back
+uint32_t lis3dh_wakeup_start(void);
+
+//take up to max_samples from the ring buffer, returns how many were taken
+uint16_t lis3dh_samples_get(lis3dh_sample_t * p_samples, uint16_t max_samples);
+
+//samples lost because the ring buffer was full
+uint32_t lis3dh_dropped_get(void);
 
 #endif  //LIS3DH_H
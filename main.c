@@ -31,6 +31,7 @@
 #include "ble_conn_params.h"
 #include "softdevice_handler.h"
 #include "app_timer.h"
+#include "app_scheduler.h"
 #include "app_button.h"
 #include "ble_glass_light.h"
 #include "app_uart.h"
@@ -48,11 +49,20 @@
 #include "nrf_drv_ws2812.h"
 #include "pin_definitions.h"
 #include "lis3dh.h"
+#include "gesture.h"
+#include "light_animation.h"
+#include "light_sync.h"
+#include "fstorage.h"
+#include "preset_store.h"
+#include "perf_bench.h"
+#include "trace.h"
+#include "ble_bas.h"
+#include "battery.h"
 
 #define IS_SRVC_CHANGED_CHARACT_PRESENT 0                                           /**< Include the service_changed characteristic. If not enabled, the server's database cannot be changed for the lifetime of the device. */
 
 #if (NRF_SD_BLE_API_VERSION == 3)
-#define NRF_BLE_MAX_MTU_SIZE            GATT_MTU_SIZE_DEFAULT                       /**< MTU size used in the softdevice enabling and to reply to a BLE_GATTS_EVT_EXCHANGE_MTU_REQUEST event. */
+#define NRF_BLE_MAX_MTU_SIZE            BLE_GL_MAX_MTU_SIZE                         /**< MTU size used in the softdevice enabling and to reply to a BLE_GATTS_EVT_EXCHANGE_MTU_REQUEST event. */
 #endif
 
 #define APP_FEATURE_NOT_SUPPORTED       BLE_GATT_STATUS_ATTERR_APP_BEGIN + 2        /**< Reply when unsupported features are requested. */
@@ -65,9 +75,11 @@
 
 #define APP_ADV_INTERVAL                320                                          /**< The advertising interval (in units of 0.625 ms. This value corresponds to 40 ms). */
 #define APP_ADV_TIMEOUT_IN_SECONDS      180                                         /**< The advertising timeout (in units of seconds). */
+#define APP_ADV_SLOW_INTERVAL           MSEC_TO_UNITS(2000, UNIT_0_625_MS)          /**< Advertising interval after the fast advertising timed out and while asleep (2 s). */
+#define APP_ADV_SLOW_TIMEOUT_IN_SECONDS 0                                           /**< Slow advertising goes on until a connection. */
 
 #define APP_TIMER_PRESCALER             0                                           /**< Value of the RTC1 PRESCALER register. */
-#define APP_TIMER_OP_QUEUE_SIZE         4                                           /**< Size of timer operation queues. */
+#define APP_TIMER_OP_QUEUE_SIZE         8                                           /**< Size of timer operation queues. */
 
 #define MIN_CONN_INTERVAL               MSEC_TO_UNITS(20, UNIT_1_25_MS)             /**< Minimum acceptable connection interval (20 ms), Connection interval uses 1.25 ms units. */
 #define MAX_CONN_INTERVAL               MSEC_TO_UNITS(75, UNIT_1_25_MS)             /**< Maximum acceptable connection interval (75 ms), Connection interval uses 1.25 ms units. */
@@ -77,6 +89,13 @@
 #define NEXT_CONN_PARAMS_UPDATE_DELAY   APP_TIMER_TICKS(30000, APP_TIMER_PRESCALER) /**< Time between each call to sd_ble_gap_conn_param_update after the first call (30 seconds). */
 #define MAX_CONN_PARAMS_UPDATE_COUNT    3                                           /**< Number of attempts before giving up the connection parameter negotiation. */
 
+#define STREAM_MIN_CONN_INTERVAL        MSEC_TO_UNITS(7.5, UNIT_1_25_MS)            /**< Minimum connection interval while colors are streamed (7.5 ms). */
+#define STREAM_MAX_CONN_INTERVAL        MSEC_TO_UNITS(15, UNIT_1_25_MS)             /**< Maximum connection interval while colors are streamed (15 ms). */
+#define STREAM_IDLE_TIMEOUT             APP_TIMER_TICKS(2000, APP_TIMER_PRESCALER)  /**< Time without stream packets after which the relaxed connection interval is requested again. */
+
+#define SCHED_MAX_EVENT_DATA_SIZE       sizeof(uint32_t)                            /**< Largest event data posted to the scheduler. */
+#define SCHED_QUEUE_SIZE                8                                           /**< Events waiting for the main loop, most are posted only once until handled. */
+
 #define DEAD_BEEF                       0xDEADBEEF                                  /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
 
 #define UART_TX_BUF_SIZE                256                                         /**< UART TX buffer size. */
@@ -92,12 +111,45 @@ APP_TIMER_DEF(m_charge_led_pulse_timer_id);
 #define CHARGING_TIMER_INTERVAL			APP_TIMER_TICKS(1000, APP_TIMER_PRESCALER)
 #define CHARGING_LED_PULSE_LENGTH		APP_TIMER_TICKS(50, APP_TIMER_PRESCALER)
 
-APP_TIMER_DEF(m_fade_timer_id);
-#define FADE_TIMER_INTERVAL             APP_TIMER_TICKS(4000/256, APP_TIMER_PRESCALER)
+#if defined(BOARD_CUSTOM) && defined(BATTERY_AIN)
+#define BATTERY_GAUGE_ENABLED           1                                           /**< The board wires the cell to the SAADC, see pin_definitions.h. */
+#else
+#define BATTERY_GAUGE_ENABLED           0
+#endif
+#define BATTERY_SAMPLE_INTERVAL         APP_TIMER_TICKS(60000, APP_TIMER_PRESCALER) /**< Time between two battery conversions, the charge changes slowly. */
+#define BATTERY_FULL_POWER_MV           3700                                        /**< Full brightness is allowed above this voltage. */
+#define BATTERY_LOW_POWER_MV            3400                                        /**< The brightness cap is down to BATTERY_LOW_BRIGHTNESS at this voltage. */
+#define BATTERY_LOW_BRIGHTNESS          64                                          /**< Brightness cap of an almost empty cell, full white at 255 would brown it out. */
+
+static uint8_t                          m_brightness = 0xFF;                        /**< Brightness set by the user, the LEDs get less when the battery is low. */
+static uint8_t                          m_brightness_cap = 0xFF;                    /**< Highest brightness the battery allows, full until a reading says otherwise. */
+#if BATTERY_GAUGE_ENABLED
+static ble_bas_t                        m_bas;                                      /**< Structure used to identify the battery service. */
+static uint8_t                          m_battery_level;                            /**< Last state of charge in the battery service. */
+#endif
+
+#define ACC_ODR                         LIS3DH_ODR_100HZ                            /**< Accelerometer sample rate, fast enough to catch the knock of clinking glasses. */
+#define ACC_SAMPLE_RATE_HZ              100
+#define ACC_RANGE                       LIS3DH_RANGE_4G                             /**< Accelerometer full scale. */
+#define ACC_COUNTS_PER_G                (32768 / 4)                                 /**< Sample value of 1 g at +-4 g. */
+#define ACC_WATERMARK                   25                                          /**< Samples read in one burst, 0.25 s at 100 Hz. */
+#define ACC_WAKEUP_ODR                  LIS3DH_ODR_50HZ                             /**< Sample rate while asleep, low power mode, still fast enough for the click detection. */
+#define ACC_WAKEUP_THRESHOLD_MG         100                                         /**< Movement that wakes the glass up, picking it up is well above. */
+#define ACC_CLICK_THRESHOLD_MG          500                                         /**< Knock that wakes the glass up. */
+
+#define POWER_SLEEP_TIMEOUT             APP_TIMER_TICKS(300000, APP_TIMER_PRESCALER) /**< Time standing still, without a connection or a leader to follow, before the glass goes to sleep (5 minutes). */
+
+#define GESTURE_FLASH_FADE_MS           400                                         /**< Fade back after the flash of a clink. */
+#define GESTURE_RESTORE_FADE_MS         500                                         /**< Fade back to the color from before a gesture effect. */
+#define GESTURE_SHAKE_ANIMATION         1                                           /**< Built-in animations started by gestures. */
+#define GESTURE_POUR_ANIMATION          3
+
+#define FADE_TIMER_INTERVAL_MS          (4000/256)                                  /**< Time between two frames of an animation. */
 
-nrf_drv_WS2812_pixel_t fader_setpoint_1;
-nrf_drv_WS2812_pixel_t fader_setpoint_2;
-nrf_drv_WS2812_pixel_t fader_current_value;
+APP_TIMER_DEF(m_stream_idle_timer_id);
+static bool                             m_stream_fast;                              /**< The streaming connection parameters are in use or requested. */
+static bool                             m_stream_active;                            /**< A stream packet came in since the idle timer last expired. */
+static bool                             m_stream_refused;                           /**< The central did not accept the streaming connection parameters on this connection. */
 
 //TODO: change these to defines
 nrf_drv_WS2812_pixel_t color_red =    {.red = 255};
@@ -109,9 +161,101 @@ nrf_drv_WS2812_pixel_t color_purple = {.red = 255, .blue = 255};
 nrf_drv_WS2812_pixel_t color_white =  {.red = 255, .green = 255, .blue = 255};
 nrf_drv_WS2812_pixel_t color_off;
 
+#define NR_OF_PIXELS                    6                                           /**< Number of WS2812 LEDs on the glass. */
+#define LEDS_CURRENT_LIMIT_MA           250                                         /**< Brighter frames are dimmed to it, full white on all LEDs would draw about 370 mA from the cell and the charger. */
+
+NRF_DRV_WS2812_DEF(m_leds, 0, NR_OF_PIXELS);
+
 #define BEACON_ADV_INTERVAL      760
 #define BEACON_URL               "\x03goo.gl/rX4mVo" /**< https://goo.gl/pIWdir short for https://developer.nordicsemi.com/thingy/52/ */
 #define BEACON_URL_LEN           14
+#define BEACON_UID_NAMESPACE     "\x67\x6c\x61\x73\x73\x5f\x6c\x69\x67\x68" /**< Any 10 bytes only our glasses use, here "glass_ligh". */
+#define BEACON_URL_RATIO         4                                                  /**< The URL frame is sent most, phones show it. */
+#define BEACON_UID_RATIO         1
+#define BEACON_TLM_RATIO         1
+#define BEACON_TLM_INTERVAL      APP_TIMER_TICKS(10000, APP_TIMER_PRESCALER)       /**< Time between two updates of the TLM frame. */
+
+APP_TIMER_DEF(m_beacon_tlm_timer_id);
+
+#define SYNC_GROUP                      0                                           /**< Glasses only follow a leader of their own group. */
+#define SYNC_BEACON_INTERVAL            100                                         /**< Beacon interval while leading, in ms, so followers hear changes quickly. */
+#define SYNC_FRAME_RATIO                6                                           /**< Half of the beacon frames carry the state while leading. */
+#define SYNC_REFRESH_INTERVAL           APP_TIMER_TICKS(50, APP_TIMER_PRESCALER)    /**< Time between two updates of the broadcast state. */
+#define SYNC_MAX_DRIFT_MS               100                                         /**< Followers jump to the time of the leader when they are further off. */
+
+APP_TIMER_DEF(m_sync_refresh_timer_id);
+static bool                             m_sync_on_air;                              /**< The state frame is in the beacon schedule. */
+static uint8_t                          m_animation_id = LIGHT_SYNC_ANIMATION_NONE; /**< What is on the LEDs, as told to followers. */
+
+static bool                             m_gesture_effect;                           /**< A gesture replaced what was on the LEDs. */
+static uint8_t                          m_rest_animation_id;                        /**< What was on the LEDs before it. */
+static nrf_drv_WS2812_pixel_t           m_rest_color;
+
+APP_TIMER_DEF(m_sleep_timer_id);
+static bool                             m_asleep;                                   /**< Radio, LEDs and accelerometer stream are off until the glass is moved. */
+static bool                             m_moving;                                   /**< Moved and not set down again. */
+static bool                             m_sync_heard;                               /**< A leader was followed since the sleep timer last expired. */
+static uint8_t                          m_sleep_animation_id;                       /**< What was on the LEDs when the glass went to sleep. */
+static nrf_drv_WS2812_pixel_t           m_sleep_color;
+
+#define SCENE_SAVE_DELAY                APP_TIMER_TICKS(5000, APP_TIMER_PRESCALER)  /**< Time the LEDs keep a state before it is stored, a color picker changes it many times a second. */
+#define SCENE_MAX_LEN                   (1 + MAX(LIGHT_ANIMATION_MAX_ENCODED_SIZE, NR_OF_PIXELS * 3)) /**< Animation id, then the encoded animation or the color of every pixel. */
+#define PRESET_MAX_LEN                  (BLE_GL_CMD_PRESET_NAME_LEN + SCENE_MAX_LEN) /**< Name, then the scene. */
+
+STATIC_ASSERT(PRESET_MAX_LEN <= PRESET_STORE_MAX_LENGTH);
+
+#define PERF_BENCH_ITERATIONS           64                                          /**< Frames per measurement of the render path benchmark, see perf_bench.h. */
+
+APP_TIMER_DEF(m_scene_save_timer_id);
+static bool                             m_scene_save_pending;                       /**< The scene save timer is running. */
+static bool                             m_scene_changed;                            /**< Changed again while it was running. */
+static uint8_t                          m_custom_animation[LIGHT_ANIMATION_MAX_ENCODED_SIZE]; /**< The custom animation on the LEDs as it was written, to store it. */
+static uint8_t                          m_custom_animation_length;
+
+/**@brief Built-in animations, started by writing their number (1 and up) to the animation
+ *        characteristic. Followers run them on their own and only need the time.
+ */
+static const light_animation_t m_builtin_animations[] =
+{
+    {   //rainbow
+        .keyframes =
+        {
+            {.color = {.red = 255},   .duration_ms = 2000, .interpolation = LIGHT_ANIMATION_HUE},
+            {.color = {.green = 255}, .duration_ms = 2000, .interpolation = LIGHT_ANIMATION_HUE},
+            {.color = {.blue = 255},  .duration_ms = 2000, .interpolation = LIGHT_ANIMATION_HUE},
+        },
+        .nr_of_keyframes = 3,
+        .repeat          = LIGHT_ANIMATION_REPEAT_FOREVER,
+    },
+    {   //breathing
+        .keyframes =
+        {
+            {.color = {.red = 255, .green = 255, .blue = 255}, .duration_ms = 1500, .interpolation = LIGHT_ANIMATION_EASE},
+            {.color = {0},                                     .duration_ms = 1500, .interpolation = LIGHT_ANIMATION_EASE},
+        },
+        .nr_of_keyframes = 2,
+        .repeat          = LIGHT_ANIMATION_REPEAT_FOREVER,
+    },
+    {   //chase
+        .keyframes =
+        {
+            {.color = {.blue = 255}, .duration_ms = 150, .interpolation = LIGHT_ANIMATION_LINEAR},
+            {.color = {0},           .duration_ms = 300, .interpolation = LIGHT_ANIMATION_LINEAR},
+            {.color = {0},           .duration_ms = 450, .interpolation = LIGHT_ANIMATION_STEP},
+        },
+        .nr_of_keyframes = 3,
+        .repeat          = LIGHT_ANIMATION_REPEAT_FOREVER,
+        .pixel_delay_ms  = 150,
+    },
+};
+
+#define NR_OF_BUILTIN_ANIMATIONS        (sizeof(m_builtin_animations) / sizeof(m_builtin_animations[0]))
+
+static volatile bool                    m_leds_show_pending;                        /**< A frame is waiting for the main loop to be shown. */
+static volatile bool                    m_acc_pending;                              /**< Accelerometer samples are waiting for the main loop. */
+static volatile bool                    m_charge_pending;                           /**< The charge status pin changed, the main loop has not read it yet. */
+static uint32_t                         m_charge_pin;                               /**< Pin of the STAT output of the charger. */
+static trace_reader_t                   m_trace_ble_reader;                         /**< Trace records notified so far. */
 
 /**@brief Function for assert macro callback.
  *
@@ -130,6 +274,84 @@ void assert_nrf_callback(uint16_t line_num, const uint8_t * p_file_name)
 }
 
 
+/**@brief Function for showing the pixels set since the last frame, from the main loop.
+ */
+static void leds_show_evt_handler(void * p_event_data, uint16_t event_size)
+{
+    #if TRACE_ENABLED
+        bool busy = nrf_drv_WS2812_is_busy(&m_leds);
+    #endif
+    
+    m_leds_show_pending = false;
+    nrf_drv_WS2812_show(&m_leds);
+    #if TRACE_ENABLED
+        TRACE(TRACE_EVT_FRAME_ENCODED, busy);
+        if(!busy && nrf_drv_WS2812_is_busy(&m_leds))
+        {
+            TRACE(TRACE_EVT_PWM_START, 0);
+        }
+    #endif
+    #if PERF_BENCH_ENABLED
+        perf_bench_show_mark();
+    #endif
+}
+
+
+/**@brief Function for showing the pixels once the main loop gets to it.
+ *
+ * @details Encoding a frame takes long, the handlers setting pixels in interrupts only post it.
+ *          Every change until then goes into the same frame.
+ */
+static void leds_show(void)
+{
+    uint32_t err_code;
+    
+    if(m_leds_show_pending)
+    {
+        return;
+    }
+    m_leds_show_pending = true;
+    
+    err_code = app_sched_event_put(NULL, 0, leds_show_evt_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+
+#if defined(BOARD_CUSTOM)
+/**@brief Function for setting the brightness the user wants, as far as the battery allows it.
+ *
+ * @details Sent with the next frame.
+ */
+static void brightness_set(uint8_t brightness)
+{
+    m_brightness = brightness;
+    nrf_drv_WS2812_set_brightness(&m_leds, MIN(m_brightness, m_brightness_cap));
+}
+
+
+/**@brief Function for storing the scene once the LEDs keep it for a while.
+ *
+ * @details Only for what a phone puts on the LEDs, not for gestures, leaders or sleep. The timer
+ *          is not restarted on every change, a stream would fill its queue, it runs once more
+ *          when the scene changed in the meantime.
+ */
+static void scene_save_request(void)
+{
+    uint32_t err_code;
+    
+    if(m_scene_save_pending)
+    {
+        m_scene_changed = true;
+        return;
+    }
+    m_scene_save_pending = true;
+    
+    err_code = app_timer_start(m_scene_save_timer_id, SCENE_SAVE_DELAY, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+#endif
+
+
 /**@brief Function for the GAP initialization.
  *
  * @details This function will set up all the necessary GAP (Generic Access Profile) parameters of
@@ -159,47 +381,6 @@ static void gap_params_init(void)
     APP_ERROR_CHECK(err_code);
 }
 
-void ws2812b_set_color(char str[])
-{
-	nrf_drv_WS2812_pixel_t color;
-    memset(&color, 0, sizeof(nrf_drv_WS2812_pixel_t));
-	
-	if(strncmp("red", str, 3) == 0)
-	{
-        color = color_red;
-	}
-	else if(strncmp("yellow", str, 6) == 0)
-	{
-		color = color_yellow;
-	}
-	else if(strncmp("green", str, 5) == 0)
-	{
-		color = color_green;
-	}
-	else if(strncmp("cyan", str, 4) == 0)
-	{
-		color = color_cyan;
-	}
-	else if(strncmp("blue", str, 4) == 0)
-	{
-		color = color_blue;
-	}
-	else if(strncmp("purple", str, 6) == 0)
-	{
-		color = color_purple;
-	}
-	else if(strncmp("white", str, 5) == 0)
-	{
-		color = color_white;
-	}
-	
-	for(uint8_t i = 0; i < NR_OF_PIXELS; i++)
-	{
-		nrf_drv_WS2812_set_pixel(i, &color);
-	}
-	nrf_drv_WS2812_show();
-}
-
 /**@brief Function for handling the data from the Nordic UART Service.
  *
  * @details This function will process the data received from the Nordic UART BLE Service and send
@@ -212,12 +393,17 @@ void ws2812b_set_color(char str[])
 /**@snippet [Handling the data received over BLE] */
 static void nus_data_handler(ble_nus_t * p_nus, nrf_drv_WS2812_pixel_t *p_color)
 {
+    m_animation_id = LIGHT_SYNC_ANIMATION_NONE;
+    m_gesture_effect = false;
+    
     #if defined(BOARD_CUSTOM)
+        light_animation_stop();
         for(uint8_t i = 0; i < NR_OF_PIXELS; i++)
         {
-            nrf_drv_WS2812_set_pixel(i, p_color);
+            nrf_drv_WS2812_set_pixel(&m_leds, i, p_color);
         }
-        nrf_drv_WS2812_show();
+        leds_show();
+        scene_save_request();
     #elif defined(BOARD_PCA10040)
         if(p_color->red)
             nrf_gpio_pin_clear(17);
@@ -236,9 +422,806 @@ static void nus_data_handler(ble_nus_t * p_nus, nrf_drv_WS2812_pixel_t *p_color)
     #endif
         
         
-    
+    
+}
+/**@snippet [Handling the data received over BLE] */
+
+/**@brief Function for starting one of the built-in animations.
+ *
+ * @param[in] animation_id  Number of the animation, 1 and up.
+ */
+static void builtin_animation_start(uint8_t animation_id)
+{
+    #if defined(BOARD_CUSTOM)
+        uint32_t err_code = light_animation_start(&m_builtin_animations[animation_id - 1]);
+        APP_ERROR_CHECK(err_code);
+    #endif
+    m_animation_id = animation_id;
+}
+
+/**@brief Function for starting an animation written to the Glass Light Service.
+ *
+ * @details A single byte selects a built-in animation, anything longer is an encoded one.
+ *
+ * @param[in] p_nus    Glass Light Service structure.
+ * @param[in] p_data   Encoded animation.
+ * @param[in] length   Length of the encoded animation.
+ */
+static void animation_data_handler(ble_nus_t * p_nus, uint8_t const * p_data, uint16_t length)
+{
+    m_gesture_effect = false;
+    
+    if(length == 1)
+    {
+        if(p_data[0] >= 1 && p_data[0] <= NR_OF_BUILTIN_ANIMATIONS)
+        {
+            builtin_animation_start(p_data[0]);
+            #if defined(BOARD_CUSTOM)
+                scene_save_request();
+            #endif
+        }
+        return;
+    }
+    
+    #if defined(BOARD_CUSTOM)
+        light_animation_t animation;
+        
+        if(light_animation_decode(&animation, p_data, length) == NRF_SUCCESS)
+        {
+            uint32_t err_code = light_animation_start(&animation);
+            APP_ERROR_CHECK(err_code);
+            m_animation_id = LIGHT_SYNC_ANIMATION_CUSTOM;
+            
+            // A decoded animation is never longer than the largest encoded one.
+            memcpy(m_custom_animation, p_data, length);
+            m_custom_animation_length = length;
+            scene_save_request();
+        }
+    #endif
+}
+
+/**@brief Function for switching between the relaxed and the streaming connection parameters.
+ *
+ * @details The connection parameters module negotiates them with the central. If it is still busy
+ *          with an earlier request the switch is tried again on the next stream packet or idle
+ *          timeout.
+ *
+ * @param[in] fast  Request the short streaming connection interval.
+ */
+static void conn_params_stream_set(bool fast)
+{
+    uint32_t              err_code;
+    ble_gap_conn_params_t conn_params;
+
+    conn_params.min_conn_interval = fast ? STREAM_MIN_CONN_INTERVAL : MIN_CONN_INTERVAL;
+    conn_params.max_conn_interval = fast ? STREAM_MAX_CONN_INTERVAL : MAX_CONN_INTERVAL;
+    conn_params.slave_latency     = SLAVE_LATENCY;
+    conn_params.conn_sup_timeout  = CONN_SUP_TIMEOUT;
+
+    err_code = ble_conn_params_change_conn_params(&conn_params);
+    if (err_code == NRF_SUCCESS)
+    {
+        m_stream_fast = fast;
+    }
+    else if (err_code != NRF_ERROR_BUSY && err_code != NRF_ERROR_INVALID_STATE)
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+/**@brief Function for going back to the relaxed connection parameters once streaming stops.
+ */
+static void stream_idle_timer_handler(void * p_context)
+{
+    uint32_t err_code;
+    
+    if (!m_stream_active)
+    {
+        conn_params_stream_set(false);
+        if (!m_stream_fast)
+        {
+            err_code = app_timer_stop(m_stream_idle_timer_id);
+            APP_ERROR_CHECK(err_code);
+        }
+    }
+    m_stream_active = false;
+}
+
+/**@brief Function for showing the pixels streamed to the Glass Light Service.
+ *
+ * @param[in] p_nus    Glass Light Service structure.
+ * @param[in] p_evt    Stream packet.
+ */
+static void stream_data_handler(ble_nus_t * p_nus, ble_gl_stream_evt_t const * p_evt)
+{
+    uint32_t err_code;
+    
+    if(p_evt->lost != 0)
+    {
+        NRF_LOG_DEBUG("Stream: %d packets lost before %d\r\n", p_evt->lost, p_evt->seq);
+    }
+    
+    m_stream_active = true;
+    m_animation_id = LIGHT_SYNC_ANIMATION_NONE;
+    m_gesture_effect = false;
+    if(!m_stream_fast && !m_stream_refused)
+    {
+        conn_params_stream_set(true);
+        if(m_stream_fast)
+        {
+            err_code = app_timer_start(m_stream_idle_timer_id, STREAM_IDLE_TIMEOUT, NULL);
+            APP_ERROR_CHECK(err_code);
+        }
+    }
+    
+    #if defined(BOARD_CUSTOM)
+        light_animation_stop();
+        for(uint16_t i = 0; i < p_evt->nr_of_pixels && p_evt->first_pixel + i < NR_OF_PIXELS; i++)
+        {
+            nrf_drv_WS2812_pixel_t color = p_evt->p_pixels[i];
+            nrf_drv_WS2812_set_pixel(&m_leds, p_evt->first_pixel + i, &color);
+        }
+        if(p_evt->show)
+        {
+            leds_show();
+        }
+        scene_save_request();
+    #endif
+}
+
+/**@brief Function for reading the color of the first pixel, the one told to followers too.
+ */
+static void first_pixel_get(nrf_drv_WS2812_pixel_t * p_color)
+{
+    nrf_drv_WS2812_pixel16_t color;
+    
+    nrf_drv_WS2812_get_pixel16(&m_leds, 0, &color);
+    p_color->red   = color.red >> 8;
+    p_color->green = color.green >> 8;
+    p_color->blue  = color.blue >> 8;
+}
+
+/**@brief Function for putting the light state into the beacon while connected.
+ */
+static void sync_refresh_timer_handler(void * p_context)
+{
+    uint32_t           err_code;
+    light_sync_state_t state;
+    
+    memset(&state, 0, sizeof(state));
+    first_pixel_get(&state.color);
+    state.animation_id = m_animation_id;
+    state.time_ms      = light_animation_is_running() ? light_animation_time_get() : 0;
+    
+    // Busy means the previous state is still on air, the next refresh brings the new one.
+    err_code = light_sync_broadcast(&state);
+    if(err_code == NRF_ERROR_BUSY)
+    {
+        return;
+    }
+    APP_ERROR_CHECK(err_code);
+    
+    // The frame can only be scheduled once it has a state in it.
+    if(!m_sync_on_air)
+    {
+        err_code = app_beacon_frame_ratio_set(APP_BEACON_FRAME_RAW, SYNC_FRAME_RATIO);
+        APP_ERROR_CHECK(err_code);
+        m_sync_on_air = true;
+    }
+}
+
+/**@brief Function for following the state broadcast by the connected glass of the group.
+ *
+ * @details Built-in animations run here too and are only kept in time, anything else is
+ *          mirrored as the color of the first pixel of the leader.
+ */
+static void sync_state_handler(light_sync_state_t const * p_state)
+{
+    #if defined(BOARD_CUSTOM)
+        static nrf_drv_WS2812_pixel_t last_color;
+        
+        m_sync_heard = true;
+        
+        if(p_state->animation_id >= 1 && p_state->animation_id <= NR_OF_BUILTIN_ANIMATIONS)
+        {
+            int32_t drift;
+            
+            if(m_animation_id != p_state->animation_id || !light_animation_is_running())
+            {
+                builtin_animation_start(p_state->animation_id);
+            }
+            
+            drift = (int32_t)(light_animation_time_get() - p_state->time_ms);
+            if(drift > SYNC_MAX_DRIFT_MS || drift < -SYNC_MAX_DRIFT_MS)
+            {
+                light_animation_time_set(p_state->time_ms);
+            }
+            return;
+        }
+        
+        if(m_animation_id == LIGHT_SYNC_ANIMATION_NONE &&
+           memcmp(&last_color, &p_state->color, sizeof(last_color)) == 0)
+        {
+            return;
+        }
+        
+        light_animation_stop();
+        m_animation_id = LIGHT_SYNC_ANIMATION_NONE;
+        last_color = p_state->color;
+        for(uint8_t i = 0; i < NR_OF_PIXELS; i++)
+        {
+            nrf_drv_WS2812_set_pixel(&m_leds, i, &last_color);
+        }
+        leds_show();
+    #endif
+}
+
+/**@brief Function for initializing the light sync between glasses.
+ */
+static void sync_init(void)
+{
+    uint32_t                err_code;
+    light_sync_init_t const sync_init =
+    {
+        .group   = SYNC_GROUP,
+        .handler = sync_state_handler
+    };
+    
+    err_code = light_sync_init(&sync_init);
+    APP_ERROR_CHECK(err_code);
+    
+    err_code = app_timer_create(&m_sync_refresh_timer_id, APP_TIMER_MODE_REPEATED, sync_refresh_timer_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+#if defined(BOARD_CUSTOM)
+/**@brief Function for putting a light state back on the LEDs.
+ *
+ * @details Built-in animations are started again, anything else fades to the color it had.
+ */
+static void light_state_restore(uint8_t animation_id, nrf_drv_WS2812_pixel_t const * p_color)
+{
+    uint32_t          err_code;
+    light_animation_t fade;
+    
+    if(animation_id >= 1 && animation_id <= NR_OF_BUILTIN_ANIMATIONS)
+    {
+        builtin_animation_start(animation_id);
+        return;
+    }
+    
+    memset(&fade, 0, sizeof(fade));
+    fade.keyframes[0].color         = *p_color;
+    fade.keyframes[0].duration_ms   = GESTURE_RESTORE_FADE_MS;
+    fade.keyframes[0].interpolation = LIGHT_ANIMATION_EASE;
+    fade.nr_of_keyframes            = 1;
+    
+    err_code = light_animation_start(&fade);
+    APP_ERROR_CHECK(err_code);
+    m_animation_id = LIGHT_SYNC_ANIMATION_NONE;
+}
+
+/**@brief Function for restarting advertising in another mode, unless a phone is connected.
+ */
+static void advertising_restart(ble_adv_mode_t mode)
+{
+    uint32_t err_code;
+    
+    if(m_conn_handle != BLE_CONN_HANDLE_INVALID)
+    {
+        return;
+    }
+    
+    // Not advertising right now is fine, it is started again below.
+    err_code = sd_ble_gap_adv_stop();
+    if(err_code != NRF_ERROR_INVALID_STATE)
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+    
+    // A phone connecting at the same time takes the only link, advertising is restarted on disconnect.
+    err_code = ble_advertising_start(mode);
+    if(err_code != NRF_ERROR_CONN_COUNT)
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+/**@brief Function for counting the time to sleep from now on.
+ */
+static void sleep_timer_restart(void)
+{
+    uint32_t err_code;
+    
+    err_code = app_timer_stop(m_sleep_timer_id);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_start(m_sleep_timer_id, POWER_SLEEP_TIMEOUT, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Function for putting the glass to sleep.
+ *
+ * @details The LEDs, the beacon and the scanning for a leader are turned off, advertising slows
+ *          down to stay connectable and the accelerometer only watches for movement in its low
+ *          power mode, a few uA.
+ */
+static void sleep_enter(void)
+{
+    uint32_t err_code;
+    
+    if(m_asleep)
+    {
+        return;
+    }
+    m_asleep = true;
+    NRF_LOG_INFO("sleep\r\n");
+    
+    if(m_gesture_effect)
+    {
+        m_gesture_effect     = false;
+        m_sleep_animation_id = m_rest_animation_id;
+        m_sleep_color        = m_rest_color;
+    }
+    else
+    {
+        m_sleep_animation_id = m_animation_id;
+        first_pixel_get(&m_sleep_color);
+    }
+    
+    m_animation_id = LIGHT_SYNC_ANIMATION_NONE;
+    light_animation_stop();
+    for(uint8_t i = 0; i < NR_OF_PIXELS; i++)
+    {
+        nrf_drv_WS2812_set_pixel(&m_leds, i, &color_off);
+    }
+    leds_show();
+    
+    app_beacon_stop();
+    err_code = light_sync_follow_stop();
+    APP_ERROR_CHECK(err_code);
+    advertising_restart(BLE_ADV_MODE_SLOW);
+    
+    err_code = lis3dh_wakeup_start();
+    APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Function for waking the glass up, everything goes back to how it was before sleep.
+ */
+static void power_wake(void)
+{
+    uint32_t err_code;
+    
+    if(!m_asleep)
+    {
+        return;
+    }
+    m_asleep = false;
+    NRF_LOG_INFO("wake\r\n");
+    
+    err_code = lis3dh_start();
+    APP_ERROR_CHECK(err_code);
+    
+    app_beacon_start();
+    err_code = light_sync_follow_start();
+    APP_ERROR_CHECK(err_code);
+    advertising_restart(BLE_ADV_MODE_FAST);
+    
+    light_state_restore(m_sleep_animation_id, &m_sleep_color);
+    sleep_timer_restart();
+}
+
+/**@brief Function for going to sleep once the glass stood still long enough.
+ *
+ * @details Not while a phone is connected or the glass is moving, the timer is started again on
+ *          disconnect and when it is set down. Following a leader keeps it awake as well.
+ */
+static void sleep_timer_handler(void * p_context)
+{
+    if(m_conn_handle != BLE_CONN_HANDLE_INVALID || m_moving)
+    {
+        return;
+    }
+    
+    if(m_sync_heard)
+    {
+        m_sync_heard = false;
+        sleep_timer_restart();
+        return;
+    }
+    
+    sleep_enter();
+}
+
+/**@brief Function for waking up from the main loop.
+ */
+static void power_wake_evt_handler(void * p_event_data, uint16_t event_size)
+{
+    power_wake();
+}
+
+/**@brief Function for waking up on movement or a knock, from the accelerometer.
+ */
+static void accelerometer_wakeup_handler(lis3dh_wakeup_src_t src)
+{
+    uint32_t err_code = app_sched_event_put(NULL, 0, power_wake_evt_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Function for encoding what is on the LEDs, to store it.
+ *
+ * @details The animation id, followed by the encoded animation for a custom one or by the color of
+ *          every pixel for none. During a gesture effect or sleep it is what comes back after it.
+ *
+ * @return Length of the scene.
+ */
+static uint8_t scene_encode(uint8_t * p_scene)
+{
+    uint8_t                animation_id = m_animation_id;
+    bool                   resting      = m_gesture_effect || m_asleep;
+    nrf_drv_WS2812_pixel_t rest_color;
+    
+    if(m_gesture_effect)
+    {
+        animation_id = m_rest_animation_id;
+        rest_color   = m_rest_color;
+    }
+    else if(m_asleep)
+    {
+        animation_id = m_sleep_animation_id;
+        rest_color   = m_sleep_color;
+    }
+    
+    // Only its color is left of a custom animation after a gesture or sleep.
+    if(resting && animation_id == LIGHT_SYNC_ANIMATION_CUSTOM)
+    {
+        animation_id = LIGHT_SYNC_ANIMATION_NONE;
+    }
+    
+    p_scene[0] = animation_id;
+    if(animation_id == LIGHT_SYNC_ANIMATION_CUSTOM)
+    {
+        memcpy(&p_scene[1], m_custom_animation, m_custom_animation_length);
+        return 1 + m_custom_animation_length;
+    }
+    if(animation_id != LIGHT_SYNC_ANIMATION_NONE)
+    {
+        return 1;
+    }
+    
+    for(uint8_t i = 0; i < NR_OF_PIXELS; i++)
+    {
+        if(!resting)
+        {
+            nrf_drv_WS2812_pixel16_t color;
+            
+            nrf_drv_WS2812_get_pixel16(&m_leds, i, &color);
+            rest_color.red   = color.red >> 8;
+            rest_color.green = color.green >> 8;
+            rest_color.blue  = color.blue >> 8;
+        }
+        p_scene[1 + 3 * i]     = rest_color.red;
+        p_scene[1 + 3 * i + 1] = rest_color.green;
+        p_scene[1 + 3 * i + 2] = rest_color.blue;
+    }
+    return 1 + 3 * NR_OF_PIXELS;
+}
+
+/**@brief Function for putting a stored scene on the LEDs.
+ *
+ * @return false if the scene is not understood, the LEDs are left alone then.
+ */
+static bool scene_apply(uint8_t const * p_scene, uint8_t length)
+{
+    uint32_t          err_code;
+    light_animation_t animation;
+    
+    if(length == 0)
+    {
+        return false;
+    }
+    
+    if(p_scene[0] >= 1 && p_scene[0] <= NR_OF_BUILTIN_ANIMATIONS && length == 1)
+    {
+        builtin_animation_start(p_scene[0]);
+    }
+    else if(p_scene[0] == LIGHT_SYNC_ANIMATION_CUSTOM &&
+            light_animation_decode(&animation, &p_scene[1], length - 1) == NRF_SUCCESS)
+    {
+        err_code = light_animation_start(&animation);
+        APP_ERROR_CHECK(err_code);
+        m_animation_id = LIGHT_SYNC_ANIMATION_CUSTOM;
+        memcpy(m_custom_animation, &p_scene[1], length - 1);
+        m_custom_animation_length = length - 1;
+    }
+    else if(p_scene[0] == LIGHT_SYNC_ANIMATION_NONE && length == 1 + 3 * NR_OF_PIXELS)
+    {
+        light_animation_stop();
+        m_animation_id = LIGHT_SYNC_ANIMATION_NONE;
+        for(uint8_t i = 0; i < NR_OF_PIXELS; i++)
+        {
+            nrf_drv_WS2812_pixel_t color =
+            {
+                .red   = p_scene[1 + 3 * i],
+                .green = p_scene[1 + 3 * i + 1],
+                .blue  = p_scene[1 + 3 * i + 2]
+            };
+            nrf_drv_WS2812_set_pixel(&m_leds, i, &color);
+        }
+        leds_show();
+    }
+    else
+    {
+        return false;
+    }
+    
+    m_gesture_effect = false;
+    return true;
+}
+
+/**@brief Function for storing a value unless it is stored already, flash is only written for changes.
+ */
+static void setting_store(uint8_t key, uint8_t const * p_value, uint8_t length)
+{
+    uint32_t err_code;
+    uint8_t  stored[PRESET_STORE_MAX_LENGTH];
+    
+    if(preset_store_read(key, stored, sizeof(stored)) == length && memcmp(stored, p_value, length) == 0)
+    {
+        return;
+    }
+    
+    err_code = preset_store_write(key, p_value, length);
+    APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Function for storing the scene and the brightness once they stayed the same a while.
+ */
+static void scene_save_timer_handler(void * p_context)
+{
+    uint32_t err_code;
+    uint8_t  scene[SCENE_MAX_LEN];
+    uint8_t  length;
+    
+    if(m_scene_changed)
+    {
+        m_scene_changed = false;
+        err_code = app_timer_start(m_scene_save_timer_id, SCENE_SAVE_DELAY, NULL);
+        APP_ERROR_CHECK(err_code);
+        return;
+    }
+    m_scene_save_pending = false;
+    
+    length = scene_encode(scene);
+    setting_store(PRESET_STORE_KEY_SCENE, scene, length);
+    setting_store(PRESET_STORE_KEY_BRIGHTNESS, &m_brightness, sizeof(m_brightness));
+}
+
+/**@brief Function for starting the preset store and going back to the last scene and brightness.
+ *
+ * @details Needs the SoftDevice, it writes the flash. The LEDs stay dark when nothing is stored.
+ */
+static void presets_init(void)
+{
+    uint32_t err_code;
+    uint8_t  scene[SCENE_MAX_LEN];
+    uint8_t  brightness;
+    uint8_t  length;
+    
+    err_code = app_timer_create(&m_scene_save_timer_id, APP_TIMER_MODE_SINGLE_SHOT, scene_save_timer_handler);
+    APP_ERROR_CHECK(err_code);
+    
+    err_code = preset_store_init();
+    APP_ERROR_CHECK(err_code);
+    
+    if(preset_store_read(PRESET_STORE_KEY_BRIGHTNESS, &brightness, sizeof(brightness)) == sizeof(brightness))
+    {
+        brightness_set(brightness);
+    }
+    
+    length = preset_store_read(PRESET_STORE_KEY_SCENE, scene, sizeof(scene));
+    if(length <= sizeof(scene))
+    {
+        UNUSED_RETURN_VALUE(scene_apply(scene, length));
+    }
+}
+#endif
+
+/**@brief Function for answering a command on the command characteristic.
+ */
+static void cmd_reply_send(ble_nus_t * p_nus, uint8_t const * p_reply, uint16_t length)
+{
+    uint32_t err_code;
+    
+    // Without notifications enabled or room to send there is no one to answer, the peer asks again.
+    err_code = ble_gl_cmd_reply_send(p_nus, p_reply, length);
+    if(err_code != NRF_ERROR_INVALID_STATE && err_code != BLE_ERROR_NO_TX_PACKETS &&
+       err_code != BLE_ERROR_GATTS_SYS_ATTR_MISSING)
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+/**@brief Function for answering a state query with what is on the LEDs.
+ *
+ * @details Laid out like a command: the opcode, the payload length, the animation id, the
+ *          brightness, the number of pixels, the color of the first pixel and the estimated
+ *          current of the LEDs in mA, little endian.
+ */
+static void cmd_state_reply(ble_nus_t * p_nus)
+{
+    nrf_drv_WS2812_pixel_t color;
+    uint8_t                reply[BLE_GL_CMD_HEADER_SIZE + 8];
+    uint16_t               current_ma = nrf_drv_WS2812_get_current(&m_leds);
+    
+    first_pixel_get(&color);
+    reply[0] = BLE_GL_CMD_QUERY_STATE;
+    reply[1] = sizeof(reply) - BLE_GL_CMD_HEADER_SIZE;
+    reply[2] = m_animation_id;
+    reply[3] = m_brightness;
+    reply[4] = NR_OF_PIXELS;
+    reply[5] = color.red;
+    reply[6] = color.green;
+    reply[7] = color.blue;
+    reply[8] = (uint8_t)current_ma;
+    reply[9] = (uint8_t)(current_ma >> 8);
+    
+    cmd_reply_send(p_nus, reply, sizeof(reply));
+}
+
+/**@brief Function for setting single pixels from a command, ending what else was on the LEDs.
+ */
+static void cmd_pixel_set(uint16_t pixel, nrf_drv_WS2812_pixel_t const * p_color)
+{
+    #if defined(BOARD_CUSTOM)
+        nrf_drv_WS2812_pixel_t color = *p_color;
+        
+        if(m_animation_id != LIGHT_SYNC_ANIMATION_NONE || light_animation_is_running())
+        {
+            light_animation_stop();
+            m_animation_id = LIGHT_SYNC_ANIMATION_NONE;
+        }
+        m_gesture_effect = false;
+        
+        if(pixel < NR_OF_PIXELS)
+        {
+            nrf_drv_WS2812_set_pixel(&m_leds, pixel, &color);
+        }
+        scene_save_request();
+    #endif
+}
+
+#if defined(BOARD_CUSTOM)
+/**@brief Function for storing what is on the LEDs under a name.
+ */
+static void preset_save(uint8_t slot, uint8_t const * p_name, uint8_t name_length)
+{
+    uint8_t preset[PRESET_MAX_LEN];
+    uint8_t length;
+    
+    if(slot >= PRESET_STORE_NR_OF_PRESETS)
+    {
+        return;
+    }
+    
+    memset(preset, 0, BLE_GL_CMD_PRESET_NAME_LEN);
+    memcpy(preset, p_name, name_length);
+    length = scene_encode(&preset[BLE_GL_CMD_PRESET_NAME_LEN]);
+    setting_store(PRESET_STORE_KEY_PRESET + slot, preset, BLE_GL_CMD_PRESET_NAME_LEN + length);
+}
+
+/**@brief Function for putting a preset on the LEDs, it becomes the last scene too.
+ *
+ * @details Answered with the slot and the name of the preset, an empty name for an empty slot.
+ */
+static void preset_load(ble_nus_t * p_nus, uint8_t slot)
+{
+    uint8_t preset[PRESET_MAX_LEN];
+    uint8_t length;
+    uint8_t reply[BLE_GL_CMD_HEADER_SIZE + 1 + BLE_GL_CMD_PRESET_NAME_LEN];
+    
+    if(slot >= PRESET_STORE_NR_OF_PRESETS)
+    {
+        return;
+    }
+    
+    length = preset_store_read(PRESET_STORE_KEY_PRESET + slot, preset, sizeof(preset));
+    if(length > BLE_GL_CMD_PRESET_NAME_LEN && length <= sizeof(preset) &&
+       scene_apply(&preset[BLE_GL_CMD_PRESET_NAME_LEN], length - BLE_GL_CMD_PRESET_NAME_LEN))
+    {
+        scene_save_request();
+    }
+    else
+    {
+        length = 0;
+    }
+    
+    reply[0] = BLE_GL_CMD_PRESET_LOAD;
+    reply[2] = slot;
+    if(length == 0)
+    {
+        reply[1] = 1;
+    }
+    else
+    {
+        reply[1] = 1 + BLE_GL_CMD_PRESET_NAME_LEN;
+        memcpy(&reply[3], preset, BLE_GL_CMD_PRESET_NAME_LEN);
+    }
+    cmd_reply_send(p_nus, reply, BLE_GL_CMD_HEADER_SIZE + reply[1]);
+}
+#endif
+
+/**@brief Function for handling the commands written to the Glass Light Service.
+ *
+ * @details All commands of a packet are handled before the main loop shows the frame, so they
+ *          end up on the LEDs together.
+ *
+ * @param[in] p_nus    Glass Light Service structure.
+ * @param[in] p_evt    Command, pointing into the written packet.
+ */
+static void cmd_handler(ble_nus_t * p_nus, ble_gl_cmd_evt_t const * p_evt)
+{
+    switch(p_evt->opcode)
+    {
+        case BLE_GL_CMD_SET_ALL:
+        {
+            nrf_drv_WS2812_pixel_t color = *p_evt->params.set_all.p_color;
+            
+            nus_data_handler(p_nus, &color);
+        } break;
+        
+        case BLE_GL_CMD_SET_RANGE:
+            //a range past the end is cut off, not wrapped around
+            for(uint32_t i = 0; i < p_evt->params.set_range.nr_of_pixels && p_evt->params.set_range.first_pixel + i < NR_OF_PIXELS; i++)
+            {
+                cmd_pixel_set(p_evt->params.set_range.first_pixel + i, p_evt->params.set_range.p_color);
+            }
+            leds_show();
+            break;
+        
+        case BLE_GL_CMD_SET_PIXELS:
+            for(uint16_t i = 0; i < p_evt->params.set_pixels.nr_of_pixels; i++)
+            {
+                ble_gl_cmd_pixel_t pixel;
+                
+                ble_gl_cmd_pixel_get(p_evt, i, &pixel);
+                cmd_pixel_set(pixel.pixel, &pixel.color);
+            }
+            leds_show();
+            break;
+        
+        case BLE_GL_CMD_ANIMATION:
+            animation_data_handler(p_nus, p_evt->params.animation.p_data, p_evt->params.animation.length);
+            break;
+        
+        case BLE_GL_CMD_BRIGHTNESS:
+            #if defined(BOARD_CUSTOM)
+                brightness_set(p_evt->params.brightness);
+                leds_show();
+                scene_save_request();
+            #endif
+            break;
+        
+        case BLE_GL_CMD_QUERY_STATE:
+            cmd_state_reply(p_nus);
+            break;
+        
+        case BLE_GL_CMD_PRESET_SAVE:
+            #if defined(BOARD_CUSTOM)
+                preset_save(p_evt->params.preset_save.slot, p_evt->params.preset_save.p_name,
+                            p_evt->params.preset_save.name_length);
+            #endif
+            break;
+        
+        case BLE_GL_CMD_PRESET_LOAD:
+            #if defined(BOARD_CUSTOM)
+                preset_load(p_nus, p_evt->params.preset_load);
+            #endif
+            break;
+        
+        default:
+            break;
+    }
 }
-/**@snippet [Handling the data received over BLE] */
 
 /**@brief Function for initializing services that will be used by the application.
  */
@@ -249,10 +1232,39 @@ static void services_init(void)
 
     memset(&nus_init, 0, sizeof(nus_init));
 
-    nus_init.data_handler = nus_data_handler;
+    nus_init.data_handler      = nus_data_handler;
+    nus_init.animation_handler = animation_data_handler;
+    nus_init.stream_handler    = stream_data_handler;
+    nus_init.cmd_handler       = cmd_handler;
+    #if defined(BOARD_CUSTOM)
+        nrf_drv_WS2812_pixel_t color;
+        
+        first_pixel_get(&color);
+        nus_init.p_initial_color = &color;
+    #endif
 
     err_code = ble_nus_init(&m_nus, &nus_init);
     APP_ERROR_CHECK(err_code);
+    
+    #if BATTERY_GAUGE_ENABLED
+        ble_bas_init_t bas_init;
+        
+        // Full until the first conversion, the notifications of the service are only for changes.
+        memset(&bas_init, 0, sizeof(bas_init));
+        BLE_GAP_CONN_SEC_MODE_SET_OPEN(&bas_init.battery_level_char_attr_md.cccd_write_perm);
+        BLE_GAP_CONN_SEC_MODE_SET_OPEN(&bas_init.battery_level_char_attr_md.read_perm);
+        BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&bas_init.battery_level_char_attr_md.write_perm);
+        BLE_GAP_CONN_SEC_MODE_SET_OPEN(&bas_init.battery_level_report_read_perm);
+        bas_init.support_notification = true;
+        bas_init.initial_batt_level   = 100;
+        m_battery_level               = 100;
+        
+        err_code = ble_bas_init(&m_bas, &bas_init);
+        APP_ERROR_CHECK(err_code);
+    #endif
+    
+    err_code = app_timer_create(&m_stream_idle_timer_id, APP_TIMER_MODE_REPEATED, stream_idle_timer_handler);
+    APP_ERROR_CHECK(err_code);
 }
 
 
@@ -261,9 +1273,8 @@ static void services_init(void)
  * @details This function will be called for all events in the Connection Parameters Module
  *          which are passed to the application.
  *
- * @note All this function does is to disconnect. This could have been done by simply setting
- *       the disconnect_on_fail config parameter, but instead we use the event handler
- *       mechanism to demonstrate its use.
+ * @note If the central refuses the streaming connection parameters the relaxed ones are kept,
+ *       otherwise a failed negotiation disconnects.
  *
  * @param[in] p_evt  Event received from the Connection Parameters Module.
  */
@@ -273,6 +1284,13 @@ static void on_conn_params_evt(ble_conn_params_evt_t * p_evt)
 
     if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED)
     {
+        if (m_stream_fast)
+        {
+            m_stream_refused = true;
+            conn_params_stream_set(false);
+            return;
+        }
+        
         err_code = sd_ble_gap_disconnect(m_conn_handle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
         APP_ERROR_CHECK(err_code);
     }
@@ -325,7 +1343,7 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
     switch (ble_adv_evt)
     {
         case BLE_ADV_EVT_IDLE:
-            err_code = ble_advertising_start(BLE_ADV_MODE_FAST);
+            err_code = ble_advertising_start(BLE_ADV_MODE_SLOW);
 			APP_ERROR_CHECK(err_code);
             break;
         default:
@@ -346,19 +1364,49 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
     {
         case BLE_GAP_EVT_CONNECTED:
             m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+            #if defined(BOARD_CUSTOM)
+                power_wake();
+            #endif
+#if (NRF_SD_BLE_API_VERSION == 3)
+            // Ask for the larger MTU right away, the link layer data length follows it.
+            err_code = sd_ble_gattc_exchange_mtu_request(m_conn_handle, NRF_BLE_MAX_MTU_SIZE);
+            APP_ERROR_CHECK(err_code);
+#endif
+            
+            // The glass the phone talks to leads the others.
+            err_code = light_sync_follow_stop();
+            APP_ERROR_CHECK(err_code);
+            app_beacon_interval_set(SYNC_BEACON_INTERVAL);
+            err_code = app_timer_start(m_sync_refresh_timer_id, SYNC_REFRESH_INTERVAL, NULL);
+            APP_ERROR_CHECK(err_code);
             break; // BLE_GAP_EVT_CONNECTED
 
         case BLE_GAP_EVT_DISCONNECTED:
             m_conn_handle = BLE_CONN_HANDLE_INVALID;
+            m_stream_fast = false;
+            m_stream_refused = false;
+            err_code = app_timer_stop(m_stream_idle_timer_id);
+            APP_ERROR_CHECK(err_code);
+            
+            // Back to the plain beacon, and follow again.
+            err_code = app_timer_stop(m_sync_refresh_timer_id);
+            APP_ERROR_CHECK(err_code);
+            if(m_sync_on_air)
+            {
+                err_code = app_beacon_frame_ratio_set(APP_BEACON_FRAME_RAW, 0);
+                APP_ERROR_CHECK(err_code);
+                m_sync_on_air = false;
+            }
+            app_beacon_interval_set(BEACON_ADV_INTERVAL);
+            err_code = light_sync_follow_start();
+            APP_ERROR_CHECK(err_code);
         
-            //turn off LEDs
             #if defined(BOARD_CUSTOM)
-                for(uint8_t i = 0; i < NR_OF_PIXELS; i++)
-                {
-                    nrf_drv_WS2812_set_pixel(i, &color_off);
-                }
-                nrf_drv_WS2812_show();
+                // The LEDs keep what the phone left on them, the sleep timer turns them off.
+                sleep_timer_restart();
             #elif defined(BOARD_PCA10040)
+                //turn off LEDs
+                m_animation_id = LIGHT_SYNC_ANIMATION_NONE;
                 nrf_gpio_pin_set(17);
                 nrf_gpio_pin_set(18);
                 nrf_gpio_pin_set(19);
@@ -431,6 +1479,11 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
                                                        NRF_BLE_MAX_MTU_SIZE);
             APP_ERROR_CHECK(err_code);
             break; // BLE_GATTS_EVT_EXCHANGE_MTU_REQUEST
+
+        case BLE_GATTC_EVT_EXCHANGE_MTU_RSP:
+            NRF_LOG_INFO("ATT MTU %d\r\n", MIN(p_ble_evt->evt.gattc_evt.params.exchange_mtu_rsp.server_rx_mtu,
+                                              NRF_BLE_MAX_MTU_SIZE));
+            break; // BLE_GATTC_EVT_EXCHANGE_MTU_RSP
 #endif
 
         default:
@@ -450,15 +1503,36 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
  */
 static void ble_evt_dispatch(ble_evt_t * p_ble_evt)
 {
+    if(p_ble_evt->header.evt_id == BLE_GATTS_EVT_WRITE)
+    {
+        TRACE(TRACE_EVT_BLE_WRITE, p_ble_evt->evt.gatts_evt.params.write.handle |
+                                   ((uint32_t)p_ble_evt->evt.gatts_evt.params.write.len << 16));
+        #if PERF_BENCH_ENABLED
+            perf_bench_write_mark();
+        #endif
+    }
+    
     ble_conn_params_on_ble_evt(p_ble_evt);
     ble_nus_on_ble_evt(&m_nus, p_ble_evt);
+    #if BATTERY_GAUGE_ENABLED
+        ble_bas_on_ble_evt(&m_bas, p_ble_evt);
+    #endif
     on_ble_evt(p_ble_evt);
     ble_advertising_on_ble_evt(p_ble_evt);
+    light_sync_on_ble_evt(p_ble_evt);
 
+    #if PERF_BENCH_ENABLED
+        if(!m_leds_show_pending)
+        {
+            //nothing for the LEDs in this write
+            perf_bench_write_cancel();
+        }
+    #endif
 }
 
 static void sys_evt_dispatch(uint32_t evt_id)
 {
+    fs_sys_event_handler(evt_id);
     app_beacon_on_sys_evt(evt_id);
 }
 
@@ -484,16 +1558,45 @@ static void ble_stack_init(void)
                                                     &ble_enable_params);
     APP_ERROR_CHECK(err_code);
 
-    //Check the ram settings against the used number of links
-    CHECK_RAM_START_ADDR(CENTRAL_LINK_COUNT,PERIPHERAL_LINK_COUNT);
+    // The RAM start in the linker settings leaves room for the larger MTU and the high bandwidth
+    // link below, so it no longer matches the default configuration CHECK_RAM_START_ADDR checks
+    // against. softdevice_enable() logs the RAM start it needs if it is set too low.
 
     // Enable BLE stack.
 #if (NRF_SD_BLE_API_VERSION == 3)
-    ble_enable_params.gatt_enable_params.att_mtu = NRF_BLE_MAX_MTU_SIZE;
+    ble_conn_bw_counts_t conn_bw_counts =
+    {
+        .tx_counts = {.high_count = PERIPHERAL_LINK_COUNT},
+        .rx_counts = {.high_count = PERIPHERAL_LINK_COUNT}
+    };
+    ble_enable_params.common_enable_params.p_conn_bw_counts = &conn_bw_counts;
+    ble_enable_params.gatt_enable_params.att_mtu            = NRF_BLE_MAX_MTU_SIZE;
 #endif
     err_code = softdevice_enable(&ble_enable_params);
     APP_ERROR_CHECK(err_code);
 
+#if (NRF_SD_BLE_API_VERSION == 3)
+    // High bandwidth gives the link several full length packets per connection event, and with
+    // event extension an event runs on as long as there is data and no other radio activity.
+    // Computed, not measured: a 251 byte LL packet and its empty ack take about 2.5 ms on the
+    // 1 Mbit PHY, so a 7.5 ms interval fits 3 of them, 3 x 244 bytes of stream data or about
+    // 780 kbit/s. With the default 23 byte MTU a 20 byte write takes about 0.7 ms, 11 per event
+    // or some 235 kbit/s, and only if the phone queues that many writes.
+    ble_opt_t opt;
+
+    memset(&opt, 0, sizeof(opt));
+    opt.common_opt.conn_bw.role               = BLE_GAP_ROLE_PERIPH;
+    opt.common_opt.conn_bw.conn_bw.conn_bw_tx = BLE_CONN_BW_HIGH;
+    opt.common_opt.conn_bw.conn_bw.conn_bw_rx = BLE_CONN_BW_HIGH;
+    err_code = sd_ble_opt_set(BLE_COMMON_OPT_CONN_BW, &opt);
+    APP_ERROR_CHECK(err_code);
+
+    memset(&opt, 0, sizeof(opt));
+    opt.common_opt.conn_evt_ext.enable = 1;
+    err_code = sd_ble_opt_set(BLE_COMMON_OPT_CONN_EVT_EXT, &opt);
+    APP_ERROR_CHECK(err_code);
+#endif
+
     // Subscribe for BLE events.
     err_code = softdevice_ble_evt_handler_set(ble_evt_dispatch);
     APP_ERROR_CHECK(err_code);
@@ -515,7 +1618,7 @@ static void advertising_init(void)
     memset(&advdata, 0, sizeof(advdata));
     advdata.name_type          = BLE_ADVDATA_FULL_NAME;
     advdata.include_appearance = false;
-    advdata.flags              = BLE_GAP_ADV_FLAGS_LE_ONLY_LIMITED_DISC_MODE;
+    advdata.flags              = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
 
     memset(&scanrsp, 0, sizeof(scanrsp));
     scanrsp.uuids_complete.uuid_cnt = sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]);
@@ -525,12 +1628,40 @@ static void advertising_init(void)
     options.ble_adv_fast_enabled  = true;
     options.ble_adv_fast_interval = APP_ADV_INTERVAL;
     options.ble_adv_fast_timeout  = APP_ADV_TIMEOUT_IN_SECONDS;
+    options.ble_adv_slow_enabled  = true;
+    options.ble_adv_slow_interval = APP_ADV_SLOW_INTERVAL;
+    options.ble_adv_slow_timeout  = APP_ADV_SLOW_TIMEOUT_IN_SECONDS;
 
     err_code = ble_advertising_init(&advdata, &scanrsp, &options, on_adv_evt, NULL);
     APP_ERROR_CHECK(err_code);
 }
 
 
+/**@brief Function for handing new trace records to RTT and, if the peer enabled them, to the trace
+ *        characteristic.
+ */
+static void trace_export(void)
+{
+    trace_record_t records[BLE_GL_STREAM_MAX_LEN / sizeof(trace_record_t)];
+    uint16_t       count;
+    
+    trace_rtt_flush();
+    
+    while(m_nus.is_trace_notification_enabled)
+    {
+        count = trace_get(&m_trace_ble_reader, records,
+                          MIN(sizeof(records) / sizeof(records[0]), m_nus.max_data_len / sizeof(trace_record_t)));
+        if(count == 0 ||
+           ble_gl_trace_send(&m_nus, (uint8_t const *)records, count * sizeof(trace_record_t)) != NRF_SUCCESS)
+        {
+            //the rest goes once the SoftDevice has room again
+            break;
+        }
+        trace_consume(&m_trace_ble_reader, count);
+    }
+}
+
+
 /**@brief Function for placing the application in low power state while waiting for events.
  */
 static void power_manage(void)
@@ -539,38 +1670,106 @@ static void power_manage(void)
     APP_ERROR_CHECK(err_code);
 }
 
+/**@brief Function for tracing the frames clocked out, from the PWM interrupt.
+ */
+static void leds_frame_handler(nrf_drv_WS2812_t * p_strip)
+{
+    TRACE(TRACE_EVT_PWM_END, 0);
+    if(nrf_drv_WS2812_is_busy(p_strip))
+    {
+        //the frame that waited for this one, or the next dithering step
+        TRACE(TRACE_EVT_PWM_START, 0);
+    }
+}
+
+static void leds_init(void)
+{
+    uint32_t err_code;
+    nrf_drv_WS2812_config_t const config =
+    {
+        .pin              = WS2812_PIN,
+        .nr_of_pixels     = NR_OF_PIXELS,
+        .handler          = leds_frame_handler,
+        .current_limit_ma = LEDS_CURRENT_LIMIT_MA
+    };
+    
+    err_code = nrf_drv_WS2812_init(&m_leds, &config);
+    APP_ERROR_CHECK(err_code);
+    
+    light_animation_init_t const animation_init =
+    {
+        .p_strip          = &m_leds,
+        .nr_of_pixels     = NR_OF_PIXELS,
+        .tick_interval_ms = FADE_TIMER_INTERVAL_MS,
+        .timer_prescaler  = APP_TIMER_PRESCALER,
+        .show_handler     = leds_show
+    };
+    
+    err_code = light_animation_init(&animation_init);
+    APP_ERROR_CHECK(err_code);
+}
+
+#if defined(BOARD_CUSTOM) && PERF_BENCH_ENABLED
+/**@brief Function for printing a benchmark result over RTT.
+ */
+static void perf_bench_report_handler(char const * p_name, uint16_t nr_of_pixels, perf_bench_stat_t const * p_stat)
+{
+    NRF_LOG_INFO("%s, %d pixels: min %d avg %d max %d cycles\r\n", (uint32_t)p_name, nr_of_pixels,
+                 p_stat->min, (uint32_t)(p_stat->sum / p_stat->count), p_stat->max);
+}
+
+/**@brief Function for measuring the render path on the LEDs of the glass.
+ *
+ * @details Runs before the SoftDevice is enabled, so no BLE interrupt ends up in the numbers. The
+ *          frames are only posted to the main loop, which shows the last one.
+ */
+static void leds_bench_run(void)
+{
+    perf_bench_init_t const bench_init =
+    {
+        .p_strip        = &m_leds,
+        .nr_of_pixels   = NR_OF_PIXELS,
+        .iterations     = PERF_BENCH_ITERATIONS,
+        .report_handler = perf_bench_report_handler
+    };
+    
+    perf_bench_init(&bench_init);
+    perf_bench_run();
+}
+#endif
+
 static void ws2812_test()
 {
 	for(int i = 0; i < NR_OF_PIXELS; i++)
 	{
-		nrf_drv_WS2812_set_pixel(i, &color_red);
+		nrf_drv_WS2812_set_pixel(&m_leds, i, &color_red);
 	}
 	
-	nrf_drv_WS2812_show();
+	nrf_drv_WS2812_show(&m_leds);
 	nrf_delay_ms(1000);
 	
 	for(int i = 0; i < NR_OF_PIXELS; i++)
 	{
-		nrf_drv_WS2812_set_pixel(i, &color_green);
+		nrf_drv_WS2812_set_pixel(&m_leds, i, &color_green);
 	}
 	
-	nrf_drv_WS2812_show();
+	nrf_drv_WS2812_show(&m_leds);
 	nrf_delay_ms(1000);
 	
 	for(int i = 0; i < NR_OF_PIXELS; i++)
 	{
-		nrf_drv_WS2812_set_pixel(i, &color_blue);
+		nrf_drv_WS2812_set_pixel(&m_leds, i, &color_blue);
 	}
 	
-	nrf_drv_WS2812_show();
+	nrf_drv_WS2812_show(&m_leds);
 	nrf_delay_ms(1000);
 	
 	for(int i = 0; i < NR_OF_PIXELS; i++)
 	{
-		nrf_drv_WS2812_set_pixel(i, &color_off);
+		nrf_drv_WS2812_set_pixel(&m_leds, i, &color_off);
 	}
 	
-	nrf_drv_WS2812_show();
+	nrf_drv_WS2812_show(&m_leds);
 }
 
 static void charge_timer_handler(void *p_context)
@@ -579,6 +1778,9 @@ static void charge_timer_handler(void *p_context)
 	uint32_t err_code = app_timer_start(m_charge_led_pulse_timer_id, CHARGING_LED_PULSE_LENGTH, NULL);
 	APP_ERROR_CHECK(err_code);
 	
+	light_animation_stop();
+	m_animation_id = LIGHT_SYNC_ANIMATION_NONE;
+	
 	color++;
 	if(color > 2)
 	{
@@ -590,36 +1792,37 @@ static void charge_timer_handler(void *p_context)
 		switch(color)
 		{
 			case 0:
-				nrf_drv_WS2812_set_pixel(i, &color_red);
+				nrf_drv_WS2812_set_pixel(&m_leds, i, &color_red);
 				break;
 			case 1:
-				nrf_drv_WS2812_set_pixel(i, &color_green);
+				nrf_drv_WS2812_set_pixel(&m_leds, i, &color_green);
 				break;
 			case 2:
-				nrf_drv_WS2812_set_pixel(i, &color_blue);
+				nrf_drv_WS2812_set_pixel(&m_leds, i, &color_blue);
 				break;
 		}
 	}
 	
-	nrf_drv_WS2812_show();
+	leds_show();
 }
 
 static void charge_led_pulse_timer_handler(void *p_context)
 {
 	for(int i = 0; i < NR_OF_PIXELS; i++)
 	{
-		nrf_drv_WS2812_set_pixel(i, &color_off);
+		nrf_drv_WS2812_set_pixel(&m_leds, i, &color_off);
 	}
 	
-	nrf_drv_WS2812_show();
+	leds_show();
 }
 
-static void charge_pin_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+static void charge_evt_handler(void * p_event_data, uint16_t event_size)
 {
 	uint32_t err_code;
-    bool pin_status = nrf_drv_gpiote_in_is_set(pin);
 	
-	if(pin_status)
+	//an edge after this posts the event again, so the level read here is never left stale
+	m_charge_pending = false;
+	if(nrf_drv_gpiote_in_is_set(m_charge_pin))
 	{
 		//done charging
 		err_code = app_timer_stop(m_charge_timer_id);
@@ -633,6 +1836,22 @@ static void charge_pin_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t a
 	}
 }
 
+static void charge_pin_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+	uint32_t err_code;
+	
+	//bouncing on plug in or a blinking STAT output would flood the scheduler queue, all edges
+	//until the main loop reads the level go into one event
+	if(m_charge_pending)
+	{
+		return;
+	}
+	m_charge_pending = true;
+	
+	err_code = app_sched_event_put(NULL, 0, charge_evt_handler);
+	APP_ERROR_CHECK(err_code);
+}
+
 static void charge_detection_init(uint32_t pin)
 {
 	uint32_t err_code;
@@ -643,6 +1862,9 @@ static void charge_detection_init(uint32_t pin)
 		APP_ERROR_CHECK(err_code);
 	}
 	
+	m_charge_pin     = pin;
+	m_charge_pending = false;
+	
 	nrf_drv_gpiote_in_config_t pin_config = GPIOTE_CONFIG_IN_SENSE_TOGGLE(false);
 	pin_config.pull = NRF_GPIO_PIN_PULLUP;
 	
@@ -658,6 +1880,251 @@ static void charge_detection_init(uint32_t pin)
 	APP_ERROR_CHECK(err_code);
 }
 
+#if BATTERY_GAUGE_ENABLED
+/**@brief Function for handling a new battery reading in the main loop.
+ *
+ * @details Updates the battery service and lowers the brightness cap while the cell drains,
+ *          linearly from full brightness at BATTERY_FULL_POWER_MV down to BATTERY_LOW_BRIGHTNESS
+ *          at BATTERY_LOW_POWER_MV. The brightness the user set is kept, it comes back on charging.
+ */
+static void battery_evt_handler(void * p_event_data, uint16_t event_size)
+{
+    uint32_t err_code;
+    uint16_t voltage_mv = battery_voltage_get();
+    uint8_t  level      = battery_level_get();
+    uint8_t  cap;
+    
+    if(level != m_battery_level)
+    {
+        m_battery_level = level;
+        
+        // Without notifications enabled or room to send the peer reads the new level.
+        err_code = ble_bas_battery_level_update(&m_bas, level);
+        if(err_code != NRF_ERROR_INVALID_STATE && err_code != BLE_ERROR_NO_TX_PACKETS &&
+           err_code != BLE_ERROR_GATTS_SYS_ATTR_MISSING)
+        {
+            APP_ERROR_CHECK(err_code);
+        }
+    }
+    
+    if(voltage_mv >= BATTERY_FULL_POWER_MV)
+    {
+        cap = 0xFF;
+    }
+    else if(voltage_mv <= BATTERY_LOW_POWER_MV)
+    {
+        cap = BATTERY_LOW_BRIGHTNESS;
+    }
+    else
+    {
+        cap = BATTERY_LOW_BRIGHTNESS + (voltage_mv - BATTERY_LOW_POWER_MV) * (0xFF - BATTERY_LOW_BRIGHTNESS) /
+                                       (BATTERY_FULL_POWER_MV - BATTERY_LOW_POWER_MV);
+    }
+    
+    if(cap != m_brightness_cap)
+    {
+        m_brightness_cap = cap;
+        brightness_set(m_brightness);
+        leds_show();
+    }
+}
+
+/**@brief Function for handling a battery conversion, in the SAADC interrupt.
+ */
+static void battery_handler(uint16_t voltage_mv, uint8_t level)
+{
+    uint32_t err_code = app_sched_event_put(NULL, 0, battery_evt_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Function for starting the battery conversions.
+ */
+static void battery_monitor_init(void)
+{
+    uint32_t err_code;
+    
+    battery_config_t const config =
+    {
+        .ain         = BATTERY_AIN,
+        .divider_num = BATTERY_DIVIDER_NUM,
+        .divider_den = BATTERY_DIVIDER_DEN,
+        .interval    = BATTERY_SAMPLE_INTERVAL,
+        .handler     = battery_handler
+    };
+    
+    err_code = battery_init(&config);
+    APP_ERROR_CHECK(err_code);
+}
+#endif
+
+#if defined(BOARD_CUSTOM)
+/**@brief Function for starting a built-in animation for a gesture, remembering what it replaces.
+ */
+static void gesture_effect_start(uint8_t animation_id)
+{
+    if(!m_gesture_effect)
+    {
+        m_gesture_effect = true;
+        m_rest_animation_id = m_animation_id;
+        first_pixel_get(&m_rest_color);
+    }
+    builtin_animation_start(animation_id);
+}
+
+/**@brief Function for going back to what was on the LEDs before a gesture effect.
+ *
+ * @details A custom animation is not kept, it is left at the color it had.
+ */
+static void gesture_effect_end(void)
+{
+    if(!m_gesture_effect)
+    {
+        return;
+    }
+    m_gesture_effect = false;
+    
+    light_state_restore(m_rest_animation_id, &m_rest_color);
+}
+
+/**@brief Function for flashing white when glasses clink, on a plain color only.
+ */
+static void gesture_flash(void)
+{
+    uint32_t          err_code;
+    light_animation_t flash;
+    
+    if(light_animation_is_running())
+    {
+        return;
+    }
+    
+    memset(&flash, 0, sizeof(flash));
+    flash.keyframes[0].color         = color_white;
+    flash.keyframes[0].duration_ms   = 0;
+    flash.keyframes[1].duration_ms   = GESTURE_FLASH_FADE_MS;
+    flash.keyframes[1].interpolation = LIGHT_ANIMATION_EASE;
+    first_pixel_get(&flash.keyframes[1].color);
+    flash.nr_of_keyframes            = 2;
+    
+    err_code = light_animation_start(&flash);
+    APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Function for turning gestures into light effects, without waiting for the phone.
+ */
+static void gesture_handler(gesture_evt_t const * p_evt)
+{
+    switch(p_evt->type)
+    {
+        case GESTURE_EVT_TAP:
+            gesture_flash();
+            break;
+        
+        case GESTURE_EVT_SHAKE:
+            gesture_effect_start(GESTURE_SHAKE_ANIMATION);
+            break;
+        
+        case GESTURE_EVT_POUR_START:
+            gesture_effect_start(GESTURE_POUR_ANIMATION);
+            break;
+        
+        case GESTURE_EVT_POUR_END:
+            gesture_effect_end();
+            break;
+        
+        case GESTURE_EVT_MOVE:
+            m_moving = true;
+            break;
+        
+        case GESTURE_EVT_SET_DOWN:
+            m_moving = false;
+            sleep_timer_restart();
+            gesture_effect_end();
+            break;
+        
+        default:
+            break;
+    }
+}
+
+/**@brief Function for running new accelerometer samples through the gesture engine, from the
+ *        main loop.
+ */
+static void accelerometer_evt_handler(void * p_event_data, uint16_t event_size)
+{
+    lis3dh_sample_t samples[LIS3DH_FIFO_SIZE];
+    uint16_t        count;
+    
+    m_acc_pending = false;
+    while((count = lis3dh_samples_get(samples, LIS3DH_FIFO_SIZE)) != 0)
+    {
+        gesture_process(samples, count);
+    }
+}
+
+/**@brief Function for handling new accelerometer samples.
+ *
+ * @details Called from the SPI interrupt once per FIFO burst. The samples wait in the ring buffer
+ *          of the driver, a second burst before the main loop got to the first is taken with it.
+ */
+static void accelerometer_handler(uint16_t nr_of_samples)
+{
+    uint32_t err_code;
+    
+    TRACE(TRACE_EVT_ACC_FIFO, nr_of_samples);
+    
+    if(m_acc_pending)
+    {
+        return;
+    }
+    m_acc_pending = true;
+    
+    err_code = app_sched_event_put(NULL, 0, accelerometer_evt_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Function for setting up the accelerometer and the gesture engine.
+ *
+ * @details The samples collect in its FIFO and are read in one burst per watermark, a quarter of
+ *          a second of them at a time.
+ */
+static void accelerometer_init(void)
+{
+    uint32_t err_code;
+    lis3dh_config_t const config =
+    {
+        .odr                 = ACC_ODR,
+        .range               = ACC_RANGE,
+        .watermark           = ACC_WATERMARK,
+        .handler             = accelerometer_handler,
+        .wakeup_odr          = ACC_WAKEUP_ODR,
+        .wakeup_threshold_mg = ACC_WAKEUP_THRESHOLD_MG,
+        .click_threshold_mg  = ACC_CLICK_THRESHOLD_MG,
+        .wakeup_handler      = accelerometer_wakeup_handler
+    };
+    gesture_init_t const gesture_init_params =
+    {
+        .sample_rate_hz = ACC_SAMPLE_RATE_HZ,
+        .counts_per_g   = ACC_COUNTS_PER_G,
+        .handler        = gesture_handler
+    };
+    
+    err_code = gesture_init(&gesture_init_params);
+    APP_ERROR_CHECK(err_code);
+    
+    err_code = lis3dh_init(&config);
+    APP_ERROR_CHECK(err_code);
+    
+    err_code = lis3dh_start();
+    APP_ERROR_CHECK(err_code);
+    
+    // Standing still from here on puts the glass to sleep.
+    err_code = app_timer_create(&m_sleep_timer_id, APP_TIMER_MODE_SINGLE_SHOT, sleep_timer_handler);
+    APP_ERROR_CHECK(err_code);
+    sleep_timer_restart();
+}
+#endif
+
 void gpio_led_init()
 {
     nrf_gpio_pin_set(17);
@@ -679,6 +2146,30 @@ static void beacon_advertiser_error_handler(uint32_t nrf_error)
 }
 
 
+/**@brief Function for refreshing the telemetry in the beacon.
+ */
+static void beacon_tlm_timer_handler(void * p_context)
+{
+    static uint32_t  uptime;
+    int32_t          temperature;
+    app_beacon_tlm_t tlm;
+    
+    memset(&tlm, 0, sizeof(tlm));
+    tlm.uptime      = uptime;
+    uptime         += 100;  //10 s in units of 0.1 s
+    tlm.temperature = (int16_t)0x8000;
+    if(sd_temp_get(&temperature) == NRF_SUCCESS)
+    {
+        tlm.temperature = (int16_t)(temperature * 64);  //0.25 degrees to 8.8 fixed point
+    }
+    #if BATTERY_GAUGE_ENABLED
+        tlm.battery_mv = battery_voltage_get();     //0 until the first plausible conversion
+    #endif
+    
+    // Busy only while the previous one is on air, it is refreshed again soon enough.
+    UNUSED_RETURN_VALUE(app_beacon_tlm_update(&tlm));
+}
+
 /**@brief Function for initializing the beacon timeslot functionality.
  */
 static uint32_t timeslot_init(void)
@@ -690,6 +2181,7 @@ static uint32_t timeslot_init(void)
     beacon_init.p_data         = (uint8_t *)BEACON_URL;
     beacon_init.data_size      = BEACON_URL_LEN;
     beacon_init.error_handler = beacon_advertiser_error_handler;
+    beacon_init.timer_prescaler = APP_TIMER_PRESCALER;
 
     err_code = sd_ble_gap_addr_get(&beacon_init.beacon_addr);
 
@@ -702,6 +2194,24 @@ static uint32_t timeslot_init(void)
     beacon_init.beacon_addr.addr[0] += 2;
 
     app_beacon_init(&beacon_init);
+    
+    // The chip's device id tells the glasses apart in the UID frame.
+    err_code = app_beacon_uid_set((uint8_t const *)BEACON_UID_NAMESPACE, (uint8_t const *)NRF_FICR->DEVICEID);
+    APP_ERROR_CHECK(err_code);
+    beacon_tlm_timer_handler(NULL);
+    
+    err_code = app_beacon_frame_ratio_set(APP_BEACON_FRAME_URL, BEACON_URL_RATIO);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_beacon_frame_ratio_set(APP_BEACON_FRAME_UID, BEACON_UID_RATIO);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_beacon_frame_ratio_set(APP_BEACON_FRAME_TLM, BEACON_TLM_RATIO);
+    APP_ERROR_CHECK(err_code);
+    
+    err_code = app_timer_create(&m_beacon_tlm_timer_id, APP_TIMER_MODE_REPEATED, beacon_tlm_timer_handler);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_start(m_beacon_tlm_timer_id, BEACON_TLM_INTERVAL, NULL);
+    APP_ERROR_CHECK(err_code);
+    
     app_beacon_start();
 
     return NRF_SUCCESS;
@@ -715,9 +2225,11 @@ int main(void)
     
     // Initialize.
     APP_TIMER_INIT(APP_TIMER_PRESCALER, APP_TIMER_OP_QUEUE_SIZE, false);
+    APP_SCHED_INIT(SCHED_MAX_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
+    trace_init();
 
     #if defined(BOARD_CUSTOM)
-        nrf_drv_WS2812_init(WS2812_PIN);
+        leds_init();
         //ws2812_test();
     #elif defined(BOARD_PCA10040)
         gpio_led_init();
@@ -728,9 +2240,17 @@ int main(void)
     
     NRF_LOG_INFO("Glass light v1.0");
     
+    #if defined(BOARD_CUSTOM) && PERF_BENCH_ENABLED
+        leds_bench_run();
+    #endif
+    
     ble_stack_init();
+    #if defined(BOARD_CUSTOM)
+        presets_init();
+    #endif
     gap_params_init();
     services_init();
+    sync_init();
     advertising_init();
     conn_params_init();
 
@@ -739,21 +2259,22 @@ int main(void)
 
     timeslot_init();
 
+    err_code = light_sync_follow_start();
+    APP_ERROR_CHECK(err_code);
+
     #if defined(BOARD_CUSTOM)
         charge_detection_init(CHARGE_STAT_PIN);
+        #if BATTERY_GAUGE_ENABLED
+            battery_monitor_init();
+        #endif
+        accelerometer_init();
     #endif
 	
-    
-    /*
-    lis3dh_init();
-    
-    lis3dh_read(0x0F, data, 2);
-    */
     // Enter main loop.
     for (;;)
     {
-        //nrf_delay_ms(1000);
-        //lis3dh_read(0x0F, data, 2);
+        app_sched_execute();
+        trace_export();
         if (NRF_LOG_PROCESS() == false)
         {
             power_manage();
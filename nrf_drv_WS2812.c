@@ -5,6 +5,7 @@
 
 #include "nrf.h"
 #include "nrf_gpio.h"
+#include "app_util.h"
 #include "app_util_platform.h"
 #include "nrf_drv_WS2812.h"
 #include "nrf_drv_pwm.h"
@@ -16,42 +17,506 @@
 //#define ZERO_HIGH_TICKS         6       //6/16MHz = 0.375us (should be 0.35us +-150ns)
 
 //fast
-#define RESET_ZEROS_AT_START    45
+#define RESET_ZEROS_AT_START    NRF_DRV_WS2812_RESET_PERIODS
 #define PERIOD_TICKS            18      //20/16MHz = 1.125us (should be 1.25us +-150ns)
 #define ONE_HIGH_TICKS          13      //14/16MHz = 0.8125us (should be 0.9us +-150ns)
 #define ZERO_HIGH_TICKS         5       //6/16MHz = 0.3125us (should be 0.35us +-150ns)
 
-static nrf_drv_pwm_t m_pwm0 = NRF_DRV_PWM_INSTANCE(0);
+#define LOW_VALUE               0x8000                          //output low for the whole pwm period
+#define LOW_WORD                (((uint32_t)LOW_VALUE << 16) | LOW_VALUE)
 
-static nrf_pwm_values_common_t m_seq_values[NR_OF_PIXELS * 24 + RESET_ZEROS_AT_START + 1];     //RESET signal + 24 bits per pixel + one pwm cycle to set the output low at the end
-static nrf_pwm_sequence_t const m_seq =
+#define MAX_STRIPS              4                               //one per pwm instance
+
+#define TRACK_DIRTY             (!NRF_DRV_WS2812_STREAMING && !NRF_DRV_WS2812_DITHER)   //frames are only partially re-encoded
+
+#define LIMIT_NONE              256                             //output scale of a frame within the current limit
+#define LINEAR_FULL_SCALE       (65535ULL * 255)                //load of one color at full on, linear light times brightness and white balance
+
+#if NRF_DRV_WS2812_DITHER
+//the pixels take 6 bytes each instead of 3 and there are no correction tables
+#define COLOR_FROM_8(value)     ((value) * 257)
+#define COLOR_FROM_16(value)    (value)
+#define COLOR_TO_16(value)      (value)
+#define DITHER_SHIFT            (8 - NRF_DRV_WS2812_DITHER_BITS)     //fraction bits below the dithered ones are rounded off
+#define DITHER_ROUND            (1UL << (7 + DITHER_SHIFT))
+#define DITHER_FRAME_PERIODS    (16000000 / PERIOD_TICKS / NRF_DRV_WS2812_DITHER_FRAME_RATE)    //pwm periods from the start of one frame to the next
+
+STATIC_ASSERT(NRF_DRV_WS2812_DITHER_BITS >= 1 && NRF_DRV_WS2812_DITHER_BITS <= 8);
+#else
+#define COLOR_FROM_8(value)     (value)
+#define COLOR_FROM_16(value)    ((value) >> 8)
+#define COLOR_TO_16(value)      ((value) * 257)
+#endif
+
+STATIC_ASSERT((RESET_ZEROS_AT_START % 2) == 0);
+
+#if NRF_DRV_WS2812_STREAMING
+
+//one chunk of pixels per sequence buffer, the first chunk of a frame is all zeros and is the reset signal
+#define SEQ_LENGTH(nr_of_pixels)    (NRF_DRV_WS2812_STREAM_CHUNK_PIXELS * 24)
+#define FRAME_CHUNKS(nr_of_pixels)  (1 + ((nr_of_pixels) + NRF_DRV_WS2812_STREAM_CHUNK_PIXELS) / NRF_DRV_WS2812_STREAM_CHUNK_PIXELS)  //reset + pixels + at least one pwm cycle low at the end
+
+STATIC_ASSERT(SEQ_LENGTH(0) >= RESET_ZEROS_AT_START);
+
+//total ram usage (in bytes) per strip is approximately 3*nr_of_pixels + 2*NRF_DRV_WS2812_STREAM_CHUNK_PIXELS*24*2 + 3*256 correction tables = nr_of_pixels * 3 + 2304 for 16 pixel chunks
+
+#else
+
+#define SEQ_LENGTH(nr_of_pixels)    ((nr_of_pixels) * 24 + RESET_ZEROS_AT_START + 1)     //RESET signal + 24 bits per pixel + one pwm cycle to set the output low at the end
+
+//total ram usage (in bytes) per strip is approximately 3*nr_of_pixels + 2*(24*nr_of_pixels*2 + (RESET_ZEROS_AT_START+1)*2) + 2*4*((nr_of_pixels+31)/32) for the dirty bitmaps + 3*256 correction tables = about nr_of_pixels * 99.25 + 964
+
+#endif
+
+//strip driven by each pwm driver instance, the pwm handler has no context
+static nrf_drv_WS2812_t * m_strips[MAX_STRIPS];
+
+//pwm value for a single bit, 0x8000 sets the polarity so the output starts high
+#define BIT_VALUE(bit)          ((bit) ? (ONE_HIGH_TICKS | 0x8000) : (ZERO_HIGH_TICKS | 0x8000))
+
+//two consecutive bits packed in one word, the first (most significant) bit is sent first and lives in the low half
+#define BIT_PAIR(bits)          ((uint32_t)BIT_VALUE((bits) & 0x02) | ((uint32_t)BIT_VALUE((bits) & 0x01) << 16))
+
+#define NIBBLE_ENTRY(nibble)    { BIT_PAIR((nibble) >> 2), BIT_PAIR(nibble) }
+
+//pwm values for every 4-bit pattern, msb first
+static const uint32_t m_nibble_lut[16][2] =
+{
+    NIBBLE_ENTRY(0x0), NIBBLE_ENTRY(0x1), NIBBLE_ENTRY(0x2), NIBBLE_ENTRY(0x3),
+    NIBBLE_ENTRY(0x4), NIBBLE_ENTRY(0x5), NIBBLE_ENTRY(0x6), NIBBLE_ENTRY(0x7),
+    NIBBLE_ENTRY(0x8), NIBBLE_ENTRY(0x9), NIBBLE_ENTRY(0xA), NIBBLE_ENTRY(0xB),
+    NIBBLE_ENTRY(0xC), NIBBLE_ENTRY(0xD), NIBBLE_ENTRY(0xE), NIBBLE_ENTRY(0xF)
+};
+
+#if NRF_DRV_WS2812_GAMMA
+//round(65535 * (i / 255) ^ 2.2), 16 bits so brightness and white balance can be applied without losing the dark end
+static const uint16_t m_gamma[257] =
 {
-    .values.p_common     = m_seq_values,
-    .length              = NRF_PWM_VALUES_LENGTH(m_seq_values),
-    .repeats             = 0,
-    .end_delay           = 0
+        0,     0,     2,     4,     7,    11,    17,    24,    32,    42,    53,    65,
+       79,    94,   111,   129,   148,   169,   192,   216,   242,   270,   299,   330,
+      362,   396,   432,   469,   508,   549,   591,   635,   681,   729,   779,   830,
+      883,   938,   995,  1053,  1113,  1175,  1239,  1305,  1373,  1443,  1514,  1587,
+     1663,  1740,  1819,  1900,  1983,  2068,  2155,  2243,  2334,  2427,  2521,  2618,
+     2717,  2817,  2920,  3024,  3131,  3240,  3350,  3463,  3578,  3694,  3813,  3934,
+     4057,  4182,  4309,  4438,  4570,  4703,  4838,  4976,  5115,  5257,  5401,  5547,
+     5695,  5845,  5998,  6152,  6309,  6468,  6629,  6792,  6957,  7124,  7294,  7466,
+     7640,  7816,  7994,  8175,  8358,  8543,  8730,  8919,  9111,  9305,  9501,  9699,
+     9900, 10102, 10307, 10515, 10724, 10936, 11150, 11366, 11585, 11806, 12029, 12254,
+    12482, 12712, 12944, 13179, 13416, 13655, 13896, 14140, 14386, 14635, 14885, 15138,
+    15394, 15652, 15912, 16174, 16439, 16706, 16975, 17247, 17521, 17798, 18077, 18358,
+    18642, 18928, 19216, 19507, 19800, 20095, 20393, 20694, 20996, 21301, 21609, 21919,
+    22231, 22546, 22863, 23182, 23504, 23829, 24156, 24485, 24817, 25151, 25487, 25826,
+    26168, 26512, 26858, 27207, 27558, 27912, 28268, 28627, 28988, 29351, 29717, 30086,
+    30457, 30830, 31206, 31585, 31966, 32349, 32735, 33124, 33514, 33908, 34304, 34702,
+    35103, 35507, 35913, 36321, 36732, 37146, 37562, 37981, 38402, 38825, 39252, 39680,
+    40112, 40546, 40982, 41421, 41862, 42306, 42753, 43202, 43654, 44108, 44565, 45025,
+    45487, 45951, 46418, 46888, 47360, 47835, 48313, 48793, 49275, 49761, 50249, 50739,
+    51232, 51728, 52226, 52727, 53230, 53736, 54245, 54756, 55270, 55787, 56306, 56828,
+    57352, 57879, 58409, 58941, 59476, 60014, 60554, 61097, 61642, 62190, 62741, 63295,
+    63851, 64410, 64971, 65535,
+    65535                                                   //lets gamma16() interpolate past the last entry
 };
 
-//total ram usage (in bytes) is approximately 3*NR_OF_PIXELS + 24*NUMBER_OF_PIXELS*2 + (RESET_ZEROS_AT_START+1)*2 = NR_OF_PIXELS * 51 + 84
+#define GAMMA(value)            m_gamma[value]
+#elif !NRF_DRV_WS2812_DITHER
+#define GAMMA(value)            ((uint16_t)((value) * 257))
+#endif
+
+#if !NRF_DRV_WS2812_DITHER
+#define LINEAR(value)           GAMMA(value)                    //linear light of a stored color, for the current estimate
+#endif
+
+//write the 8 pwm values for one color byte, msb first
+static __INLINE void encode_byte(uint32_t * p_dst, uint8_t value)
+{
+    uint32_t const * p_high = m_nibble_lut[value >> 4];
+    uint32_t const * p_low  = m_nibble_lut[value & 0x0F];
+    
+    p_dst[0] = p_high[0];
+    p_dst[1] = p_high[1];
+    p_dst[2] = p_low[0];
+    p_dst[3] = p_low[1];
+}
+
+#if NRF_DRV_WS2812_DITHER
+
+//16 bit color to 16 bit linear light, between the entries of the gamma table
+static __INLINE uint32_t gamma16(uint32_t value)
+{
+#if NRF_DRV_WS2812_GAMMA
+    uint32_t position = value * 255 + (value >> 8);         //value / 65535 in 8.16 fixed point
+    uint32_t i        = position >> 16;
+    uint32_t fraction = (position >> 8) & 0xFF;
+    
+    return m_gamma[i] + (((m_gamma[i + 1] - m_gamma[i]) * fraction) >> 8);
+#else
+    return value;
+#endif
+}
+
+#define LINEAR(value)           gamma16(value)
+
+//translate part of the pixels array to pwm values, WS2812 expects the colors in GRB order
+static void encode_pixels(nrf_drv_WS2812_t * p_strip, uint32_t * p_dst, uint32_t first, uint32_t count)
+{
+    nrf_drv_WS2812_stored_pixel_t const * p_pixel = &p_strip->p_pixels[first];
+    uint32_t                              fractions = 0;
+    //the current limit goes into the same multiply as brightness and white balance
+    uint32_t                              scale_red   = (p_strip->scale[0] * p_strip->limit) >> 8;
+    uint32_t                              scale_green = (p_strip->scale[1] * p_strip->limit) >> 8;
+    uint32_t                              scale_blue  = (p_strip->scale[2] * p_strip->limit) >> 8;
+    
+    for(uint32_t i = 0; i < count; i++)
+    {
+        //ordered dithering, the bit reversed frame count visits every step once per 2^bits frames
+        //and neighbouring pixels are at different steps so the strip does not flicker in unison
+        uint32_t step  = __RBIT(p_strip->frame_count + first + i) >> (32 - NRF_DRV_WS2812_DITHER_BITS);
+        uint32_t green = (gamma16(p_pixel->green) * scale_green + DITHER_ROUND) >> (8 + DITHER_SHIFT);
+        uint32_t red   = (gamma16(p_pixel->red)   * scale_red   + DITHER_ROUND) >> (8 + DITHER_SHIFT);
+        uint32_t blue  = (gamma16(p_pixel->blue)  * scale_blue  + DITHER_ROUND) >> (8 + DITHER_SHIFT);
+        
+        //output level in the upper bits, the part between two levels in the lower ones
+        encode_byte(p_dst,     (green >> NRF_DRV_WS2812_DITHER_BITS) + ((green & ((1 << NRF_DRV_WS2812_DITHER_BITS) - 1)) > step));
+        encode_byte(p_dst + 4, (red   >> NRF_DRV_WS2812_DITHER_BITS) + ((red   & ((1 << NRF_DRV_WS2812_DITHER_BITS) - 1)) > step));
+        encode_byte(p_dst + 8, (blue  >> NRF_DRV_WS2812_DITHER_BITS) + ((blue  & ((1 << NRF_DRV_WS2812_DITHER_BITS) - 1)) > step));
+        fractions |= green | red | blue;
+        p_dst += 12;
+        p_pixel++;
+    }
+    
+    if((fractions & ((1 << NRF_DRV_WS2812_DITHER_BITS) - 1)) != 0)
+    {
+        p_strip->dithering = true;
+    }
+}
+
+#else
+
+//translate part of the pixels array to pwm values, WS2812 expects the colors in GRB order
+static void encode_pixels(nrf_drv_WS2812_t * p_strip, uint32_t * p_dst, uint32_t first, uint32_t count)
+{
+    nrf_drv_WS2812_pixel_t const * p_pixel = &p_strip->p_pixels[first];
+    uint8_t const                * p_red   = p_strip->p_correction[0];
+    uint8_t const                * p_green = p_strip->p_correction[1];
+    uint8_t const                * p_blue  = p_strip->p_correction[2];
+    uint32_t                       limit   = p_strip->limit;
+    
+    if(limit == LIMIT_NONE)
+    {
+        for(uint32_t i = 0; i < count; i++)
+        {
+            encode_byte(p_dst,     p_green[p_pixel->green]);
+            encode_byte(p_dst + 4, p_red[p_pixel->red]);
+            encode_byte(p_dst + 8, p_blue[p_pixel->blue]);
+            p_dst += 12;
+            p_pixel++;
+        }
+        return;
+    }
+    
+    //over the current limit, the corrected colors are scaled down once more
+    for(uint32_t i = 0; i < count; i++)
+    {
+        encode_byte(p_dst,     (p_green[p_pixel->green] * limit) >> 8);
+        encode_byte(p_dst + 4, (p_red[p_pixel->red]     * limit) >> 8);
+        encode_byte(p_dst + 8, (p_blue[p_pixel->blue]   * limit) >> 8);
+        p_dst += 12;
+        p_pixel++;
+    }
+}
+
+#endif
+
+#if NRF_DRV_WS2812_STREAMING
+
+//fill a sequence buffer with one chunk of the frame
+static void fill_chunk(nrf_drv_WS2812_t * p_strip, uint32_t buffer, uint32_t chunk)
+{
+    uint32_t * p_words = p_strip->p_seq_words[buffer];
+    uint32_t   first   = (chunk - 1) * NRF_DRV_WS2812_STREAM_CHUNK_PIXELS;
+    uint32_t   count   = 0;
+    
+    if(chunk > 0 && first < p_strip->nr_of_pixels)
+    {
+        count = MIN(p_strip->nr_of_pixels - first, NRF_DRV_WS2812_STREAM_CHUNK_PIXELS);
+        encode_pixels(p_strip, p_words, first, count);
+    }
+    
+    for(uint32_t i = count * 12; i < NRF_DRV_WS2812_SEQ_WORDS(0); i++)
+    {
+        p_words[i] = LOW_WORD;
+    }
+}
 
-static nrf_drv_WS2812_pixel_t pixels[NR_OF_PIXELS];
+//start clocking out the pixels array, called with the pwm stopped
+static void start_frame(nrf_drv_WS2812_t * p_strip)
+{
+#if NRF_DRV_WS2812_DITHER
+    p_strip->frame_count++;
+    p_strip->dithering = false;
+#endif
+    fill_chunk(p_strip, 0, 0);
+    fill_chunk(p_strip, 1, 1);
+    p_strip->next_chunk = 2;
+    p_strip->busy       = true;
+    
+    //seq0 and seq1 alternate, each is refilled while the other one plays
+    nrf_drv_pwm_complex_playback(&p_strip->pwm, &p_strip->seq[0], &p_strip->seq[1], (p_strip->frame_chunks + 1) / 2,
+                                 NRF_DRV_PWM_FLAG_STOP | NRF_DRV_PWM_FLAG_SIGNAL_END_SEQ0 | NRF_DRV_PWM_FLAG_SIGNAL_END_SEQ1);
+}
+
+#else
+
+//start clocking out the back buffer, called with the pwm stopped
+static void start_frame(nrf_drv_WS2812_t * p_strip)
+{
+    p_strip->busy = true;
+    nrf_drv_pwm_simple_playback(&p_strip->pwm, &p_strip->seq[p_strip->back_buffer], 1, NRF_DRV_PWM_FLAG_STOP);
+    p_strip->back_buffer ^= 1;
+}
+
+#if TRACK_DIRTY
+
+//re-encode the pixels changed since this buffer was last encoded
+static void encode_dirty(nrf_drv_WS2812_t * p_strip, uint32_t buffer)
+{
+    uint32_t * p_dirty = p_strip->p_dirty[buffer];
+    uint32_t * p_words = &p_strip->p_seq_words[buffer][RESET_ZEROS_AT_START / 2];
+    
+    for(uint32_t w = 0; w < NRF_DRV_WS2812_DIRTY_WORDS(p_strip->nr_of_pixels); w++)
+    {
+        uint32_t bits;
+        
+        //a pixel set from an interrupt in between would lose its bit
+        CRITICAL_REGION_ENTER();
+        bits = p_dirty[w];
+        p_dirty[w] = 0;
+        CRITICAL_REGION_EXIT();
+        if(bits == 0xFFFFFFFF)
+        {
+            //whole frame changes end up here, no need to look at single bits
+            encode_pixels(p_strip, &p_words[w * 32 * 12], w * 32, 32);
+            continue;
+        }
+        while(bits != 0)
+        {
+            uint32_t bit   = 31 - __CLZ(bits);
+            uint32_t first = w * 32 + bit;
+            
+            bits &= ~(1UL << bit);
+            encode_pixels(p_strip, &p_words[first * 12], first, 1);
+        }
+    }
+}
+
+#endif
+
+//bring the back buffer up to date with the pixels array
+static void encode_back_buffer(nrf_drv_WS2812_t * p_strip)
+{
+#if NRF_DRV_WS2812_DITHER
+    //every pixel moves on to its next dithering step
+    p_strip->frame_count++;
+    p_strip->dithering = false;
+    encode_pixels(p_strip, &p_strip->p_seq_words[p_strip->back_buffer][RESET_ZEROS_AT_START / 2], 0, p_strip->nr_of_pixels);
+#else
+    encode_dirty(p_strip, p_strip->back_buffer);
+#endif
+}
+
+#endif
+
+#if NRF_DRV_WS2812_DITHER
+
+//send the next dithering step of the same pixels, called from the pwm interrupt with the pwm stopped
+static void dither_refresh(nrf_drv_WS2812_t * p_strip)
+{
+#if NRF_DRV_WS2812_STREAMING
+    start_frame(p_strip);
+#else
+    if(!p_strip->encoding)
+    {
+        encode_back_buffer(p_strip);
+        start_frame(p_strip);
+    }
+#endif
+}
+
+#endif
+
+#if TRACK_DIRTY
+
+//every pixel has to be encoded again into both buffers
+static void mark_all_dirty(nrf_drv_WS2812_t * p_strip)
+{
+    for(uint32_t w = 0; w < NRF_DRV_WS2812_DIRTY_WORDS(p_strip->nr_of_pixels); w++)
+    {
+        //no bits past the last pixel, that is where the low value at the end of the frame lives
+        uint32_t bits = (p_strip->nr_of_pixels - w * 32 >= 32) ? 0xFFFFFFFF : ((1UL << (p_strip->nr_of_pixels % 32)) - 1);
+        
+        p_strip->p_dirty[0][w] = bits;
+        p_strip->p_dirty[1][w] = bits;
+    }
+}
+
+#endif
+
+//rebuild the output value tables after a brightness or white balance change, every pixel has to be encoded again
+static void correction_update(nrf_drv_WS2812_t * p_strip)
+{
+    for(uint32_t c = 0; c < 3; c++)
+    {
+        p_strip->scale[c] = (p_strip->brightness * p_strip->white_balance[c] + 127) / 255;
+        
+#if !NRF_DRV_WS2812_DITHER
+        for(uint32_t i = 0; i < 256; i++)
+        {
+            p_strip->p_correction[c][i] = (GAMMA(i) * p_strip->scale[c] + 0x8000) >> 16;
+        }
+#endif
+    }
+    
+#if TRACK_DIRTY
+    mark_all_dirty(p_strip);
+#endif
+    p_strip->changed = true;
+}
+
+//load the current limit leaves for the light, the pixels draw the idle current even when they are off
+static void max_load_update(nrf_drv_WS2812_t * p_strip)
+{
+    uint32_t limit_ua = p_strip->current_limit_ma * 1000UL;
+    uint32_t idle_ua  = p_strip->nr_of_pixels * NRF_DRV_WS2812_PIXEL_IDLE_UA;
+    
+    p_strip->max_load = (limit_ua > idle_ua) ? (uint64_t)(limit_ua - idle_ua) * LINEAR_FULL_SCALE / NRF_DRV_WS2812_CHANNEL_UA : 0;
+}
+
+//linear light of all pixels times brightness and white balance, summed from scratch as pixels
+//are set from interrupts too and a running sum would drift
+static uint64_t load_get(nrf_drv_WS2812_t const * p_strip)
+{
+    uint32_t sum[3] = {0, 0, 0};
+    uint64_t load   = 0;
+    
+    for(uint32_t i = 0; i < p_strip->nr_of_pixels; i++)
+    {
+        nrf_drv_WS2812_stored_pixel_t const * p_pixel = &p_strip->p_pixels[i];
+        
+        sum[0] += LINEAR(p_pixel->red);
+        sum[1] += LINEAR(p_pixel->green);
+        sum[2] += LINEAR(p_pixel->blue);
+    }
+    for(uint32_t c = 0; c < 3; c++)
+    {
+        load += (uint64_t)sum[c] * p_strip->scale[c];
+    }
+    return load;
+}
+
+//dim the frame to show evenly when it is above the current limit, before it is encoded
+static void current_limit_update(nrf_drv_WS2812_t * p_strip)
+{
+    uint32_t limit = LIMIT_NONE;
+    
+    //without a limit show() stays at the cost of encoding the changed pixels
+    if(p_strip->current_limit_ma != 0)
+    {
+        uint64_t load = load_get(p_strip);
+        
+        if(load > p_strip->max_load)
+        {
+            limit = p_strip->max_load * LIMIT_NONE / load;
+        }
+    }
+    
+    if(limit != p_strip->limit)
+    {
+        p_strip->limit = limit;
+#if TRACK_DIRTY
+        mark_all_dirty(p_strip);
+#endif
+    }
+}
 
-void nrf_drv_WS2812_init(uint8_t pin)
+static void pwm_handler(nrf_drv_WS2812_t * p_strip, nrf_drv_pwm_evt_type_t event_type)
 {
-    nrf_gpio_cfg_output(pin);
-    nrf_gpio_pin_clear(pin);
+    switch(event_type)
+    {
+#if NRF_DRV_WS2812_STREAMING
+        case NRF_DRV_PWM_EVT_END_SEQ0:
+        case NRF_DRV_PWM_EVT_END_SEQ1:
+            //this buffer has been read, the other one is playing now
+            fill_chunk(p_strip, event_type == NRF_DRV_PWM_EVT_END_SEQ0 ? 0 : 1, p_strip->next_chunk++);
+            break;
+#endif
+    
+        //follows the SEQEND of the last sequence (LOOPSDONE -> STOP short), the buffers are free again
+        case NRF_DRV_PWM_EVT_STOPPED:
+            p_strip->busy = false;
+    
+            if(p_strip->pending)
+            {
+                p_strip->pending = false;
+                start_frame(p_strip);
+            }
+#if NRF_DRV_WS2812_DITHER
+            else if(p_strip->dithering)
+            {
+                dither_refresh(p_strip);
+            }
+#endif
     
+            if(p_strip->handler != NULL)
+            {
+                p_strip->handler(p_strip);
+            }
+            break;
+    
+        default:
+            break;
+    }
+}
+
+static void pwm_handler_0(nrf_drv_pwm_evt_type_t event_type) { pwm_handler(m_strips[0], event_type); }
+static void pwm_handler_1(nrf_drv_pwm_evt_type_t event_type) { pwm_handler(m_strips[1], event_type); }
+static void pwm_handler_2(nrf_drv_pwm_evt_type_t event_type) { pwm_handler(m_strips[2], event_type); }
+static void pwm_handler_3(nrf_drv_pwm_evt_type_t event_type) { pwm_handler(m_strips[3], event_type); }
+
+static const nrf_drv_pwm_handler_t m_pwm_handlers[MAX_STRIPS] =
+{
+    pwm_handler_0,
+    pwm_handler_1,
+    pwm_handler_2,
+    pwm_handler_3
+};
+
+uint32_t nrf_drv_WS2812_init(nrf_drv_WS2812_t * p_strip, nrf_drv_WS2812_config_t const * p_config)
+{
     uint32_t err_code;
+    uint8_t  idx = p_strip->pwm.drv_inst_idx;
+    
+    if(p_config->nr_of_pixels == 0 || p_config->nr_of_pixels > p_strip->max_pixels || idx >= MAX_STRIPS)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    
+    nrf_gpio_cfg_output(p_config->pin);
+    nrf_gpio_pin_clear(p_config->pin);
+    
     nrf_drv_pwm_config_t const config0 =
     {
         .output_pins =
         {
-            pin, // channel 0
+            p_config->pin, // channel 0
             NRF_DRV_PWM_PIN_NOT_USED, // channel 1
             NRF_DRV_PWM_PIN_NOT_USED, // channel 2
             NRF_DRV_PWM_PIN_NOT_USED  // channel 3
         },
+#if NRF_DRV_WS2812_STREAMING
+        .irq_priority = APP_IRQ_PRIORITY_HIGH,      //a chunk must be refilled before the other one has been clocked out
+#else
         .irq_priority = APP_IRQ_PRIORITY_LOW,
+#endif
         .base_clock   = NRF_PWM_CLK_16MHz,
         .count_mode   = NRF_PWM_MODE_UP,
         .top_value    = PERIOD_TICKS,
@@ -59,78 +524,248 @@ void nrf_drv_WS2812_init(uint8_t pin)
         .step_mode    = NRF_PWM_STEP_AUTO
     };
     
-    err_code = nrf_drv_pwm_init(&m_pwm0, &config0, NULL);
-    APP_ERROR_CHECK(err_code);
+    p_strip->nr_of_pixels = p_config->nr_of_pixels;
+    p_strip->handler      = p_config->handler;
+    p_strip->busy         = false;
+    p_strip->pending      = false;
+#if NRF_DRV_WS2812_DITHER
+    p_strip->frame_count  = 0;
+    p_strip->dithering    = false;
+    p_strip->encoding     = false;
+#endif
+    p_strip->brightness   = 0xFF;
+    p_strip->current_limit_ma = p_config->current_limit_ma;
+    p_strip->limit        = LIMIT_NONE;
+    max_load_update(p_strip);
+    
+    for(uint32_t c = 0; c < 3; c++)
+    {
+        p_strip->white_balance[c] = 0xFF;
+    }
+    correction_update(p_strip);
+    p_strip->changed      = false;          //the buffers are encoded from scratch below
+    
+    for(uint32_t b = 0; b < 2; b++)
+    {
+        p_strip->seq[b].values.p_common = (nrf_pwm_values_common_t const *)p_strip->p_seq_words[b];
+        p_strip->seq[b].length          = SEQ_LENGTH(p_strip->nr_of_pixels);
+        p_strip->seq[b].repeats         = 0;
+        p_strip->seq[b].end_delay       = 0;
+#if NRF_DRV_WS2812_DITHER && !NRF_DRV_WS2812_STREAMING
+        //low after the frame so dithering does not resend faster than NRF_DRV_WS2812_DITHER_FRAME_RATE
+        if(p_strip->seq[b].length < DITHER_FRAME_PERIODS)
+        {
+            p_strip->seq[b].end_delay = DITHER_FRAME_PERIODS - p_strip->seq[b].length;
+        }
+#endif
+    }
+    
+    memset(p_strip->p_pixels, 0, p_strip->nr_of_pixels * sizeof(nrf_drv_WS2812_stored_pixel_t));
+    
+    err_code = nrf_drv_pwm_init(&p_strip->pwm, &config0, m_pwm_handlers[idx]);
+    if(err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+    
+    //only a strip that owns its PWM instance is dispatched to from the interrupt
+    m_strips[idx] = p_strip;
+    
+#if NRF_DRV_WS2812_STREAMING
+    p_strip->frame_chunks = FRAME_CHUNKS(p_strip->nr_of_pixels);
+#if NRF_DRV_WS2812_DITHER
+    //all low chunks at the end so dithering does not resend faster than NRF_DRV_WS2812_DITHER_FRAME_RATE
+    p_strip->frame_chunks = MAX(p_strip->frame_chunks, CEIL_DIV(DITHER_FRAME_PERIODS, SEQ_LENGTH(0)));
+#endif
+#else
+    p_strip->back_buffer = 0;
+    
+    for(uint32_t b = 0; b < 2; b++)
+    {
+        nrf_pwm_values_common_t * p_values = (nrf_pwm_values_common_t *)p_strip->p_seq_words[b];
+        
+        for(int i = 0; i < RESET_ZEROS_AT_START; i++)
+        {
+            p_values[i] = LOW_VALUE;
+        }
+        
+        p_values[p_strip->nr_of_pixels * 24 + RESET_ZEROS_AT_START] = LOW_VALUE;
+        
+        encode_pixels(p_strip, &p_strip->p_seq_words[b][RESET_ZEROS_AT_START / 2], 0, p_strip->nr_of_pixels);
+#if TRACK_DIRTY
+        memset(p_strip->p_dirty[b], 0, NRF_DRV_WS2812_DIRTY_WORDS(p_strip->nr_of_pixels) * sizeof(uint32_t));
+#endif
+    }
+#endif
+    
+    //clock out an all off frame
+    start_frame(p_strip);
     
-    for(int i = 0; i < NRF_PWM_VALUES_LENGTH(m_seq_values); i++)
+    return NRF_SUCCESS;
+}
+
+
+//store a color in the format of the pixels array
+static void pixel_store(nrf_drv_WS2812_t * p_strip, uint16_t pixel_nr, uint16_t red, uint16_t green, uint16_t blue)
+{
+    nrf_drv_WS2812_stored_pixel_t * p_pixel = &p_strip->p_pixels[pixel_nr];
+    
+    if(p_pixel->red == red && p_pixel->green == green && p_pixel->blue == blue)
     {
-        m_seq_values[i] = ONE_HIGH_TICKS;
+        return;
     }
-		
-	for(int i = 0; i < RESET_ZEROS_AT_START; i++)
-	{
-		m_seq_values[i] = 0x8000;
-	}
-	
-	m_seq_values[NR_OF_PIXELS * 24 + RESET_ZEROS_AT_START] = 0x8000;
-	
-	nrf_drv_pwm_simple_playback(&m_pwm0, &m_seq, 1, 0);
+    
+    p_pixel->red = red;
+    p_pixel->green = green;
+    p_pixel->blue = blue;
+    
+    p_strip->changed = true;
+#if TRACK_DIRTY
+    //both buffers have to pick up the new color, the bitmaps are shared with pixels set from
+    //interrupts and with encode_dirty()
+    CRITICAL_REGION_ENTER();
+    p_strip->p_dirty[0][pixel_nr / 32] |= 1UL << (pixel_nr % 32);
+    p_strip->p_dirty[1][pixel_nr / 32] |= 1UL << (pixel_nr % 32);
+    CRITICAL_REGION_EXIT();
+#endif
+}
+
+
+void nrf_drv_WS2812_set_pixel_rgb(nrf_drv_WS2812_t * p_strip, uint16_t pixel_nr, uint8_t red, uint8_t green, uint8_t blue)
+{
+    pixel_store(p_strip, pixel_nr, COLOR_FROM_8(red), COLOR_FROM_8(green), COLOR_FROM_8(blue));
 }
 
 
-void nrf_drv_WS2812_set_pixel_rgb(uint8_t pixel_nr, uint8_t red, uint8_t green, uint8_t blue)
+void nrf_drv_WS2812_set_pixel(nrf_drv_WS2812_t * p_strip, uint16_t pixel_nr, nrf_drv_WS2812_pixel_t *color)
 {
-    pixels[pixel_nr].red = red;
-    pixels[pixel_nr].green = green;
-    pixels[pixel_nr].blue = blue;
+    pixel_store(p_strip, pixel_nr, COLOR_FROM_8(color->red), COLOR_FROM_8(color->green), COLOR_FROM_8(color->blue));
 }
 
 
-void nrf_drv_WS2812_set_pixel(uint8_t pixel_nr, nrf_drv_WS2812_pixel_t *color)
+void nrf_drv_WS2812_set_pixel16(nrf_drv_WS2812_t * p_strip, uint16_t pixel_nr, uint16_t red, uint16_t green, uint16_t blue)
 {
-    memcpy(&pixels[pixel_nr], color, sizeof(nrf_drv_WS2812_pixel_t));
+    pixel_store(p_strip, pixel_nr, COLOR_FROM_16(red), COLOR_FROM_16(green), COLOR_FROM_16(blue));
 }
 
-void nrf_drv_WS2812_show(void)
+
+void nrf_drv_WS2812_get_pixel16(nrf_drv_WS2812_t const * p_strip, uint16_t pixel_nr, nrf_drv_WS2812_pixel16_t * p_color)
 {
-    //translate pixels array to pwm sequence array
+    nrf_drv_WS2812_stored_pixel_t const * p_pixel = &p_strip->p_pixels[pixel_nr];
     
-    for(uint8_t i = 0; i < (sizeof(pixels)/sizeof(nrf_drv_WS2812_pixel_t)) ; i++)
+    p_color->red = COLOR_TO_16(p_pixel->red);
+    p_color->green = COLOR_TO_16(p_pixel->green);
+    p_color->blue = COLOR_TO_16(p_pixel->blue);
+}
+
+
+void nrf_drv_WS2812_set_brightness(nrf_drv_WS2812_t * p_strip, uint8_t brightness)
+{
+    if(brightness != p_strip->brightness)
     {
-        for(uint8_t j = 0; j < 8; j++)
-        {
-            if( (pixels[i].green << j) & 0x80)
-            {
-                m_seq_values[RESET_ZEROS_AT_START + i*24 + j] = ONE_HIGH_TICKS | 0x8000;
-            }
-            else
-            {
-                m_seq_values[RESET_ZEROS_AT_START + i*24 + j] = ZERO_HIGH_TICKS | 0x8000;
-            }
-        }
-        for(uint8_t j = 0; j < 8; j++)
-        {
-            if( (pixels[i].red << j) & 0x80)
-            {
-                m_seq_values[RESET_ZEROS_AT_START + i*24 + j + 8] = ONE_HIGH_TICKS | 0x8000;
-            }
-            else
-            {
-                m_seq_values[RESET_ZEROS_AT_START + i*24 + j + 8] = ZERO_HIGH_TICKS | 0x8000;
-            }
-        }
-        for(uint8_t j = 0; j < 8; j++)
-        {
-            if( (pixels[i].blue << j) & 0x80)
-            {
-                m_seq_values[RESET_ZEROS_AT_START + i*24 + j + 16] = ONE_HIGH_TICKS | 0x8000;
-            }
-            else
-            {
-                m_seq_values[RESET_ZEROS_AT_START + i*24 + j + 16] = ZERO_HIGH_TICKS | 0x8000;
-            }
-        }
+        p_strip->brightness = brightness;
+        correction_update(p_strip);
+    }
+}
+
+
+void nrf_drv_WS2812_set_white_balance(nrf_drv_WS2812_t * p_strip, uint8_t red, uint8_t green, uint8_t blue)
+{
+    if(red != p_strip->white_balance[0] || green != p_strip->white_balance[1] || blue != p_strip->white_balance[2])
+    {
+        p_strip->white_balance[0] = red;
+        p_strip->white_balance[1] = green;
+        p_strip->white_balance[2] = blue;
+        correction_update(p_strip);
     }
+}
+
+
+void nrf_drv_WS2812_set_current_limit(nrf_drv_WS2812_t * p_strip, uint16_t limit_ma)
+{
+    if(limit_ma != p_strip->current_limit_ma)
+    {
+        p_strip->current_limit_ma = limit_ma;
+        max_load_update(p_strip);
+        p_strip->changed = true;
+    }
+}
+
+
+uint16_t nrf_drv_WS2812_get_current(nrf_drv_WS2812_t const * p_strip)
+{
+    uint32_t idle_ua = p_strip->nr_of_pixels * NRF_DRV_WS2812_PIXEL_IDLE_UA;
+    uint32_t leds_ua = load_get(p_strip) * p_strip->limit / LIMIT_NONE * NRF_DRV_WS2812_CHANNEL_UA / LINEAR_FULL_SCALE;
+    
+    return (idle_ua + leds_ua + 999) / 1000;
+}
+
+#if NRF_DRV_WS2812_STREAMING
+
+void nrf_drv_WS2812_show(nrf_drv_WS2812_t * p_strip)
+{
+    if(!p_strip->changed)
+    {
+        return;
+    }
+    p_strip->changed = false;
+    current_limit_update(p_strip);
     
-    nrf_drv_pwm_simple_playback(&m_pwm0, &m_seq, 1, 0);
+    //the pixels are encoded while the frame is clocked out
+    CRITICAL_REGION_ENTER();
+    if(p_strip->busy)
+    {
+        p_strip->pending = true;
+    }
+    else
+    {
+        start_frame(p_strip);
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+#else
+
+void nrf_drv_WS2812_show(nrf_drv_WS2812_t * p_strip)
+{
+    if(!p_strip->changed)
+    {
+        //same frame as the one sent or waiting to be sent
+        return;
+    }
+    p_strip->changed = false;
+    current_limit_update(p_strip);
+    
+    //the pwm interrupt must not start or rewrite the back buffer while it is being rewritten here
+    CRITICAL_REGION_ENTER();
+    p_strip->pending = false;
+#if NRF_DRV_WS2812_DITHER
+    p_strip->encoding = true;
+#endif
+    CRITICAL_REGION_EXIT();
+    
+    encode_back_buffer(p_strip);
+    
+    CRITICAL_REGION_ENTER();
+#if NRF_DRV_WS2812_DITHER
+    p_strip->encoding = false;
+#endif
+    if(p_strip->busy)
+    {
+        //sent from the pwm interrupt when the current frame is done
+        p_strip->pending = true;
+    }
+    else
+    {
+        start_frame(p_strip);
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+#endif
+
+
+bool nrf_drv_WS2812_is_busy(nrf_drv_WS2812_t const * p_strip)
+{
+    return p_strip->busy || p_strip->pending;
 }
@@ -1,11 +1,87 @@
-
-
 #ifndef NRF_DRV_WS2812_H__
 #define NRF_DRV_WS2812_H__
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#include "nordic_common.h"
+#include "nrf_drv_pwm.h"
+
+/* With streaming enabled the pwm values are encoded on the fly into two small buffers of
+ * NRF_DRV_WS2812_STREAM_CHUNK_PIXELS pixels each, refilled from the PWM interrupt, instead of
+ * keeping two full frames (48 bytes per pixel each). RAM use no longer grows with the strip
+ * length beyond the 3 bytes per pixel of the pixels array.
+ *
+ * A chunk must be refilled while the other one is clocked out, 27us per pixel, so chunks
+ * must be long enough to cover the worst case interrupt latency under the SoftDevice. Pixels
+ * changed while a frame is being sent may show up in that frame.
+ */
+#ifndef NRF_DRV_WS2812_STREAMING
+#define NRF_DRV_WS2812_STREAMING 0
+#endif
+
+#ifndef NRF_DRV_WS2812_STREAM_CHUNK_PIXELS
+#define NRF_DRV_WS2812_STREAM_CHUNK_PIXELS 16
+#endif
+
+/* Gamma correction of the pixel colors, with a gamma of 2.2. Brightness and white balance are
+ * applied after it, on linear light, and all three are folded into one lookup table per channel
+ * so encoding a color byte stays a single table lookup.
+ */
+#ifndef NRF_DRV_WS2812_GAMMA
+#define NRF_DRV_WS2812_GAMMA 1
+#endif
+
+/* Temporal dithering. The pixels are kept with 16 bits per color and the part below the 8 bits
+ * the LEDs take is spread over NRF_DRV_WS2812_DITHER_BITS consecutive frames. While any color has
+ * such a part the driver resends the strip by itself, at most NRF_DRV_WS2812_DITHER_FRAME_RATE
+ * times a second, so slow fades stay smooth at the dark end without more updates from the
+ * application. Costs 3 more bytes per pixel and a multiply per color when encoding. On by default
+ * for the glass light board only, whatever the toolchain.
+ */
+#ifndef NRF_DRV_WS2812_DITHER
+#ifdef BOARD_CUSTOM
+#define NRF_DRV_WS2812_DITHER 1
+#else
+#define NRF_DRV_WS2812_DITHER 0
+#endif
+#endif
+
+#ifndef NRF_DRV_WS2812_DITHER_BITS
+#define NRF_DRV_WS2812_DITHER_BITS 4
+#endif
+
+#ifndef NRF_DRV_WS2812_DITHER_FRAME_RATE
+#define NRF_DRV_WS2812_DITHER_FRAME_RATE 400
+#endif
 
-#define NR_OF_PIXELS 6
+/* Current limit. While a limit is set, the linear light of every channel is summed over the strip
+ * in nrf_drv_WS2812_show(), so the current of a frame is known before it is encoded, also when
+ * only the changed pixels are encoded or the frame is streamed. Without one show() does not look
+ * at the pixels that did not change, the estimate is summed when it is asked for. A frame that
+ * would draw more than the limit is dimmed evenly in the encoding, with one multiply per color.
+ * The estimate takes NRF_DRV_WS2812_CHANNEL_UA for a color at full on and
+ * NRF_DRV_WS2812_PIXEL_IDLE_UA for every pixel, on or off.
+ */
+#ifndef NRF_DRV_WS2812_CHANNEL_UA
+#define NRF_DRV_WS2812_CHANNEL_UA 20000     //WS2812B, a white pixel takes 60 mA
+#endif
+
+#ifndef NRF_DRV_WS2812_PIXEL_IDLE_UA
+#define NRF_DRV_WS2812_PIXEL_IDLE_UA 1000
+#endif
+
+#define NRF_DRV_WS2812_RESET_PERIODS 46     //low pwm periods in front of every frame, even so the pixel data is word aligned
+
+//words needed for one sequence buffer, two pwm values per word
+#if NRF_DRV_WS2812_STREAMING
+#define NRF_DRV_WS2812_SEQ_WORDS(max_pixels)    (NRF_DRV_WS2812_STREAM_CHUNK_PIXELS * 12)
+#else
+#define NRF_DRV_WS2812_SEQ_WORDS(max_pixels)    (((max_pixels) * 24 + NRF_DRV_WS2812_RESET_PERIODS + 2) / 2)
+#endif
+
+//words needed for one dirty pixel bitmap
+#define NRF_DRV_WS2812_DIRTY_WORDS(max_pixels)  (((max_pixels) + 31) / 32)
 
 typedef struct
 {
@@ -14,9 +90,168 @@ typedef struct
     uint8_t blue;
 } nrf_drv_WS2812_pixel_t;
 
-void nrf_drv_WS2812_init(uint8_t pin);
-void nrf_drv_WS2812_set_pixel_rgb(uint8_t pixel_nr, uint8_t red, uint8_t green, uint8_t blue);
-void nrf_drv_WS2812_set_pixel(uint8_t pixel_nr, nrf_drv_WS2812_pixel_t *color);
-void nrf_drv_WS2812_show(void);
+typedef struct
+{
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+} nrf_drv_WS2812_pixel16_t;
+
+//what the pixels array holds
+#if NRF_DRV_WS2812_DITHER
+typedef nrf_drv_WS2812_pixel16_t nrf_drv_WS2812_stored_pixel_t;
+#else
+typedef nrf_drv_WS2812_pixel_t nrf_drv_WS2812_stored_pixel_t;
+#endif
+
+typedef struct nrf_drv_WS2812_s nrf_drv_WS2812_t;
+
+/**@brief Called from the PWM interrupt each time a frame has been clocked out, including the
+ *        frames resent for dithering.
+ */
+typedef void (*nrf_drv_WS2812_handler_t)(nrf_drv_WS2812_t * p_strip);
+
+typedef struct
+{
+    uint8_t                  pin;               /**< Data pin of the strip. */
+    uint16_t                 nr_of_pixels;      /**< Pixels on the strip, at most the max_pixels given to @ref NRF_DRV_WS2812_DEF. */
+    nrf_drv_WS2812_handler_t handler;           /**< Frame done handler, can be NULL. */
+    uint16_t                 current_limit_ma;  /**< Highest estimated current of a frame, 0 for no limit. */
+} nrf_drv_WS2812_config_t;
+
+/**@brief One strip, driven by its own PWM instance. Define with @ref NRF_DRV_WS2812_DEF and
+ *        only access through the functions below.
+ */
+struct nrf_drv_WS2812_s
+{
+    nrf_drv_pwm_t              pwm;
+    nrf_drv_WS2812_stored_pixel_t * p_pixels;
+    uint32_t                 * p_seq_words[2];
+    uint16_t                   max_pixels;
+    uint16_t                   nr_of_pixels;
+    nrf_pwm_sequence_t         seq[2];
+    nrf_drv_WS2812_handler_t   handler;
+    uint8_t                    scale[3];        //brightness and white balance per channel
+    uint64_t                   max_load;        //load within the current limit
+    uint16_t                   current_limit_ma; //0 for no limit
+    uint16_t                   limit;           //output scale that keeps the frame within the limit, 256 for none
+#if NRF_DRV_WS2812_DITHER
+    uint8_t                    frame_count;     //selects the dithering step
+    bool                       dithering;       //the last frame encoded had colors between two output steps
+    volatile bool              encoding;        //the back buffer is being rewritten by show
+#else
+    uint8_t                 (* p_correction)[256]; //output value for every red, green and blue value
+#endif
+    uint8_t                    brightness;
+    uint8_t                    white_balance[3];  //red, green, blue
+    volatile bool              busy;            //a frame is being clocked out
+    volatile bool              pending;         //a frame is waiting for the current one to end
+    bool                       changed;         //pixels have been changed since the last show
+#if NRF_DRV_WS2812_STREAMING
+    uint16_t                   next_chunk;      //chunk of the running frame to put in the next free buffer
+    uint16_t                   frame_chunks;
+#else
+    uint8_t                    back_buffer;     //buffer that is not being clocked out
+    uint32_t                 * p_dirty[2];      //pixels changed since each buffer was last encoded, one bit per pixel
+#endif
+};
+
+/**@brief Define a strip and its buffers.
+ *
+ * @param _name        Name of the strip variable.
+ * @param _pwm_id      PWM instance to drive it with (0-2, 3 on devices that have PWM3). It must be
+ *                     enabled in sdk_config.h and not used by anything else.
+ * @param _max_pixels  Number of pixels the buffers are sized for.
+ */
+#if NRF_DRV_WS2812_STREAMING || NRF_DRV_WS2812_DITHER
+//the pixels are encoded for every frame, nothing to track per buffer
+#define NRF_DRV_WS2812_DIRTY_DEF(_name, _max_pixels)
+#define NRF_DRV_WS2812_DIRTY_INIT(_name)
+#else
+#define NRF_DRV_WS2812_DIRTY_DEF(_name, _max_pixels)                                            \
+    static uint32_t CONCAT_2(_name, _dirty)[2][NRF_DRV_WS2812_DIRTY_WORDS(_max_pixels)];
+#define NRF_DRV_WS2812_DIRTY_INIT(_name)                                                        \
+    .p_dirty      = { CONCAT_2(_name, _dirty)[0], CONCAT_2(_name, _dirty)[1] },
+#endif
+
+#if NRF_DRV_WS2812_DITHER
+//colors are corrected with arithmetic while encoding
+#define NRF_DRV_WS2812_CORRECTION_DEF(_name)
+#define NRF_DRV_WS2812_CORRECTION_INIT(_name)
+#else
+#define NRF_DRV_WS2812_CORRECTION_DEF(_name)                                                    \
+    static uint8_t CONCAT_2(_name, _correction)[3][256];
+#define NRF_DRV_WS2812_CORRECTION_INIT(_name)                                                   \
+    .p_correction = CONCAT_2(_name, _correction),
+#endif
+
+#define NRF_DRV_WS2812_DEF(_name, _pwm_id, _max_pixels)                                         \
+    static nrf_drv_WS2812_stored_pixel_t CONCAT_2(_name, _pixels)[_max_pixels];                 \
+    static uint32_t CONCAT_2(_name, _seq_words)[2][NRF_DRV_WS2812_SEQ_WORDS(_max_pixels)];      \
+    NRF_DRV_WS2812_CORRECTION_DEF(_name)                                                        \
+    NRF_DRV_WS2812_DIRTY_DEF(_name, _max_pixels)                                                \
+    static nrf_drv_WS2812_t _name =                                                             \
+    {                                                                                           \
+        .pwm          = NRF_DRV_PWM_INSTANCE(_pwm_id),                                          \
+        .p_pixels     = CONCAT_2(_name, _pixels),                                               \
+        .p_seq_words  = { CONCAT_2(_name, _seq_words)[0], CONCAT_2(_name, _seq_words)[1] },     \
+        NRF_DRV_WS2812_CORRECTION_INIT(_name)                                                   \
+        NRF_DRV_WS2812_DIRTY_INIT(_name)                                                        \
+        .max_pixels   = (_max_pixels)                                                           \
+    }
+
+/**@brief Set up the PWM instance of the strip and send an all off frame.
+ *
+ * @retval NRF_SUCCESS              If the strip was initialized.
+ * @retval NRF_ERROR_INVALID_PARAM  If nr_of_pixels is zero or larger than the buffers.
+ * @retval NRF_ERROR_INVALID_STATE  If the PWM instance is already in use.
+ */
+uint32_t nrf_drv_WS2812_init(nrf_drv_WS2812_t * p_strip, nrf_drv_WS2812_config_t const * p_config);
+
+/**@brief Set the color of one pixel, it is sent with the next @ref nrf_drv_WS2812_show.
+ *
+ * @details Writing the color a pixel already has does not count as a change.
+ */
+void nrf_drv_WS2812_set_pixel_rgb(nrf_drv_WS2812_t * p_strip, uint16_t pixel_nr, uint8_t red, uint8_t green, uint8_t blue);
+void nrf_drv_WS2812_set_pixel(nrf_drv_WS2812_t * p_strip, uint16_t pixel_nr, nrf_drv_WS2812_pixel_t *color);
+
+/**@brief Set the color of one pixel with 16 bits per color. Only the upper 8 bits are used
+ *        unless NRF_DRV_WS2812_DITHER is enabled.
+ */
+void nrf_drv_WS2812_set_pixel16(nrf_drv_WS2812_t * p_strip, uint16_t pixel_nr, uint16_t red, uint16_t green, uint16_t blue);
+
+/**@brief Get the color of one pixel as last set, with 16 bits per color. */
+void nrf_drv_WS2812_get_pixel16(nrf_drv_WS2812_t const * p_strip, uint16_t pixel_nr, nrf_drv_WS2812_pixel16_t * p_color);
+
+/**@brief Scale all colors of the strip, 255 is full brightness. Sent with the next
+ *        @ref nrf_drv_WS2812_show, the default is 255.
+ */
+void nrf_drv_WS2812_set_brightness(nrf_drv_WS2812_t * p_strip, uint8_t brightness);
+
+/**@brief Scale the channels separately to correct the white point of the LEDs. Sent with the
+ *        next @ref nrf_drv_WS2812_show, the default is 255 for all three.
+ */
+void nrf_drv_WS2812_set_white_balance(nrf_drv_WS2812_t * p_strip, uint8_t red, uint8_t green, uint8_t blue);
+
+/**@brief Limit the estimated current of the strip, brighter frames are dimmed evenly down to
+ *        it. Sent with the next @ref nrf_drv_WS2812_show, 0 turns the limit off.
+ */
+void nrf_drv_WS2812_set_current_limit(nrf_drv_WS2812_t * p_strip, uint16_t limit_ma);
+
+/**@brief Get the estimated current of the pixels as set, with the limit of the frame last shown
+ *        applied, in mA. Sums the whole strip, it is meant for telemetry and not for every frame.
+ */
+uint16_t nrf_drv_WS2812_get_current(nrf_drv_WS2812_t const * p_strip);
+
+/**@brief Encode the changed pixels into the free sequence buffer and send it.
+ *
+ * @details Does nothing if no pixel has changed since the last call. Does not wait. If a frame is still being clocked out the new one is sent when it
+ *          ends, a later call before that replaces the waiting frame. Strips on different PWM
+ *          instances are clocked out in parallel.
+ */
+void nrf_drv_WS2812_show(nrf_drv_WS2812_t * p_strip);
+
+/**@brief Check if a frame is being clocked out or waiting to be. */
+bool nrf_drv_WS2812_is_busy(nrf_drv_WS2812_t const * p_strip);
 
 #endif //NRF_DRV_WS2812
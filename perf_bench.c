@@ -0,0 +1,211 @@
+
+#include <string.h>
+
+#include "sdk_common.h"
+#include "light_animation.h"
+#include "perf_bench.h"
+
+#define OVERHEAD_SAMPLES            16
+
+//hue cycle in the encoding of the animation characteristic: forever, red to blue and back in
+//500 ms each. No delay between the pixels, so each one is interpolated, not only the first.
+static uint8_t const m_hue_cycle[] =
+{
+    LIGHT_ANIMATION_REPEAT_FOREVER, 0,
+    0xFF, 0x00, 0x00, 50, LIGHT_ANIMATION_HUE << 6,
+    0x00, 0x00, 0xFF, 50, LIGHT_ANIMATION_HUE << 6,
+};
+
+static perf_bench_init_t m_config;
+static uint32_t          m_overhead;                //cycles of reading the counter twice
+
+static perf_bench_stat_t m_latency;
+static uint32_t          m_write_cycles;
+static volatile bool     m_write_pending;
+
+
+static void stat_reset(perf_bench_stat_t * p_stat)
+{
+    memset(p_stat, 0, sizeof(perf_bench_stat_t));
+    p_stat->min = UINT32_MAX;
+}
+
+
+static void stat_report(char const * p_name, perf_bench_stat_t const * p_stat)
+{
+    if(m_config.report_handler != NULL && p_stat->count != 0)
+    {
+        m_config.report_handler(p_name, m_config.nr_of_pixels, p_stat);
+    }
+}
+
+
+// Every pixel gets a new color, else show() only encodes the changed ones.
+static void pixels_fill(uint32_t seed)
+{
+    for(uint16_t i = 0; i < m_config.nr_of_pixels; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        nrf_drv_WS2812_set_pixel_rgb(m_config.p_strip, i, seed >> 24, seed >> 16, seed >> 8);
+    }
+}
+
+
+// The first frame of an animation interpolates from the color of pixel 0, a new one every time
+// keeps the frames from being the same.
+static void start_color_set(uint32_t seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    nrf_drv_WS2812_set_pixel_rgb(m_config.p_strip, 0, seed >> 24, seed >> 16, seed >> 8);
+}
+
+
+// Full frame, the work behind every change of all pixels.
+static void encode_measure(void)
+{
+    perf_bench_stat_t stat;
+
+    stat_reset(&stat);
+    for(uint16_t n = 0; n < m_config.iterations; n++)
+    {
+        uint32_t start;
+
+        pixels_fill(n + 1);
+        start = perf_bench_cycles();
+        nrf_drv_WS2812_show(m_config.p_strip);
+        perf_bench_stat_add(&stat, perf_bench_cycles() - start);
+    }
+    stat_report("encode", &stat);
+}
+
+
+// Interpolating the colors of every pixel and setting them, without showing them.
+static void frame_measure(light_animation_t const * p_animation)
+{
+    perf_bench_stat_t stat;
+    uint32_t          err_code;
+
+    stat_reset(&stat);
+    for(uint16_t n = 0; n < m_config.iterations; n++)
+    {
+        uint32_t start;
+
+        start_color_set(n + 1);
+        start    = perf_bench_cycles();
+        err_code = light_animation_start(p_animation);
+        perf_bench_stat_add(&stat, perf_bench_cycles() - start);
+        APP_ERROR_CHECK(err_code);
+    }
+    light_animation_stop();
+    stat_report("frame", &stat);
+}
+
+
+// What an animation written over BLE goes through before its first frame is on the pwm.
+static void write_measure(void)
+{
+    perf_bench_stat_t stat;
+    light_animation_t animation;
+    uint32_t          err_code;
+
+    stat_reset(&stat);
+    for(uint16_t n = 0; n < m_config.iterations; n++)
+    {
+        uint32_t start;
+
+        start_color_set(n + 1);
+        start    = perf_bench_cycles();
+        err_code = light_animation_decode(&animation, m_hue_cycle, sizeof(m_hue_cycle));
+        if(err_code == NRF_SUCCESS)
+        {
+            err_code = light_animation_start(&animation);
+        }
+        nrf_drv_WS2812_show(m_config.p_strip);
+        perf_bench_stat_add(&stat, perf_bench_cycles() - start);
+        APP_ERROR_CHECK(err_code);
+    }
+    light_animation_stop();
+    stat_report("write", &stat);
+}
+
+
+void perf_bench_init(perf_bench_init_t const * p_init)
+{
+    m_config = *p_init;
+
+#if defined(__arm__)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+    m_overhead = UINT32_MAX;
+    for(uint8_t i = 0; i < OVERHEAD_SAMPLES; i++)
+    {
+        uint32_t start = perf_bench_cycles();
+
+        m_overhead = MIN(m_overhead, perf_bench_cycles() - start);
+    }
+
+    stat_reset(&m_latency);
+    m_write_pending = false;
+}
+
+
+void perf_bench_run(void)
+{
+    light_animation_t animation;
+    uint32_t          err_code;
+
+    encode_measure();
+
+    err_code = light_animation_decode(&animation, m_hue_cycle, sizeof(m_hue_cycle));
+    APP_ERROR_CHECK(err_code);
+    frame_measure(&animation);
+
+    write_measure();
+}
+
+
+void perf_bench_stat_add(perf_bench_stat_t * p_stat, uint32_t cycles)
+{
+    cycles = (cycles > m_overhead) ? cycles - m_overhead : 0;
+
+    p_stat->count++;
+    p_stat->sum += cycles;
+    p_stat->min = MIN(p_stat->min, cycles);
+    p_stat->max = MAX(p_stat->max, cycles);
+}
+
+
+void perf_bench_write_mark(void)
+{
+    if(!m_write_pending)
+    {
+        m_write_cycles  = perf_bench_cycles();
+        m_write_pending = true;
+    }
+}
+
+
+void perf_bench_write_cancel(void)
+{
+    m_write_pending = false;
+}
+
+
+void perf_bench_show_mark(void)
+{
+    if(!m_write_pending)
+    {
+        return;
+    }
+    m_write_pending = false;
+
+    perf_bench_stat_add(&m_latency, perf_bench_cycles() - m_write_cycles);
+    if(m_latency.count == PERF_BENCH_LATENCY_SAMPLES)
+    {
+        stat_report("latency", &m_latency);
+        stat_reset(&m_latency);
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef PERF_BENCH_H__
+#define PERF_BENCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nrf_drv_WS2812.h"
+
+/* Cycle counts of the render path: encoding a frame in nrf_drv_WS2812_show(), building one in
+ * light_animation and the way from an animation written over BLE to a frame on the pwm. On the
+ * target the DWT cycle counter is read, on the host the time stamp counter, see host/Makefile.
+ *
+ * The same synthetic workload runs on both, so the numbers of a change can be had on the host
+ * first. On the target the write to photon latency of the real BLE writes is measured as well,
+ * up to the frame being handed to the pwm, the first LED latches it one reset period later.
+ */
+
+#ifndef PERF_BENCH_ENABLED
+#define PERF_BENCH_ENABLED                  0           //set to 1 to run the benchmark at start and measure the BLE writes
+#endif
+
+#define PERF_BENCH_LATENCY_SAMPLES          16          //BLE writes measured per latency report
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+} perf_bench_stat_t;
+
+/**@brief Called with the result of one measurement, in cycles.
+ *
+ * @param[in] p_name        What was measured.
+ * @param[in] nr_of_pixels  Strip length it was measured with.
+ */
+typedef void (*perf_bench_report_handler_t)(char const * p_name, uint16_t nr_of_pixels, perf_bench_stat_t const * p_stat);
+
+typedef struct
+{
+    nrf_drv_WS2812_t *          p_strip;            /**< Initialized strip the frames are encoded for. */
+    uint16_t                    nr_of_pixels;
+    uint16_t                    iterations;         /**< Frames per measurement. */
+    perf_bench_report_handler_t report_handler;
+} perf_bench_init_t;
+
+#if defined(__arm__)
+
+#include "nrf.h"
+
+static __INLINE uint32_t perf_bench_cycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+#elif defined(__x86_64__) || defined(__i386__)
+
+#include <x86intrin.h>
+
+static inline uint32_t perf_bench_cycles(void)
+{
+    return (uint32_t)__rdtsc();
+}
+
+#else
+
+#include <time.h>
+
+//no cycle counter to read, ns instead
+static inline uint32_t perf_bench_cycles(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec);
+}
+
+#endif
+
+/**@brief Start the cycle counter and find the cost of reading it, which is taken off every
+ *        measurement.
+ */
+void perf_bench_init(perf_bench_init_t const * p_init);
+
+/**@brief Measure encode time, frame build time and write to show time, reported per measurement.
+ *
+ * @details light_animation must be initialized for the same strip, with a show handler that does
+ *          not show the frame right away, so frame building is measured without the encoding.
+ *          The animation is stopped and the pixels are left changed when it returns.
+ */
+void perf_bench_run(void);
+
+void perf_bench_stat_add(perf_bench_stat_t * p_stat, uint32_t cycles);
+
+/**@brief A BLE write came in, kept until its frame is shown. Later writes go into the same frame.
+ */
+void perf_bench_write_mark(void);
+
+/**@brief The write did not change the LEDs, forget it. */
+void perf_bench_write_cancel(void);
+
+/**@brief A frame was handed to the pwm, ends the latency of the write marked before it.
+ */
+void perf_bench_show_mark(void);
+
+#endif //PERF_BENCH_H__
@@ -6,6 +6,9 @@
 
 #define CHARGE_STAT_PIN 8
 
+//the battery gauge is only built with BATTERY_AIN, the SAADC input the cell is wired to, and
+//BATTERY_DIVIDER_NUM / BATTERY_DIVIDER_DEN, the ratio of the divider in front of it
+
 #define ACC_CS_PIN      15
 #define ACC_SCK_PIN     31
 #define ACC_MOSI_PIN    17
@@ -0,0 +1,391 @@
+
+#include <string.h>
+
+#include "sdk_common.h"
+#include "app_util_platform.h"
+#include "fstorage.h"
+#include "preset_store.h"
+
+#define PAGE_MAGIC              0x31545350  //"PST1"
+#define PAGE_HEADER_WORDS       2           //magic and generation, written last so a page is only
+                                            //valid once all records were copied to it
+#define NR_OF_PAGES             2
+#define RECORD_END              0xFFFFFFFF  //erased flash, no record there yet
+
+//record header word: key, length in bytes, checksum of the data
+#define HEADER(key, length, sum)    ((uint32_t)(key) | ((uint32_t)(length) << 8) | ((uint32_t)(sum) << 16))
+#define HEADER_KEY(header)          ((header) & 0xFF)
+#define HEADER_LENGTH(header)       (((header) >> 8) & 0xFF)
+#define HEADER_SUM(header)          ((header) >> 16)
+
+//after compaction every key at full length plus the next record has to fit, else it never ends
+#define RECORD_MAX_WORDS            (1 + PRESET_STORE_MAX_LENGTH / 4)
+STATIC_ASSERT(PAGE_HEADER_WORDS + (PRESET_STORE_NR_OF_KEYS + 1) * RECORD_MAX_WORDS <= FS_PAGE_SIZE_WORDS);
+STATIC_ASSERT(PRESET_STORE_MAX_LENGTH % 4 == 0 && PRESET_STORE_MAX_LENGTH <= 0xFF);
+
+static void fs_evt_handler(fs_evt_t const * const evt, fs_ret_t result);
+
+FS_REGISTER_CFG(fs_config_t m_fs_config) =
+{
+    .callback  = fs_evt_handler,
+    .num_pages = NR_OF_PAGES,
+    .priority  = 0xFE
+};
+
+//what the flash is busy with
+static enum
+{
+    OP_APPEND,
+    OP_ERASE,
+    OP_COPY,
+    OP_HEADER,
+} m_op;
+
+static uint8_t          m_active;                           //page the log is in
+static uint32_t         m_generation;                       //of the active page, the newer page wins
+static uint32_t const * mp_write;                           //next free word in the active page
+static uint32_t const * m_index[PRESET_STORE_NR_OF_KEYS];   //newest record of each key, NULL if none
+
+//written values waiting for the flash, copied in so the caller's buffer is free right away
+static struct
+{
+    bool    dirty;
+    uint8_t length;
+    uint8_t seq;                                            //changes on every write
+    uint8_t data[PRESET_STORE_MAX_LENGTH];
+} m_pending[PRESET_STORE_NR_OF_KEYS];
+
+static volatile bool    m_busy;
+static uint32_t         m_record[RECORD_MAX_WORDS];          //the flash writes from here
+static uint8_t          m_op_key;
+static uint8_t          m_op_seq;
+static uint16_t         m_op_words;
+
+//while the newest records are copied to the other page
+static uint32_t const * mp_copy;
+static uint32_t const * m_copy_index[PRESET_STORE_NR_OF_KEYS];
+
+static void next_op(void);
+
+
+static uint32_t const * page_get(uint8_t page)
+{
+    return m_fs_config.p_start_addr + page * FS_PAGE_SIZE_WORDS;
+}
+
+
+static uint16_t record_words(uint8_t length)
+{
+    return 1 + (length + 3) / 4;
+}
+
+
+// Fletcher-16, a torn write is caught by it.
+static uint16_t checksum(uint8_t const * p_data, uint8_t length)
+{
+    uint16_t sum1 = 0;
+    uint16_t sum2 = 0;
+
+    for (uint8_t i = 0; i < length; i++)
+    {
+        sum1 = (sum1 + p_data[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+
+    return (sum2 << 8) | sum1;
+}
+
+
+static bool page_is_valid(uint8_t page)
+{
+    return page_get(page)[0] == PAGE_MAGIC;
+}
+
+
+// Index the newest record of every key, returns where the next record goes.
+static uint32_t const * page_scan(uint8_t page)
+{
+    uint32_t const * p_record = page_get(page) + PAGE_HEADER_WORDS;
+    uint32_t const * p_end    = page_get(page) + FS_PAGE_SIZE_WORDS;
+
+    memset(m_index, 0, sizeof(m_index));
+
+    while (p_record < p_end && *p_record != RECORD_END)
+    {
+        uint32_t header = *p_record;
+        uint16_t words  = record_words(HEADER_LENGTH(header));
+
+        if (p_record + words > p_end)
+        {
+            //torn header, nothing fits behind it anyway
+            return p_end;
+        }
+
+        if (HEADER_KEY(header) < PRESET_STORE_NR_OF_KEYS &&
+            HEADER_SUM(header) == checksum((uint8_t const *)(p_record + 1), HEADER_LENGTH(header)))
+        {
+            m_index[HEADER_KEY(header)] = p_record;
+        }
+        p_record += words;
+    }
+
+    return p_record;
+}
+
+
+// Copy the newest records to the other page, starting by erasing it.
+static void compaction_start(void)
+{
+    m_op = OP_ERASE;
+    if (fs_erase(&m_fs_config, page_get(m_active ^ 1), 1, NULL) != FS_SUCCESS)
+    {
+        m_busy = false;
+    }
+}
+
+
+static void copy_next(void)
+{
+    uint32_t const * p_record = NULL;
+
+    for (; m_op_key < PRESET_STORE_NR_OF_KEYS; m_op_key++)
+    {
+        //deleted values are left behind
+        p_record = m_index[m_op_key];
+        if (p_record != NULL && HEADER_LENGTH(*p_record) != 0)
+        {
+            break;
+        }
+    }
+
+    if (m_op_key < PRESET_STORE_NR_OF_KEYS)
+    {
+        m_op       = OP_COPY;
+        m_op_words = record_words(HEADER_LENGTH(*p_record));
+        memcpy(m_record, p_record, m_op_words * sizeof(uint32_t));
+        p_record   = mp_copy;
+    }
+    else
+    {
+        //all there, now the page may count
+        m_op        = OP_HEADER;
+        m_op_words  = PAGE_HEADER_WORDS;
+        m_record[0] = PAGE_MAGIC;
+        m_record[1] = m_generation + 1;
+        p_record    = page_get(m_active ^ 1);
+    }
+
+    if (fs_store(&m_fs_config, p_record, m_record, m_op_words, NULL) != FS_SUCCESS)
+    {
+        m_busy = false;
+    }
+}
+
+
+// Append the next waiting value, or stop when there is none.
+static void next_op(void)
+{
+    uint8_t key;
+    uint8_t length;
+
+    CRITICAL_REGION_ENTER();
+    for (key = 0; key < PRESET_STORE_NR_OF_KEYS && !m_pending[key].dirty; key++)
+    {
+    }
+    if (key == PRESET_STORE_NR_OF_KEYS)
+    {
+        m_busy = false;
+    }
+    else
+    {
+        length = m_pending[key].length;
+        m_record[0] = HEADER(key, length, checksum(m_pending[key].data, length));
+        memcpy(&m_record[1], m_pending[key].data, length);
+        m_op_seq = m_pending[key].seq;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (key == PRESET_STORE_NR_OF_KEYS)
+    {
+        return;
+    }
+
+    m_op       = OP_APPEND;
+    m_op_key   = key;
+    m_op_words = record_words(length);
+
+    if (mp_write + m_op_words > page_get(m_active) + FS_PAGE_SIZE_WORDS)
+    {
+        compaction_start();
+        return;
+    }
+
+    if (fs_store(&m_fs_config, mp_write, m_record, m_op_words, NULL) != FS_SUCCESS)
+    {
+        m_busy = false;
+    }
+}
+
+
+static void fs_evt_handler(fs_evt_t const * const evt, fs_ret_t result)
+{
+    switch (m_op)
+    {
+        case OP_APPEND:
+            //a failed write may have left some words written, the checksum rules them out
+            if (result == FS_SUCCESS)
+            {
+                m_index[m_op_key] = mp_write;
+
+                CRITICAL_REGION_ENTER();
+                if (m_pending[m_op_key].seq == m_op_seq)
+                {
+                    m_pending[m_op_key].dirty = false;
+                }
+                CRITICAL_REGION_EXIT();
+            }
+            mp_write += m_op_words;
+            break;
+
+        case OP_ERASE:
+            if (result == FS_SUCCESS)
+            {
+                memset(m_copy_index, 0, sizeof(m_copy_index));
+                mp_copy  = page_get(m_active ^ 1) + PAGE_HEADER_WORDS;
+                m_op_key = 0;
+                copy_next();
+                return;
+            }
+            break;
+
+        case OP_COPY:
+            if (result == FS_SUCCESS)
+            {
+                m_copy_index[m_op_key] = mp_copy;
+                mp_copy += m_op_words;
+                m_op_key++;
+                copy_next();
+                return;
+            }
+            break;
+
+        case OP_HEADER:
+            if (result == FS_SUCCESS)
+            {
+                mp_write      = mp_copy;
+                m_active     ^= 1;
+                m_generation += 1;
+                memcpy(m_index, m_copy_index, sizeof(m_index));
+            }
+            break;
+    }
+
+    if (result != FS_SUCCESS)
+    {
+        //tried again with the next write
+        m_busy = false;
+        return;
+    }
+
+    next_op();
+}
+
+
+uint32_t preset_store_init(void)
+{
+    uint8_t  newest = NR_OF_PAGES;
+
+    if (fs_init() != FS_SUCCESS)
+    {
+        return NRF_ERROR_INTERNAL;
+    }
+
+    for (uint8_t page = 0; page < NR_OF_PAGES; page++)
+    {
+        if (page_is_valid(page) &&
+            (newest == NR_OF_PAGES || (int32_t)(page_get(page)[1] - page_get(newest)[1]) > 0))
+        {
+            newest = page;
+        }
+    }
+
+    if (newest == NR_OF_PAGES)
+    {
+        //nothing stored yet, make page 0 the first one with no records to copy
+        memset(m_index, 0, sizeof(m_index));
+        m_active     = 1;
+        m_generation = 0;
+        m_busy       = true;
+        compaction_start();
+        return NRF_SUCCESS;
+    }
+
+    m_active     = newest;
+    m_generation = page_get(newest)[1];
+    mp_write     = page_scan(newest);
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t preset_store_write(uint8_t key, void const * p_data, uint8_t length)
+{
+    bool start;
+
+    if (key >= PRESET_STORE_NR_OF_KEYS)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (length > PRESET_STORE_MAX_LENGTH)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    CRITICAL_REGION_ENTER();
+    memcpy(m_pending[key].data, p_data, length);
+    m_pending[key].length = length;
+    m_pending[key].dirty  = true;
+    m_pending[key].seq++;
+    start  = !m_busy;
+    m_busy = true;
+    CRITICAL_REGION_EXIT();
+
+    if (start)
+    {
+        next_op();
+    }
+
+    return NRF_SUCCESS;
+}
+
+
+uint8_t preset_store_read(uint8_t key, void * p_data, uint8_t max_length)
+{
+    uint8_t length = 0;
+
+    if (key >= PRESET_STORE_NR_OF_KEYS)
+    {
+        return 0;
+    }
+
+    CRITICAL_REGION_ENTER();
+    if (m_pending[key].dirty)
+    {
+        length = m_pending[key].length;
+        memcpy(p_data, m_pending[key].data, MIN(length, max_length));
+    }
+    else if (m_index[key] != NULL)
+    {
+        length = HEADER_LENGTH(*m_index[key]);
+        memcpy(p_data, m_index[key] + 1, MIN(length, max_length));
+    }
+    CRITICAL_REGION_EXIT();
+
+    return length;
+}
+
+
+bool preset_store_is_busy(void)
+{
+    return m_busy;
+}
@@ -0,0 +1,50 @@
+#ifndef PRESET_STORE_H__
+#define PRESET_STORE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Small settings that survive a reset, in flash through fstorage. Every change is appended as a
+ * record to a log filling one flash page, a RAM index points at the newest record of each key.
+ * When the page is full the newest records are copied to the other page and the two swap, so the
+ * pages wear evenly and are only erased once per page full of changes.
+ *
+ * Writes are copied and done in the background, a read returns the value written last even
+ * before it reached flash.
+ */
+
+#define PRESET_STORE_MAX_LENGTH         64          //bytes per value
+#define PRESET_STORE_NR_OF_PRESETS      4
+
+typedef enum
+{
+    PRESET_STORE_KEY_SCENE,                         /**< What was on the LEDs last. */
+    PRESET_STORE_KEY_BRIGHTNESS,
+    PRESET_STORE_KEY_PRESET,                        /**< First of the user presets. */
+    PRESET_STORE_NR_OF_KEYS = PRESET_STORE_KEY_PRESET + PRESET_STORE_NR_OF_PRESETS
+} preset_store_key_t;
+
+/**@brief Find the newest records, fstorage is initialized here too.
+ *
+ * @details Forward the system events to fs_sys_event_handler.
+ */
+uint32_t preset_store_init(void);
+
+/**@brief Store a value, replacing the one stored before under the key. A length of 0 deletes it.
+ *
+ * @retval NRF_SUCCESS              If the value is stored or will be soon.
+ * @retval NRF_ERROR_INVALID_PARAM  If the key is unknown.
+ * @retval NRF_ERROR_INVALID_LENGTH If the value is longer than @ref PRESET_STORE_MAX_LENGTH.
+ */
+uint32_t preset_store_write(uint8_t key, void const * p_data, uint8_t length);
+
+/**@brief Read the value stored under a key.
+ *
+ * @return Length of the value, 0 if there is none. At most max_length bytes are copied.
+ */
+uint8_t preset_store_read(uint8_t key, void * p_data, uint8_t max_length);
+
+/**@brief Writes not yet in flash. */
+bool preset_store_is_busy(void);
+
+#endif //PRESET_STORE_H__
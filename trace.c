@@ -0,0 +1,120 @@
+
+#include <string.h>
+
+#include "sdk_common.h"
+#include "SEGGER_RTT.h"
+#include "trace.h"
+
+#if TRACE_ENABLED
+
+STATIC_ASSERT((TRACE_BUFFER_SIZE & (TRACE_BUFFER_SIZE - 1)) == 0);
+STATIC_ASSERT(TRACE_NR_OF_EVTS <= 0x100);
+
+#define RTT_CHUNK_RECORDS           16          //records written to RTT at once
+
+trace_record_t    trace_buffer[TRACE_BUFFER_SIZE];
+volatile uint32_t trace_head;                   //records taken so far, the next one goes here
+
+static uint8_t        m_rtt_buffer[TRACE_RTT_BUFFER_SIZE];
+static trace_reader_t m_rtt_reader;
+
+
+void trace_init(void)
+{
+    //records are only written whole, those that do not fit wait for the next flush
+    UNUSED_RETURN_VALUE(SEGGER_RTT_ConfigUpBuffer(TRACE_RTT_CHANNEL, "trace", m_rtt_buffer, sizeof(m_rtt_buffer),
+                                                  SEGGER_RTT_MODE_NO_BLOCK_SKIP));
+}
+
+
+uint16_t trace_get(trace_reader_t * p_reader, trace_record_t * p_records, uint16_t max_records)
+{
+    uint32_t head  = trace_head;
+    uint16_t count = 0;
+    uint16_t lost  = 0;
+
+    if(head - p_reader->index > TRACE_BUFFER_SIZE)
+    {
+        //lapped, go on with the oldest record still there
+        p_reader->lost += head - TRACE_BUFFER_SIZE - p_reader->index;
+        p_reader->index = head - TRACE_BUFFER_SIZE;
+    }
+
+    if(max_records != 0 && p_reader->lost != 0)
+    {
+        p_records[0].arg = p_reader->lost;
+        lost = 1;
+    }
+
+    while(lost + count < max_records && p_reader->index + count != head)
+    {
+        p_records[lost + count] = trace_buffer[(p_reader->index + count) & (TRACE_BUFFER_SIZE - 1)];
+        count++;
+    }
+
+    if(trace_head - p_reader->index > TRACE_BUFFER_SIZE)
+    {
+        //some were overwritten while they were copied, the next call skips them
+        return 0;
+    }
+
+    if(lost != 0)
+    {
+        //dated like the record after the gap, the timeline stays in order
+        p_records[0].event_time = TRACE_EVT_LOST | ((count != 0) ? (p_records[1].event_time & ~0xFFUL) : (NRF_RTC1->COUNTER << 8));
+    }
+
+    return lost + count;
+}
+
+
+void trace_consume(trace_reader_t * p_reader, uint16_t nr_of_records)
+{
+    if(nr_of_records != 0 && p_reader->lost != 0)
+    {
+        p_reader->lost = 0;
+        nr_of_records--;
+    }
+    p_reader->index += nr_of_records;
+}
+
+
+void trace_rtt_flush(void)
+{
+    trace_record_t records[RTT_CHUNK_RECORDS];
+    uint16_t       count;
+
+    while((count = trace_get(&m_rtt_reader, records, RTT_CHUNK_RECORDS)) != 0)
+    {
+        if(SEGGER_RTT_Write(TRACE_RTT_CHANNEL, records, count * sizeof(trace_record_t)) == 0)
+        {
+            //no room, nobody reads the channel or not fast enough
+            return;
+        }
+        trace_consume(&m_rtt_reader, count);
+    }
+}
+
+#else
+
+void trace_init(void)
+{
+}
+
+
+uint16_t trace_get(trace_reader_t * p_reader, trace_record_t * p_records, uint16_t max_records)
+{
+    return 0;
+}
+
+
+void trace_consume(trace_reader_t * p_reader, uint16_t nr_of_records)
+{
+}
+
+
+void trace_rtt_flush(void)
+{
+}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef TRACE_H__
+#define TRACE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Binary trace of the hot paths. Each event is a record of two words in a ring buffer in RAM,
+ * taken in a handful of cycles and without formatting, so it can stay on in production builds.
+ * The main loop copies new records to their own RTT channel and notifies them on the trace
+ * characteristic of the Glass Light Service, host/trace_decode turns them into a timeline.
+ *
+ * A record is, little endian:
+ *  - word 0: the event in bits 0-7, the RTC1 counter app_timer runs on in bits 8-31
+ *  - word 1: an argument, see @ref trace_evt_t
+ * Records a reader did not get to before they were overwritten are replaced by one
+ * @ref TRACE_EVT_LOST record.
+ */
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED                   1
+#endif
+
+#define TRACE_BUFFER_SIZE               128         //records, a power of two
+#define TRACE_RTT_CHANNEL               1           //up channel the records are written to, 0 is NRF_LOG's
+#define TRACE_RTT_BUFFER_SIZE           512         //bytes
+
+typedef enum
+{
+    TRACE_EVT_LOST,                     /**< Records overwritten before they were read, arg: how many. */
+    TRACE_EVT_BLE_WRITE,                /**< arg: attribute handle, length in bits 16-31. */
+    TRACE_EVT_FRAME_ENCODED,            /**< show() returned, arg: 1 if the frame waits for the one clocked out. */
+    TRACE_EVT_PWM_START,
+    TRACE_EVT_PWM_END,
+    TRACE_EVT_TIMESLOT_START,           /**< arg: beacon frame sent in it. */
+    TRACE_EVT_TIMESLOT_END,             /**< arg: time the radio ran in the slot, in us. */
+    TRACE_EVT_TIMESLOT_BLOCKED,         /**< arg: slot requests blocked so far. */
+    TRACE_EVT_TIMESLOT_CANCELED,        /**< arg: slot requests canceled so far. */
+    TRACE_EVT_ACC_FIFO,                 /**< Accelerometer FIFO read, arg: samples. */
+    TRACE_EVT_SYS,                      /**< Timeslot session idle or closed, arg: the SoC event. */
+    TRACE_NR_OF_EVTS
+} trace_evt_t;
+
+typedef struct
+{
+    uint32_t event_time;
+    uint32_t arg;
+} trace_record_t;
+
+/**@brief Position of one consumer of the records. Zero it to start at the oldest record. */
+typedef struct
+{
+    uint32_t index;
+    uint32_t lost;
+} trace_reader_t;
+
+#if TRACE_ENABLED
+
+#include "nrf.h"
+
+extern trace_record_t    trace_buffer[TRACE_BUFFER_SIZE];
+extern volatile uint32_t trace_head;
+
+/**@brief Record an event, from any interrupt priority. Use @ref TRACE. */
+static __INLINE void trace_record(uint8_t event, uint32_t arg)
+{
+    uint32_t         index;
+    trace_record_t * p_record;
+
+    //an interrupt in between clears the exclusive access, the store then fails and it is tried again
+    do
+    {
+        index = __LDREXW((uint32_t *)&trace_head);
+    } while(__STREXW(index + 1, (uint32_t *)&trace_head) != 0);
+
+    p_record = &trace_buffer[index & (TRACE_BUFFER_SIZE - 1)];
+    p_record->arg        = arg;
+    p_record->event_time = event | (NRF_RTC1->COUNTER << 8);
+}
+
+#define TRACE(event, arg)       trace_record((event), (uint32_t)(arg))
+
+#else
+
+#define TRACE(event, arg)       ((void)0)
+
+#endif
+
+/**@brief Set up the RTT channel. NRF_LOG is not needed for it. */
+void trace_init(void);
+
+/**@brief Copy the records a reader has not had yet, oldest first. They stay unread until
+ *        @ref trace_consume.
+ *
+ * @return Number of records copied.
+ */
+uint16_t trace_get(trace_reader_t * p_reader, trace_record_t * p_records, uint16_t max_records);
+
+/**@brief Mark records returned by @ref trace_get as read. */
+void trace_consume(trace_reader_t * p_reader, uint16_t nr_of_records);
+
+/**@brief Write the new records to the RTT channel, from the main loop. */
+void trace_rtt_flush(void);
+
+#endif //TRACE_H__